@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui concurrent network
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -18,20 +18,37 @@ QMAKE_TARGET_COPYRIGHT		= "Copyright (C) 2015 SantiX"
 RC_ICONS 					= "Resources/ETSRadioManager.ico"
 
 
+include(parser.pri)
+
 SOURCES += main.cpp\
         mainwindow.cpp \
     aboutdialog.cpp \
-    parser.cpp \
+    diagnosticsdialog.cpp \
+    streamtablemodel.cpp \
+    streamloader.cpp \
+    streamcommands.cpp \
+    streamfiltermodel.cpp \
+    streamchecker.cpp \
     insertdialog.cpp
 
 HEADERS  += mainwindow.h \
-    parser.h \
+    streamtablemodel.h \
+    streamloader.h \
+    streamcommands.h \
+    streamfiltermodel.h \
+    streamchecker.h \
     aboutdialog.h \
+    diagnosticsdialog.h \
     insertdialog.h
 
 FORMS    += mainwindow.ui \
     aboutdialog.ui \
+    diagnosticsdialog.ui \
     insertdialog.ui
 
 RESOURCES += \
     Icons.qrc
+
+# Headless command line tool (QtCore only), built into cli/ with "make cli".
+cli.commands = $(MKDIR) cli && cd cli && $(QMAKE) $$PWD/cli/etsradiocli.pro && $(MAKE)
+QMAKE_EXTRA_TARGETS += cli
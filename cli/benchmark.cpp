@@ -0,0 +1,627 @@
+#include "benchmark.h"
+#include "parser.h"
+#include "linescanner.h"
+#include "streamcache.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QThread>
+#include <algorithm>
+
+// Deterministic pseudo-random numbers, so that every run measures the same
+// files and the same sequence of edits.
+class Lcg {
+public:
+    explicit Lcg(quint32 seed): state_(seed) {}
+
+    quint32 next(quint32 bound)
+    {
+        state_ = state_ * 1664525u + 1013904223u;
+        return (state_ >> 8) % bound;
+    }
+
+private:
+    quint32 state_;
+};
+
+
+// The QString codec that Parser::unescapeString() and escapeString() replaced,
+// kept as it was to measure them against. It only handles 2-byte characters:
+// longer ones come out wrong, but take about as long.
+static QChar legacyCodePoint(unsigned int word)
+{
+    unsigned int high   = (word & 0x1F00);
+    unsigned int low    = (word & 0x003F);
+
+    return (high>>2) | low ;
+}
+
+static QString legacyUnescape(const QString& str)
+{
+    QString res;
+    int i = 0;
+    while (i < str.length()) {
+        if (str[i] == '\\') {
+            QString high    = str.mid(i+2, 2);
+            QString low     = str.mid(i+6, 2);
+            i = i + 8;
+
+            QString code_str(high);
+            code_str.append(low);
+            res.append(legacyCodePoint(code_str.toInt(NULL, 16)));
+        }
+        else {
+            res.append(str[i]);
+            i++;
+        }
+    }
+    return res;
+}
+
+static QString legacyEscape(const QString& str)
+{
+    QString res;
+    for (int i = 0; i < str.length(); i++) {
+        if (str[i].unicode() > 127) {
+            QByteArray ca;
+            ca.append(str[i]);
+            ca = ca.toHex();
+            bool ok = false;
+            unsigned int code = ca.toUInt(&ok, 16);
+            if (!ok) {
+                continue;
+            }
+            unsigned int high = (code & 0xFF00)>>8;
+            unsigned int low = code & 0x00FF;
+            res.append("\\x" + QString::number(high, 16) + "\\x" + QString::number(low, 16));
+        }
+        else {
+            res.append(str[i]);
+        }
+    }
+    return res;
+}
+
+// How the list was read before the arena: a QTextStream line by line, into a
+// QList<Stream> of two QStrings per entry.
+static void legacyReadStreams(const QString& filename, QList<Stream>& streams)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly|QIODevice::Text)) {
+        return;
+    }
+
+    QTextStream in(&file);
+    in.setCodec("UTF-8");
+    while (!in.atEnd()) {
+        QString l = in.readLine();
+        if (l.contains("live_stream_def", Qt::CaseInsensitive)) {
+            continue;
+        }
+
+        int first_quote = l.indexOf('"');
+        if (first_quote != -1) {
+            int last_quote  = l.lastIndexOf('"');
+            int separator   = l.indexOf('|');
+
+            QString url     = l.mid(first_quote+1, separator-first_quote-1);
+            QString name    = legacyUnescape(l.mid(separator+1, last_quote-separator-1));
+            streams.push_back(Stream(url, name));
+        }
+    }
+}
+
+// Counted as StreamList::memoryUsage() counts: what is allocated, without the
+// allocator's own overhead. Stream is too large to be stored in the QList's
+// array, so every entry is a node of its own, and each of its QStrings has a
+// header.
+static qint64 legacyMemoryUsage(const QList<Stream>& streams)
+{
+    qint64 bytes = sizeof(streams) + qint64(streams.size()) * (sizeof(void*) + sizeof(Stream));
+    foreach (const Stream& s, streams) {
+        bytes += 2 * qint64(sizeof(QString::Data))
+               + qint64(s.url.capacity() + 1 + s.name.capacity() + 1) * sizeof(QChar);
+    }
+    return bytes;
+}
+
+
+Benchmark::Benchmark(const QList<int>& sizes, const QList<double>& escaped_ratios, int repeat):
+sizes_(sizes),
+escaped_ratios_(escaped_ratios),
+repeat_(qMax(1, repeat))
+{
+}
+
+bool Benchmark::run(QTextStream& out)
+{
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        return false;
+    }
+
+    out << QString("%1 %2 %3 %4 %5 %6 %7")
+           .arg("operation", -22).arg("entries", 8).arg("escaped", 8)
+           .arg("ns/entry", 12).arg("MiB/s", 10).arg("speedup", 8).arg("B/entry", 10)
+        << endl;
+
+    foreach (int entries, sizes_) {
+        foreach (double ratio, escaped_ratios_) {
+            Dataset data;
+            const QString file = dir.filePath(QString("live_streams_%1_%2.sii").arg(entries).arg(ratio));
+            if (!generate(file, entries, ratio, data)) {
+                return false;
+            }
+
+            benchmarkReaders(data, out);
+            benchmarkLoad(data, out);
+            benchmarkParsers(data, out);
+            benchmarkCodec(data, out);
+            benchmarkSave(data, dir.filePath("saved.sii"), out);
+            benchmarkEdits(data, out);
+            benchmarkSort(data, out);
+
+            QFile::remove(file);
+            QFile::remove(StreamCache::cachePath(file));
+        }
+    }
+    return true;
+}
+
+bool Benchmark::generate(const QString& file, int entries, double escaped_ratio, Dataset& data)
+{
+/*
+Writes a file like the ones the game produces: the URLs are ASCII, and the
+names of escaped_ratio of the entries (spread evenly) contain non-ASCII
+characters of different lengths in UTF-8, stored as "\xNN" escapes.
+*/
+    static const char* const kNonAscii[] = {
+        "Caf\xC3\xA9 \xC3\x91and\xC3\xBA",                  // 2-byte characters.
+        "\xD0\xA0\xD0\xB0\xD0\xB4\xD0\xB8\xD0\xBE",         // Cyrillic.
+        "\xE6\x97\xA5\xE6\x9C\xAC\xE3\x81\xAE",             // 3-byte characters.
+        "\xF0\x9F\x8E\xB5 Hits"                             // 4-byte (surrogate pair).
+    };
+
+    QFile out(file);
+    if (!out.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    data.entries        = entries;
+    data.escaped_ratio  = escaped_ratio;
+    data.file           = file;
+
+    QByteArray buffer;
+    buffer.append("SiiNunit\n{\nlive_stream_def : _nameless.0000.0000 {\n stream_data: ");
+    buffer.append(QByteArray::number(entries)).append('\n');
+
+    Lcg rng(entries);
+    double escaped = 0;
+    for (int i = 0; i < entries; i++) {
+        QString name = QString("Radio %1 %2").arg(i).arg(QString(int(rng.next(24)), QChar('x')));
+        escaped += escaped_ratio;
+        if (escaped >= 1) {
+            escaped -= 1;
+            name += ' ' + QString::fromUtf8(kNonAscii[i % 4]);
+        }
+        const QByteArray raw = Parser::escapeString(name);
+
+        buffer.append(" stream_data[").append(QByteArray::number(i)).append("]: \"");
+        buffer.append("http://stream").append(QByteArray::number(rng.next(1000)));
+        buffer.append(".example.com:8000/live/").append(QByteArray::number(i));
+        buffer.append('|').append(raw).append("\"\n");
+        data.raw_names.append(raw);
+        data.names.append(name);
+
+        if (buffer.size() >= (1 << 20)) {
+            out.write(buffer);
+            buffer.resize(0);
+        }
+    }
+    buffer.append("}\n}\n");
+    out.write(buffer);
+    out.close();
+
+    data.bytes = QFileInfo(file).size();
+    return out.error() == QFileDevice::NoError;
+}
+
+void Benchmark::benchmarkReaders(const Dataset& data, QTextStream& out)
+{
+    struct Reader {
+        QString name;
+        Parser::ReadMode mode;
+        int threads;
+    };
+
+    // The parallel reader goes through powers of two up to the number of
+    // cores, which gives the speedup curve. The cached reader is timed
+    // reopening the file, once a first (untimed) read has written its cache.
+    QList<Reader> readers;
+    readers.append(Reader{"read/text", Parser::TextStreamReader, 1});
+    readers.append(Reader{"read/mapped", Parser::MappedReader, 1});
+    const int cores = QThread::idealThreadCount();
+    for (int threads = 2; threads < cores * 2; threads *= 2) {
+        const int n = qMin(threads, cores);
+        readers.append(Reader{QString("read/parallel-%1").arg(n), Parser::ParallelReader, n});
+    }
+    readers.append(Reader{"read/cached", Parser::CachedReader, 1});
+    readers.append(Reader{"read/validating", Parser::ValidatingReader, 1});
+
+    foreach (const Reader& reader, readers) {
+        if (reader.mode == Parser::CachedReader) {
+            Parser writer(data.file, reader.mode, reader.threads);
+        }
+
+        QVector<qint64> samples;
+        for (int i = 0; i < repeat_; i++) {
+            QElapsedTimer timer;
+            timer.start();
+            Parser parser(data.file, reader.mode, reader.threads);
+            samples.append(timer.nsecsElapsed());
+
+            if (parser.streamCount() != data.entries) {
+                out << reader.name << ": read " << parser.streamCount() << " of "
+                    << data.entries << " entries" << endl;
+            }
+        }
+        addResult(reader.name, data, data.entries, data.bytes, samples, out);
+    }
+}
+
+void Benchmark::benchmarkLoad(const Dataset& data, QTextStream& out)
+{
+/*
+The list as the editor keeps it (an arena read by the mapped reader) against
+the QList<Stream> it replaced: the time to read the file into each, and the
+memory each holds once read.
+*/
+    QVector<qint64> samples;
+    qint64 memory = 0;
+    for (int i = 0; i < repeat_; i++) {
+        QList<Stream> streams;
+        QElapsedTimer timer;
+        timer.start();
+        legacyReadStreams(data.file, streams);
+        samples.append(timer.nsecsElapsed());
+
+        memory = legacyMemoryUsage(streams);
+        if (streams.size() != data.entries) {
+            out << "load/qlist: read " << streams.size() << " of " << data.entries << " entries" << endl;
+        }
+    }
+    addResult("load/qlist", data, data.entries, data.bytes, samples, out, memory);
+
+    samples.clear();
+    for (int i = 0; i < repeat_; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        Parser parser(data.file, Parser::MappedReader);
+        samples.append(timer.nsecsElapsed());
+
+        memory = parser.streamList().memoryUsage();
+        if (parser.streamCount() != data.entries) {
+            out << "load/arena: read " << parser.streamCount() << " of " << data.entries << " entries" << endl;
+        }
+    }
+    addResult("load/arena", data, data.entries, data.bytes, samples, out, memory);
+}
+
+void Benchmark::benchmarkParsers(const Dataset& data, QTextStream& out)
+{
+/*
+The two ways the readers parse a file, on its contents already in memory and
+on a single thread: line by line (parse/lines, what files that are not valid
+documents go through) and as a document (parse/document, tree and entries).
+*/
+    QFile file(data.file);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    const QByteArray contents = file.readAll();
+    const char* begin = contents.constData();
+
+    QVector<qint64> samples;
+    for (int i = 0; i < repeat_; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        const ParsedBlock block = Parser::parseBlock(begin, begin, begin + contents.size());
+        samples.append(timer.nsecsElapsed());
+
+        if (block.streams.size() != data.entries) {
+            out << "parse/lines: parsed " << block.streams.size() << " of " << data.entries << " entries" << endl;
+        }
+    }
+    addResult("parse/lines", data, data.entries, contents.size(), samples, out);
+
+    samples.clear();
+    for (int i = 0; i < repeat_; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        SiiDocument document;
+        document.parse(contents);
+        const QVector<int> entries = Parser::entryNodes(document);
+        const ParsedBlock block = Parser::parseEntries(document, entries, 0, entries.size());
+        samples.append(timer.nsecsElapsed());
+
+        if (block.streams.size() != data.entries) {
+            out << "parse/document: parsed " << block.streams.size() << " of " << data.entries << " entries" << endl;
+        }
+    }
+    addResult("parse/document", data, data.entries, contents.size(), samples, out);
+}
+
+void Benchmark::benchmarkCodec(const Dataset& data, QTextStream& out)
+{
+    volatile int sink = 0;  // Keeps the results from being optimized away.
+
+    qint64 raw_bytes = 0;
+    foreach (const QByteArray& raw, data.raw_names) {
+        raw_bytes += raw.size();
+    }
+
+    // The old codec first, as the new one is compared against it. It took
+    // the QStrings of the lines read by a QTextStream.
+    QStringList raw_strings;
+    foreach (const QByteArray& raw, data.raw_names) {
+        raw_strings.append(QString::fromLatin1(raw));
+    }
+    QVector<qint64> samples;
+    for (int i = 0; i < repeat_; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        foreach (const QString& raw, raw_strings) {
+            sink += legacyUnescape(raw).size();
+        }
+        samples.append(timer.nsecsElapsed());
+    }
+    addResult("unescapeString/qstring", data, data.entries, raw_bytes, samples, out);
+
+    samples.clear();
+    for (int i = 0; i < repeat_; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        foreach (const QString& name, data.names) {
+            sink += legacyEscape(name).size();
+        }
+        samples.append(timer.nsecsElapsed());
+    }
+    addResult("escapeString/qstring", data, data.entries, raw_bytes, samples, out);
+
+    samples.clear();
+    for (int i = 0; i < repeat_; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        foreach (const QByteArray& raw, data.raw_names) {
+            sink += Parser::unescapeString(raw.constData(), raw.size()).size();
+        }
+        samples.append(timer.nsecsElapsed());
+    }
+    addResult("unescapeString", data, data.entries, raw_bytes, samples, out);
+
+    samples.clear();
+    for (int i = 0; i < repeat_; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        foreach (const QString& name, data.names) {
+            sink += Parser::escapeString(name).size();
+        }
+        samples.append(timer.nsecsElapsed());
+    }
+    addResult("escapeString", data, data.entries, raw_bytes, samples, out);
+}
+
+void Benchmark::benchmarkSave(const Dataset& data, const QString& output, QTextStream& out)
+{
+    Parser parser(data.file);
+
+    QVector<qint64> samples;
+    for (int i = 0; i < repeat_; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        if (!parser.saveStreams(output)) {
+            out << "saveStreams: cannot write " << output << endl;
+            return;
+        }
+        samples.append(timer.nsecsElapsed());
+    }
+    addResult("saveStreams", data, data.entries, QFileInfo(output).size(), samples, out);
+    QFile::remove(output);
+}
+
+void Benchmark::benchmarkSort(const Dataset& data, QTextStream& out)
+{
+    // Only the order is timed (keys included): applying it is one permute.
+    Parser parser(data.file);
+    const int cores = QThread::idealThreadCount();
+
+    QList<int> threads;
+    threads << 1;
+    if (cores > 1) {
+        threads << cores;
+    }
+    foreach (int n, threads) {
+        QVector<qint64> samples;
+        for (int i = 0; i < repeat_; i++) {
+            QElapsedTimer timer;
+            timer.start();
+            parser.sortOrder(Parser::SortByName, n);
+            samples.append(timer.nsecsElapsed());
+        }
+        addResult(QString("sort/name-%1").arg(n), data, data.entries, 0, samples, out);
+    }
+
+    QVector<qint64> samples;
+    for (int i = 0; i < repeat_; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        parser.sortOrder(Parser::SortByHost, cores);
+        samples.append(timer.nsecsElapsed());
+    }
+    addResult(QString("sort/host-%1").arg(cores), data, data.entries, 0, samples, out);
+}
+
+void Benchmark::benchmarkEdits(const Dataset& data, QTextStream& out)
+{
+/*
+Edits are timed per operation, on a list read again for every iteration (a
+copy would be shared with the original, and the timed loop would pay for
+detaching it). Deleting shifts the rows after the deleted one, so fewer
+deletions are made than swaps or insertions.
+*/
+    if (data.entries < 2) {
+        return;
+    }
+
+    // Swaps
+    const int swaps = qMin(data.entries, 100000);
+    QVector<qint64> samples;
+    for (int i = 0; i < repeat_; i++) {
+        Parser parser(data.file);
+        Lcg rng(i + 1);
+        QVector<unsigned int> rows(swaps * 2);
+        for (int j = 0; j < rows.size(); j++) {
+            rows[j] = rng.next(data.entries);
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        for (int j = 0; j < swaps; j++) {
+            parser.swapStreams(rows.at(j * 2), rows.at(j * 2 + 1));
+        }
+        samples.append(timer.nsecsElapsed());
+    }
+    addResult("swapStreams", data, swaps, 0, samples, out);
+
+    // Deletions
+    const int deletions = qMin(data.entries / 2, 1000);
+    samples.clear();
+    for (int i = 0; i < repeat_; i++) {
+        Parser parser(data.file);
+        Lcg rng(i + 1);
+        QVector<unsigned int> rows(deletions);
+        for (int j = 0; j < deletions; j++) {
+            rows[j] = rng.next(data.entries - j);
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        for (int j = 0; j < deletions; j++) {
+            parser.deleteStream(rows.at(j));
+        }
+        samples.append(timer.nsecsElapsed());
+    }
+    addResult("deleteStream", data, deletions, 0, samples, out);
+
+    // Insertions (at the end, as in the editor)
+    const int insertions = qMin(data.entries, 100000);
+    const Stream stream("http://inserted.example.com:8000/live", data.names.last());
+    samples.clear();
+    for (int i = 0; i < repeat_; i++) {
+        Parser parser(data.file);
+
+        QElapsedTimer timer;
+        timer.start();
+        for (int j = 0; j < insertions; j++) {
+            parser.insertStream(stream);
+        }
+        samples.append(timer.nsecsElapsed());
+    }
+    addResult("insertStream", data, insertions, 0, samples, out);
+}
+
+void Benchmark::addResult(const QString& name, const Dataset& data, qint64 operations, qint64 bytes,
+                          const QVector<qint64>& samples, QTextStream& out, qint64 memory)
+{
+    BenchmarkResult r;
+    r.name          = name;
+    r.entries       = data.entries;
+    r.escaped_ratio = data.escaped_ratio;
+    r.operations    = qMax(qint64(1), operations);
+    r.bytes         = bytes;
+    r.best_ns       = qMax(qint64(1), *std::min_element(samples.constBegin(), samples.constEnd()));
+    r.iterations    = samples.size();
+    r.speedup       = 0;
+    r.memory        = memory;
+
+    // Readers are compared against the single threaded mapped one, and the
+    // arena and the codec against the QList and QString ones they replaced.
+    QString baseline;
+    if (name.startsWith("read/")) {
+        baseline = "read/mapped";
+    }
+    else if (name.startsWith("load/")) {
+        baseline = "load/qlist";
+    }
+    else if (name == "unescapeString" || name == "escapeString" || name.endsWith("/qstring")) {
+        baseline = name.section('/', 0, 0) + "/qstring";
+    }
+    if (name == baseline) {
+        r.speedup = 1;
+    }
+    else if (!baseline.isEmpty()) {
+        for (int i = results_.size() - 1; i >= 0; i--) {
+            const BenchmarkResult& base = results_.at(i);
+            if (base.name == baseline && base.entries == r.entries &&
+                base.escaped_ratio == r.escaped_ratio) {
+                r.speedup = double(base.best_ns) / r.best_ns;
+                break;
+            }
+        }
+    }
+    results_.append(r);
+
+    out << QString("%1 %2 %3% %4 %5 %6 %7")
+           .arg(r.name, -22).arg(r.entries, 8).arg(r.escaped_ratio * 100, 7, 'f', 0)
+           .arg(double(r.best_ns) / r.operations, 12, 'f', 1)
+           .arg(r.bytes > 0 ? r.bytes * 1e9 / r.best_ns / 1048576.0 : 0.0, 10, 'f', 1)
+           .arg(r.speedup > 0 ? QString::number(r.speedup, 'f', 2) : QString("-"), 8)
+           .arg(r.memory > 0 ? QString::number(double(r.memory) / r.entries, 'f', 1) : QString("-"), 10)
+        << endl;
+}
+
+QByteArray Benchmark::toJson() const
+{
+    static const char* const kKernels[] = {"scalar", "sse2", "avx2"};
+
+    QJsonArray results;
+    foreach (const BenchmarkResult& r, results_) {
+        QJsonObject o;
+        o.insert("name", r.name);
+        o.insert("entries", r.entries);
+        o.insert("escaped_ratio", r.escaped_ratio);
+        o.insert("operations", r.operations);
+        o.insert("iterations", r.iterations);
+        o.insert("best_ns", r.best_ns);
+        o.insert("ns_per_entry", double(r.best_ns) / r.operations);
+        if (r.bytes > 0) {
+            o.insert("bytes", r.bytes);
+            o.insert("bytes_per_second", r.bytes * 1e9 / r.best_ns);
+        }
+        if (r.memory > 0) {
+            o.insert("memory_bytes", r.memory);
+            o.insert("memory_per_entry", double(r.memory) / r.entries);
+        }
+        if (r.speedup > 0) {
+            o.insert("speedup", r.speedup);
+        }
+        results.append(o);
+    }
+
+    QJsonObject context;
+    context.insert("date", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    context.insert("qt_version", QString(qVersion()));
+    context.insert("line_scanner", QString(kKernels[LineScanner::bestKernel()]));
+    context.insert("cores", QThread::idealThreadCount());
+
+    QJsonObject root;
+    root.insert("context", context);
+    root.insert("results", results);
+    return QJsonDocument(root).toJson();
+}
@@ -0,0 +1,65 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+
+// One measured operation on one synthetic file.
+struct BenchmarkResult {
+    QString name;               // Operation, e.g. "read/parallel-4".
+    int entries;                // Entries in the file.
+    double escaped_ratio;       // Fraction of the names with "\xNN" escapes.
+    qint64 operations;          // Per iteration (entries, swaps, ...).
+    qint64 bytes;               // Per iteration, 0 if it does not apply.
+    qint64 best_ns;             // Fastest iteration.
+    int iterations;
+    double speedup;             // Readers: against read/mapped; codec: against
+                                // the old QString codec; loads: against the
+                                // old QList<Stream>; else 0.
+    qint64 memory;              // Held by the list once loaded, 0 if not measured.
+};
+
+
+// Times the Parser hot paths on generated live_streams.sii files of the given
+// sizes and ratios of escaped (non-ASCII) names. Every measurement is
+// repeated and the fastest run is kept, which is the least noisy figure on a
+// busy machine.
+class Benchmark {
+public:
+    Benchmark(const QList<int>& sizes, const QList<double>& escaped_ratios, int repeat);
+
+    bool run(QTextStream& out);         // Prints every result as it is measured.
+    QByteArray toJson() const;
+
+private:
+    // A generated file, along with the names in it.
+    struct Dataset {
+        int entries;
+        double escaped_ratio;
+        QString file;
+        qint64 bytes;
+        QList<QByteArray> raw_names;    // As written in the file.
+        QStringList names;              // Decoded.
+    };
+
+    QList<int> sizes_;
+    QList<double> escaped_ratios_;
+    int repeat_;
+    QList<BenchmarkResult> results_;
+
+    static bool generate(const QString& file, int entries, double escaped_ratio, Dataset&);
+    void benchmarkReaders(const Dataset&, QTextStream&);
+    void benchmarkLoad(const Dataset&, QTextStream&);
+    void benchmarkParsers(const Dataset&, QTextStream&);
+    void benchmarkCodec(const Dataset&, QTextStream&);
+    void benchmarkSave(const Dataset&, const QString& output, QTextStream&);
+    void benchmarkEdits(const Dataset&, QTextStream&);
+    void benchmarkSort(const Dataset&, QTextStream&);
+    void addResult(const QString& name, const Dataset&, qint64 operations, qint64 bytes,
+                   const QVector<qint64>& samples, QTextStream&, qint64 memory = 0);
+};
+
+#endif // BENCHMARK_H
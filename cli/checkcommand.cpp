@@ -0,0 +1,170 @@
+#include "checkcommand.h"
+#include "clitool.h"
+#include "mockstreamserver.h"
+
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QSet>
+
+CheckCommand::CheckCommand(int connections, int per_host, int timeout)
+{
+    checker_.setMaxConcurrent(connections);
+    checker_.setMaxPerHost(per_host);
+    checker_.setTimeout(timeout);
+    connect(&checker_, SIGNAL(checked(QString,CheckResult)), this, SLOT(streamChecked(QString,CheckResult)));
+}
+
+int CheckCommand::run(const QStringList& files, Parser::ReadMode mode)
+{
+    QTextStream out(stdout);
+    int res = 0;
+
+    // Every URL once, in the order of the files.
+    QStringList urls;
+    QSet<QString> seen;
+    foreach (const QString& file, files) {
+        Parser* parser = CliTool::readFile(file, mode);
+        if (parser == NULL) {
+            out << file << ": cannot be read" << endl;
+            res = 1;
+            continue;
+        }
+        for (int row = 0; row < parser->streamCount(); row++) {
+            const QString url = parser->urlAt(row).toString();
+            const QString key = Parser::normalizeUrl(url);
+            if (!seen.contains(key)) {
+                seen.insert(key);
+                urls.append(url);
+            }
+        }
+        delete parser;
+    }
+
+    const qint64 elapsed_ns = checkUrls(urls);
+
+    QList<CheckResult> results;
+    foreach (const QString& url, urls) {
+        const CheckResult result = results_.value(Parser::normalizeUrl(url));
+        results.append(result);
+        out << QString("%1 %2 ms  %3").arg(result.summary(), -24).arg(result.latency_ms, 6).arg(url) << endl;
+    }
+    printTotals(out, results, elapsed_ns);
+    return res;
+}
+
+int CheckCommand::runMock(int urls, int hosts, int latency)
+{
+/*
+One URL in ten is missing and one is redirected, and one in twenty never
+answers; the rest are streams. The URLs are spread over the servers, each on
+an address of its own, as the checker limits the connections per host.
+Checking them again must then take every answer from the cache.
+*/
+    QTextStream out(stdout);
+
+    QList<MockStreamServer*> servers;
+    for (int i = 0; i < qBound(1, hosts, 254); i++) {
+        MockStreamServer* server = new MockStreamServer(this);
+        if (!server->start(i + 1)) {
+            out << "Cannot start the mock servers: " << server->errorString() << endl;
+            return 1;
+        }
+        server->setLatency(latency);
+        servers.append(server);
+    }
+
+    QStringList list;
+    QList<CheckResult::Status> expected;
+    for (int i = 0; i < urls; i++) {
+        QString path;
+        if (i % 10 == 0) {
+            path = "/missing/";
+            expected.append(CheckResult::Offline);
+        }
+        else if (i % 10 == 1) {
+            path = "/redirect/";
+            expected.append(CheckResult::Online);
+        }
+        else if (i % 20 == 2) {
+            path = "/slow/";
+            expected.append(CheckResult::Timeout);
+        }
+        else {
+            path = "/ok/";
+            expected.append(CheckResult::Online);
+        }
+        list.append(servers.at(i % servers.size())->url(path + QString::number(i)));
+    }
+
+    const qint64 elapsed_ns = checkUrls(list);
+
+    int mismatches = 0;
+    QList<CheckResult> results;
+    for (int i = 0; i < list.size(); i++) {
+        const CheckResult result = results_.value(Parser::normalizeUrl(list.at(i)));
+        results.append(result);
+        const bool icy_ok = result.status != CheckResult::Online ||
+                            (result.icy_bitrate == 128 && result.icy_metaint == 16000);
+        if (result.status != expected.at(i) || !icy_ok) {
+            out << list.at(i) << ": " << result.summary() << endl;
+            mismatches++;
+        }
+    }
+    printTotals(out, results, elapsed_ns);
+
+    int requests = 0;
+    foreach (MockStreamServer* server, servers) {
+        requests += server->requestCount();
+    }
+    results_.clear();
+    const qint64 cached_ns = checkUrls(list);
+    int served = -requests;
+    foreach (MockStreamServer* server, servers) {
+        served += server->requestCount();
+    }
+    if (served > 0 || results_.size() != list.size()) {
+        out << "Checking again made " << served << " requests instead of using the cache" << endl;
+        mismatches++;
+    }
+    out << QString("Again, from the cache: %1 ms").arg(cached_ns / 1e6, 0, 'f', 1) << endl;
+
+    if (mismatches > 0) {
+        out << mismatches << " unexpected results" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+void CheckCommand::streamChecked(const QString& url, const CheckResult& result)
+{
+    results_.insert(Parser::normalizeUrl(url), result);
+}
+
+qint64 CheckCommand::checkUrls(const QStringList& urls)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QEventLoop loop;
+    connect(&checker_, SIGNAL(finished()), &loop, SLOT(quit()));
+    checker_.check(urls);
+    if (checker_.isRunning()) {     // Else everything came from the cache.
+        loop.exec();
+    }
+    return timer.nsecsElapsed();
+}
+
+void CheckCommand::printTotals(QTextStream& out, const QList<CheckResult>& results, qint64 elapsed_ns)
+{
+    int counts[4] = {0, 0, 0, 0};
+    foreach (const CheckResult& result, results) {
+        counts[result.status]++;
+    }
+    const double secs = qMax(qint64(1), elapsed_ns) / 1e9;
+    out << QString("%1 URLs: %2 online, %3 offline, %4 timed out, %5 errors in %6 s (%7 checks/s)")
+           .arg(results.size())
+           .arg(counts[CheckResult::Online]).arg(counts[CheckResult::Offline])
+           .arg(counts[CheckResult::Timeout]).arg(counts[CheckResult::Error])
+           .arg(secs, 0, 'f', 2).arg(results.size() / secs, 0, 'f', 1)
+        << endl;
+}
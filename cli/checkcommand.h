@@ -0,0 +1,37 @@
+#ifndef CHECKCOMMAND_H
+#define CHECKCOMMAND_H
+
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <QTextStream>
+
+#include "parser.h"
+#include "streamchecker.h"
+
+// The check command: probes the stream URLs of the files and prints what
+// became of each one, and how many URLs were checked per second.
+// With runMock(), the URLs point to local stand-in servers whose answers are
+// known, which checks the checker itself without a network.
+class CheckCommand : public QObject
+{
+    Q_OBJECT
+
+public:
+    CheckCommand(int connections, int per_host, int timeout);
+
+    int run(const QStringList& files, Parser::ReadMode);    // Returns the exit code.
+    int runMock(int urls, int hosts, int latency);
+
+private slots:
+    void streamChecked(const QString& url, const CheckResult&);
+
+private:
+    StreamChecker checker_;
+    QHash<QString, CheckResult> results_;   // By normalized URL.
+
+    qint64 checkUrls(const QStringList&);   // Waits for them; returns the elapsed ns.
+    static void printTotals(QTextStream&, const QList<CheckResult>&, qint64 elapsed_ns);
+};
+
+#endif // CHECKCOMMAND_H
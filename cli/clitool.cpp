@@ -0,0 +1,386 @@
+#include "clitool.h"
+
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QSaveFile>
+#include <QSet>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+CliTool::CliTool(const QString& command, const CliOptions& options):
+command_(command),
+options_(options),
+single_output_(false),
+sort_threads_(1)
+{
+}
+
+QStringList CliTool::commands()
+{
+    return QStringList() << "parse" << "validate" << "dedupe" << "merge"
+                         << "sort" << "export" << "stats";
+}
+
+QStringList CliTool::formats()
+{
+    return QStringList() << "csv" << "json" << "m3u";
+}
+
+QStringList CliTool::expandInputs(const QStringList& inputs)
+{
+    QStringList files;
+    foreach (const QString& input, inputs) {
+        if (!QFileInfo(input).isDir()) {
+            files.append(input);
+            continue;
+        }
+
+        // Sorted, so that results come out in the same order on every run.
+        QStringList found;
+        QDirIterator it(input, QStringList() << "*.sii", QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            found.append(it.next());
+        }
+        found.sort();
+        files += found;
+    }
+    return files;
+}
+
+int CliTool::run(const QStringList& files)
+{
+/*
+Every file is handled by its own task in a pool of options_.jobs threads, and
+the results are waited for in input order, so the output stays in that order
+while later files are already being processed. merge is the exception: its
+inputs are streamed one after another into a single result.
+*/
+    QTextStream out(stdout);
+    QElapsedTimer timer;
+    timer.start();
+
+    single_output_ = (files.size() == 1 || command_ == "merge") &&
+                     !options_.output.isEmpty() && !QFileInfo(options_.output).isDir();
+    if (!single_output_ && !options_.output.isEmpty()) {
+        QDir().mkpath(options_.output);
+    }
+    sort_threads_ = (files.size() == 1) ? options_.jobs : 1;
+
+    QList<FileResult> results;
+    if (command_ == "merge") {
+        results.append(merge(files));
+        printResult(out, results.last());
+    }
+    else {
+        QThreadPool pool;
+        pool.setMaxThreadCount(options_.jobs);
+
+        QList< QFuture<FileResult> > futures;
+        foreach (const QString& file, files) {
+            futures.append(QtConcurrent::run(&pool, this, &CliTool::processFile, file));
+        }
+        for (int i = 0; i < futures.size(); i++) {
+            results.append(futures[i].result());
+            printResult(out, results.last());
+        }
+    }
+
+    // Totals
+    int failed = 0;
+    qint64 entries = 0;
+    qint64 bytes = 0;
+    foreach (const FileResult& r, results) {
+        failed += r.ok ? 0 : 1;
+        entries += r.entries;
+        bytes += r.bytes;
+    }
+    const double seconds = timer.nsecsElapsed() / 1e9;
+    out << QString("%1 file(s), %2 failed, %3 entries, %4 MiB in %5 s (%6 MiB/s)")
+           .arg(results.size()).arg(failed).arg(entries)
+           .arg(bytes / 1048576.0, 0, 'f', 2).arg(seconds, 0, 'f', 3)
+           .arg(seconds > 0 ? bytes / 1048576.0 / seconds : 0.0, 0, 'f', 1)
+        << endl;
+
+    return failed == 0 ? 0 : 1;
+}
+
+FileResult CliTool::processFile(const QString& file) const
+{
+    FileResult res;
+    res.file = file;
+    res.ok = true;
+    res.entries = 0;
+    res.bytes = QFileInfo(file).size();
+
+    if (command_ == "validate") {
+        return validate(file);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    Parser* parser = readFile(file, options_.read_mode);
+    if (parser == NULL) {
+        res.ok = false;
+        res.summary = "cannot be read";
+        res.elapsed_ns = timer.nsecsElapsed();
+        return res;
+    }
+    if (!parser->errorString().isEmpty()) {
+        res.ok = false;
+        res.summary = "cannot be read: " + parser->errorString();
+        delete parser;
+        res.elapsed_ns = timer.nsecsElapsed();
+        return res;
+    }
+    res.entries = parser->streamCount();
+
+    if (command_ == "parse") {
+        res.summary = QString("%1 entries").arg(res.entries);
+    }
+    else if (command_ == "stats") {
+        res.summary = stats(*parser);
+    }
+    else if (command_ == "dedupe" || command_ == "sort") {
+        const QString output = outputPath(file, QString());
+        if (command_ == "dedupe") {
+            res.summary = QString("%1 duplicates removed").arg(parser->removeDuplicates());
+        }
+        else {
+            parser->sortStreams(options_.sort_key, sort_threads_);
+            res.summary = "sorted";
+        }
+        res.ok = (output == file) ? parser->saveStreams() : parser->saveStreams(output);
+        res.summary += res.ok ? ", written to " + output : ", cannot write " + output;
+    }
+    else if (command_ == "export") {
+        const QString output = outputPath(file, options_.format);
+        res.ok = exportStreams(*parser, output);
+        res.summary = res.ok ? "exported to " + output : "cannot write " + output;
+    }
+
+    delete parser;
+    res.elapsed_ns = timer.nsecsElapsed();
+    return res;
+}
+
+FileResult CliTool::merge(const QStringList& files) const
+{
+/*
+Streams the inputs, in the given order, through a StreamMerger, so that only
+the merged entries are kept in memory and not every input. The header comes
+from the first input that has one.
+*/
+    FileResult res;
+    res.file = options_.output;
+    res.ok = false;
+    res.entries = 0;
+    res.bytes = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int preferred = -1;
+    for (int i = 0; i < files.size() && !options_.preferred.isEmpty(); i++) {
+        if (QFileInfo(files.at(i)) == QFileInfo(options_.preferred)) {
+            preferred = i;
+            break;
+        }
+    }
+
+    StreamMerger merger(NULL, options_.merge_rule, preferred);
+    QStringList unreadable;
+    foreach (const QString& file, files) {
+        res.bytes += QFileInfo(file).size();
+        if (!merger.addFile(file)) {
+            unreadable.append(file);
+        }
+    }
+
+    if (!unreadable.isEmpty()) {
+        res.summary = "cannot read " + unreadable.join(", ");
+    }
+    else if (options_.merge_rule == StreamMerger::PreferSource && preferred < 0) {
+        res.summary = options_.preferred + " is not one of the inputs";
+    }
+    else if (merger.liveStreamDefLine().isEmpty()) {
+        res.summary = "no live_stream_def line in the inputs";
+    }
+    else {
+        Parser merged(QString(), Parser::DeferredReader);
+        merger.apply(merged);
+        res.entries = merged.streamCount();
+        res.ok = merged.saveStreams(options_.output);
+        res.summary = QString("%1 files merged, %2 duplicates removed")
+                      .arg(files.size()).arg(merger.duplicates());
+        if (!res.ok) {
+            res.summary += ", cannot write the output";
+        }
+    }
+
+    res.elapsed_ns = timer.nsecsElapsed();
+    return res;
+}
+
+Parser* CliTool::readFile(const QString& file, Parser::ReadMode mode)
+{
+    // The parser itself skips files it cannot open, leaving them empty.
+    const QFileInfo info(file);
+    if (!info.isFile() || !info.isReadable()) {
+        return NULL;
+    }
+    return new Parser(file, mode);
+}
+
+FileResult CliTool::validate(const QString& file) const
+{
+/*
+A pure scan of the file through a StreamValidator, without building its list
+of entries. Errors fail the file; warnings (duplicate URLs, numbering...) are
+only printed.
+*/
+    FileResult res;
+    res.file = file;
+    res.ok = false;
+    res.entries = 0;
+    res.bytes = QFileInfo(file).size();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    StreamValidator validator(options_.max_problems);
+    if (!QFileInfo(file).isFile() || !validator.checkFile(file)) {
+        res.summary = "cannot be read";
+        res.elapsed_ns = timer.nsecsElapsed();
+        return res;
+    }
+    res.entries = validator.entryCount();
+    res.ok = validator.isValid();
+
+    if (validator.errorCount() + validator.warningCount() == 0) {
+        res.summary = QString("valid, %1 entries").arg(res.entries);
+    }
+    else {
+        res.summary = QString("%1 entries, %2 errors, %3 warnings")
+                      .arg(res.entries).arg(validator.errorCount()).arg(validator.warningCount());
+    }
+    foreach (const StreamDiagnostic& d, validator.diagnostics()) {
+        res.details.append(file + ":" + d.toString());
+    }
+    const int hidden = validator.errorCount() + validator.warningCount() - validator.diagnostics().size();
+    if (hidden > 0) {
+        res.details.append(QString("%1 more problems not shown").arg(hidden));
+    }
+
+    res.elapsed_ns = timer.nsecsElapsed();
+    return res;
+}
+
+QString CliTool::stats(const Parser& parser) const
+{
+    QSet<QString> urls;
+    QMap<QString, int> schemes;
+    qint64 name_length = 0;
+    int non_ascii = 0;
+    for (StreamList::const_iterator it = parser.streamsBegin(); it != parser.streamsEnd(); ++it) {
+        const Stream s = *it;
+        urls.insert(Parser::normalizeUrl(s.url));
+        name_length += s.name.size();
+
+        const int scheme_end = s.url.indexOf("://");
+        schemes[scheme_end == -1 ? QString("none") : s.url.left(scheme_end).toLower()]++;
+
+        for (int i = 0; i < s.name.size(); i++) {
+            if (s.name.at(i).unicode() > 0x7F) {
+                non_ascii++;
+                break;
+            }
+        }
+    }
+
+    QStringList scheme_counts;
+    for (QMap<QString, int>::const_iterator it = schemes.constBegin(); it != schemes.constEnd(); ++it) {
+        scheme_counts << QString("%1 %2").arg(it.value()).arg(it.key());
+    }
+
+    const int count = parser.streamCount();
+    return QString("%1 entries, %2 unique URLs, %3 non-ASCII names, average name %4 chars, schemes: %5")
+           .arg(count).arg(urls.size()).arg(non_ascii)
+           .arg(count > 0 ? double(name_length) / count : 0.0, 0, 'f', 1)
+           .arg(scheme_counts.isEmpty() ? QString("none") : scheme_counts.join(", "));
+}
+
+bool CliTool::exportStreams(const Parser& parser, const QString& filename) const
+{
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    if (options_.format == "json") {
+        QJsonArray entries;
+        for (StreamList::const_iterator it = parser.streamsBegin(); it != parser.streamsEnd(); ++it) {
+            QJsonObject entry;
+            entry.insert("name", it->name);
+            entry.insert("url", it->url);
+            entries.append(entry);
+        }
+        file.write(QJsonDocument(entries).toJson());
+        return file.commit();
+    }
+
+    QTextStream out(&file);
+    out.setCodec("UTF-8");
+    if (options_.format == "m3u") {
+        out << "#EXTM3U\n";
+        for (StreamList::const_iterator it = parser.streamsBegin(); it != parser.streamsEnd(); ++it) {
+            const Stream s = *it;
+            out << "#EXTINF:-1," << s.name << '\n' << s.url << '\n';
+        }
+    }
+    else { // csv
+        out << "name,url\n";
+        for (StreamList::const_iterator it = parser.streamsBegin(); it != parser.streamsEnd(); ++it) {
+            const Stream s = *it;
+            out << '"' << QString(s.name).replace('"', "\"\"") << "\",\""
+                << QString(s.url).replace('"', "\"\"") << "\"\n";
+        }
+    }
+    out.flush();
+    return out.status() == QTextStream::Ok && file.commit();
+}
+
+QString CliTool::outputPath(const QString& input, const QString& extension) const
+{
+/*
+Where the result for an input goes: the output file if there is only one input,
+a file with the input's name inside the output directory otherwise, and the
+input itself (or a file next to it, when exporting) without an output.
+*/
+    const QFileInfo info(input);
+    const QString name = extension.isEmpty() ? info.fileName()
+                                             : info.completeBaseName() + "." + extension;
+    if (single_output_) {
+        return options_.output;
+    }
+    if (!options_.output.isEmpty()) {
+        return QDir(options_.output).filePath(name);
+    }
+    return extension.isEmpty() ? input : info.dir().filePath(name);
+}
+
+void CliTool::printResult(QTextStream& out, const FileResult& r)
+{
+    out << QString("%1 %2 ms  %3: %4")
+           .arg(r.ok ? "ok  " : "FAIL").arg(r.elapsed_ns / 1e6, 10, 'f', 2)
+           .arg(r.file).arg(r.summary)
+        << endl;
+    foreach (const QString& line, r.details) {
+        out << "      " << line << endl;
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef CLITOOL_H
+#define CLITOOL_H
+
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+
+#include "parser.h"
+#include "streammerger.h"
+
+// Settings given on the command line.
+struct CliOptions {
+    QString output;             // Output file or, with several inputs, directory.
+    QString format;             // export: "csv", "json" or "m3u".
+    Parser::SortKey sort_key;
+    Parser::ReadMode read_mode;
+    StreamMerger::ConflictRule merge_rule;
+    QString preferred;          // merge: input whose entries win, with PreferSource.
+    int jobs;                   // Files processed at the same time.
+    int max_problems;           // validate: problems printed per file.
+};
+
+// What a command did with one file.
+struct FileResult {
+    QString file;
+    bool ok;
+    QString summary;
+    QStringList details;        // Printed under the summary, one per line.
+    int entries;
+    qint64 bytes;               // Size of the input.
+    qint64 elapsed_ns;
+};
+
+
+// Runs one of the subcommands over a set of files. Files are independent from
+// each other, so they are processed concurrently, and their results are
+// printed in the given order as soon as they are available.
+class CliTool {
+public:
+    CliTool(const QString& command, const CliOptions&);
+
+    static QStringList commands();
+    static QStringList formats();
+    static QStringList expandInputs(const QStringList&);   // Directories become their .sii files.
+    static Parser* readFile(const QString&, Parser::ReadMode);     // NULL if it cannot be read.
+
+    int run(const QStringList& files);  // Returns the exit code.
+
+private:
+    QString command_;
+    CliOptions options_;
+    bool single_output_;                // Whether options_.output names a file.
+    int sort_threads_;                  // All the jobs for one file, one per file otherwise.
+
+    FileResult processFile(const QString&) const;
+    FileResult merge(const QStringList&) const;
+
+    FileResult validate(const QString&) const;
+    QString stats(const Parser&) const;
+    bool exportStreams(const Parser&, const QString&) const;
+    QString outputPath(const QString& input, const QString& extension) const;
+
+    static void printResult(QTextStream&, const FileResult&);
+};
+
+#endif // CLITOOL_H
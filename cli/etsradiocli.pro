@@ -0,0 +1,31 @@
+#-------------------------------------------------
+#
+# Command line front end of the parser, for batch processing .sii files on
+# machines without a display. QtCore (and QtNetwork, for check) only.
+#
+#-------------------------------------------------
+
+QT       = core concurrent network
+
+TARGET = etsradiocli
+TEMPLATE = app
+
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../parser.pri)
+
+SOURCES += main.cpp \
+    clitool.cpp \
+    benchmark.cpp \
+    checkcommand.cpp \
+    selftest.cpp \
+    mockstreamserver.cpp \
+    ../streamchecker.cpp
+
+HEADERS += clitool.h \
+    benchmark.h \
+    checkcommand.h \
+    selftest.h \
+    mockstreamserver.h \
+    ../streamchecker.h
@@ -0,0 +1,246 @@
+#include "clitool.h"
+#include "benchmark.h"
+#include "checkcommand.h"
+#include "profiler.h"
+#include "selftest.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QThread>
+
+// Writes what the profiler measured, if asked to (--trace).
+static bool writeTrace(const QString& path, QTextStream& err)
+{
+    if (path.isEmpty()) {
+        return true;
+    }
+    if (!Profiler::isEnabled()) {
+        err << "--trace needs a build configured with \"qmake CONFIG+=profiling\"." << endl;
+        return false;
+    }
+    if (!Profiler::instance().writeTrace(path)) {
+        err << "Cannot write " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("etsradiocli");
+    QCoreApplication::setApplicationVersion("0.0.0.1");
+
+    QCommandLineParser args;
+    args.setApplicationDescription("Batch processing of live_streams.sii files.\n\n"
+        "Commands:\n"
+        "  parse     Reads the files and counts their entries.\n"
+        "  validate  Checks every line of the files, and prints where the problems are.\n"
+        "  dedupe    Removes entries with repeated URLs.\n"
+        "  merge     Joins the files into the output, without repeated URLs.\n"
+        "            --keep and --prefer tell which entry of a repeated URL stays.\n"
+        "  sort      Sorts the entries by name, URL, host or name prefix (--by).\n"
+        "  export    Writes the entries as CSV, JSON or M3U.\n"
+        "  stats     Summarizes the contents of the files.\n"
+        "  check     Tells which stream URLs of the files are on the air (with\n"
+        "            --mock, checks generated URLs against local servers).\n"
+        "  bench     Times the parser on generated files (takes no inputs).\n"
+        "  selftest  Reads and saves known files with every reader, and checks that\n"
+        "            they come out unchanged (takes no inputs).\n\n"
+        "dedupe and sort overwrite their inputs unless an output is given.");
+    args.addHelpOption();
+    args.addVersionOption();
+    args.addPositionalArgument("command", "Command to run.");
+    args.addPositionalArgument("inputs", ".sii files, or directories to search for them.", "inputs...");
+
+    QCommandLineOption output(QStringList() << "o" << "output",
+        "Output file or, with several inputs, directory.", "path");
+    QCommandLineOption jobs(QStringList() << "j" << "jobs",
+        "Files processed at the same time (default: one per core).", "n");
+    QCommandLineOption sort_key("by", "Sort key for sort: name, url, host or prefix (of the name).", "key", "name");
+    QCommandLineOption keep("keep", "Entry that merge keeps for a repeated URL: first or longest (name).",
+        "rule", "first");
+    QCommandLineOption prefer("prefer", "Input whose entries merge keeps for repeated URLs.", "file");
+    QCommandLineOption format("format", "Format for export: csv, json or m3u.", "format", "csv");
+    QCommandLineOption reader("reader",
+        "File reader: mapped, parallel, text, cached or validating (default: parallel for a single\n"
+        "input, mapped otherwise). cached reuses, or writes, a .cache file next to each input.\n"
+        "validating also checks every line, as validate does.",
+        "reader");
+    QCommandLineOption max_problems("max-problems", "Problems that validate prints per file.", "n", "20");
+    QCommandLineOption sizes("sizes", "Entries of the files generated by bench.",
+        "list", "10,1000,100000,1000000");
+    QCommandLineOption escaped("escaped", "Ratios of escaped names generated by bench.",
+        "list", "0,0.1,1");
+    QCommandLineOption repeat("repeat", "Iterations of each bench measurement.", "n", "5");
+    QCommandLineOption json("json", "Also writes the bench results as JSON to this file.", "path");
+    QCommandLineOption connections("connections", "URLs checked at the same time.", "n", "16");
+    QCommandLineOption per_host("per-host", "URLs of the same host checked at the same time.", "n", "2");
+    QCommandLineOption timeout("timeout", "Milliseconds to wait for a stream to answer.", "ms");
+    QCommandLineOption mock("mock", "Number of URLs that check generates (takes no inputs).", "n");
+    QCommandLineOption mock_hosts("mock-hosts", "Local servers that answer the generated URLs.", "n", "8");
+    QCommandLineOption latency("latency", "Milliseconds the local servers wait before answering.", "ms", "0");
+    QCommandLineOption trace("trace", "Writes the time spent in each phase as a Chrome trace to this file "
+                             "(profiling builds only).", "path");
+    args.addOption(output);
+    args.addOption(jobs);
+    args.addOption(sort_key);
+    args.addOption(keep);
+    args.addOption(prefer);
+    args.addOption(format);
+    args.addOption(reader);
+    args.addOption(max_problems);
+    args.addOption(sizes);
+    args.addOption(escaped);
+    args.addOption(repeat);
+    args.addOption(json);
+    args.addOption(connections);
+    args.addOption(per_host);
+    args.addOption(timeout);
+    args.addOption(mock);
+    args.addOption(mock_hosts);
+    args.addOption(latency);
+    args.addOption(trace);
+    args.process(a);
+
+    QTextStream err(stderr);
+    QStringList positional = args.positionalArguments();
+    if (positional.value(0) == "bench") {
+        QList<int> entries;
+        foreach (const QString& size, args.value(sizes).split(',', QString::SkipEmptyParts)) {
+            entries.append(size.toInt());
+        }
+        QList<double> ratios;
+        foreach (const QString& ratio, args.value(escaped).split(',', QString::SkipEmptyParts)) {
+            ratios.append(qBound(0.0, ratio.toDouble(), 1.0));
+        }
+
+        QTextStream out(stdout);
+        Benchmark benchmark(entries, ratios, args.value(repeat).toInt());
+        if (!benchmark.run(out)) {
+            err << "Cannot write the benchmark files." << endl;
+            return 1;
+        }
+        if (args.isSet(json)) {
+            QFile file(args.value(json));
+            if (!file.open(QIODevice::WriteOnly) || file.write(benchmark.toJson()) < 0) {
+                err << "Cannot write " << args.value(json) << endl;
+                return 1;
+            }
+        }
+        return writeTrace(args.value(trace), err) ? 0 : 1;
+    }
+
+    if (positional.value(0) == "selftest") {
+        QTextStream out(stdout);
+        return SelfTest(out).run();
+    }
+
+    // The local servers answer at once, or never: a short wait is enough.
+    const int wait = args.isSet(timeout) ? args.value(timeout).toInt() : (args.isSet(mock) ? 1000 : 10000);
+    if (positional.value(0) == "check" && args.isSet(mock)) {
+        CheckCommand check(args.value(connections).toInt(), args.value(per_host).toInt(), wait);
+        return check.runMock(args.value(mock).toInt(), args.value(mock_hosts).toInt(),
+                             args.value(latency).toInt());
+    }
+
+    if (positional.size() < 2 ||
+        !(CliTool::commands().contains(positional.first()) || positional.first() == "check")) {
+        err << args.helpText();
+        return 2;
+    }
+    const QString command = positional.takeFirst();
+
+    CliOptions options;
+    options.output      = args.value(output);
+    options.format      = args.value(format);
+    options.sort_key    = Parser::SortByName;
+    options.jobs        = args.isSet(jobs) ? args.value(jobs).toInt() : QThread::idealThreadCount();
+    options.preferred   = args.value(prefer);
+    options.max_problems = args.value(max_problems).toInt();
+    options.merge_rule  = StreamMerger::KeepFirst;
+    if (args.isSet(prefer)) {
+        options.merge_rule = StreamMerger::PreferSource;
+    }
+    else if (args.value(keep) == "longest") {
+        options.merge_rule = StreamMerger::KeepLongestName;
+    }
+    else if (args.value(keep) != "first") {
+        err << "Unknown merge rule: " << args.value(keep) << endl;
+        return 2;
+    }
+    if (args.value(sort_key) == "url") {
+        options.sort_key = Parser::SortByUrl;
+    }
+    else if (args.value(sort_key) == "host") {
+        options.sort_key = Parser::SortByHost;
+    }
+    else if (args.value(sort_key) == "prefix") {
+        options.sort_key = Parser::SortByPrefix;
+    }
+    else if (args.value(sort_key) != "name") {
+        err << "Unknown sort key: " << args.value(sort_key) << endl;
+        return 2;
+    }
+
+    if (options.jobs <= 0) {
+        err << "Invalid number of jobs: " << args.value(jobs) << endl;
+        return 2;
+    }
+    if (options.max_problems < 0) {
+        err << "Invalid number of problems: " << args.value(max_problems) << endl;
+        return 2;
+    }
+    if (!CliTool::formats().contains(options.format)) {
+        err << "Unknown export format: " << options.format << endl;
+        return 2;
+    }
+    if (command == "merge" && options.output.isEmpty()) {
+        err << "merge needs an output file (-o)." << endl;
+        return 2;
+    }
+
+    const QStringList files = CliTool::expandInputs(positional);
+    if (files.isEmpty()) {
+        err << "No .sii files found." << endl;
+        return 2;
+    }
+
+    // One file gets all the cores to itself; several files already keep them
+    // busy, so each one is read by a single thread.
+    const QString mode = args.value(reader);
+    if (mode == "text") {
+        options.read_mode = Parser::TextStreamReader;
+    }
+    else if (mode == "mapped" || (mode.isEmpty() && files.size() > 1)) {
+        options.read_mode = Parser::MappedReader;
+    }
+    else if (mode == "parallel" || mode.isEmpty()) {
+        options.read_mode = Parser::ParallelReader;
+    }
+    else if (mode == "cached") {
+        options.read_mode = Parser::CachedReader;
+    }
+    else if (mode == "validating") {
+        options.read_mode = Parser::ValidatingReader;
+    }
+    else {
+        err << "Unknown reader: " << mode << endl;
+        return 2;
+    }
+
+    int status;
+    if (command == "check") {
+        CheckCommand check(args.value(connections).toInt(), args.value(per_host).toInt(), wait);
+        status = check.run(files, options.read_mode);
+    }
+    else {
+        CliTool tool(command, options);
+        status = tool.run(files);
+    }
+    if (!writeTrace(args.value(trace), err) && status == 0) {
+        status = 1;
+    }
+    return status;
+}
@@ -0,0 +1,108 @@
+#include "mockstreamserver.h"
+
+#include <QHostAddress>
+#include <QTcpSocket>
+#include <QTimer>
+
+MockStreamServer::MockStreamServer(QObject *parent) :
+    QTcpServer(parent),
+    latency_(0),
+    requests_(0)
+{
+    connect(this, SIGNAL(newConnection()), this, SLOT(acceptConnections()));
+}
+
+bool MockStreamServer::start(int host)
+{
+    // The whole 127.0.0.0/8 block is the loopback interface (on Linux, at
+    // least), which gives as many different hosts as needed.
+    return listen(QHostAddress(QString("127.0.0.%1").arg(host)), 0);
+}
+
+QString MockStreamServer::url(const QString& path) const
+{
+    return QString("http://%1:%2%3").arg(serverAddress().toString()).arg(serverPort()).arg(path);
+}
+
+void MockStreamServer::setLatency(int msecs)
+{
+    latency_ = msecs;
+}
+
+int MockStreamServer::requestCount() const
+{
+    return requests_;
+}
+
+void MockStreamServer::acceptConnections()
+{
+    while (hasPendingConnections()) {
+        QTcpSocket* socket = nextPendingConnection();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void MockStreamServer::readRequest()
+{
+    // Only the request line matters; the rest of the headers are skipped.
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket->property("request").isNull() || !socket->canReadLine()) {
+        return;
+    }
+
+    const QList<QByteArray> words = socket->readLine().trimmed().split(' ');
+    socket->setProperty("request", words.value(1));
+    requests_++;
+
+    // Owned by the socket, which is how answer() finds it, and gone with it
+    // if the client gives up first.
+    QTimer* timer = new QTimer(socket);
+    timer->setSingleShot(true);
+    connect(timer, SIGNAL(timeout()), this, SLOT(answer()));
+    timer->start(latency_);
+}
+
+void MockStreamServer::answer()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender()->parent());
+    const QByteArray path = socket->property("request").toByteArray();
+    const QByteArray res = response(path);
+    if (res.isEmpty()) {
+        return;
+    }
+    socket->write(res);
+
+    // Streams never end; anything else is over once written.
+    if (!path.startsWith("/ok/")) {
+        socket->disconnectFromHost();
+    }
+}
+
+QByteArray MockStreamServer::response(const QByteArray& path)
+{
+    if (path.startsWith("/ok/")) {
+        const QByteArray n = path.mid(4);
+        QByteArray res = "HTTP/1.0 200 OK\r\n"
+                         "Content-Type: audio/mpeg\r\n"
+                         "icy-name: Mock Radio " + n + "\r\n"
+                         "icy-br: 128\r\n"
+                         "icy-metaint: 16000\r\n"
+                         "\r\n";
+        return res.append(QByteArray(4096, '\0'));
+    }
+    if (path.startsWith("/redirect/")) {
+        return "HTTP/1.0 302 Found\r\n"
+               "Location: /ok/" + path.mid(10) + "\r\n"
+               "Content-Length: 0\r\n"
+               "Connection: close\r\n"
+               "\r\n";
+    }
+    if (path.startsWith("/slow/")) {
+        return QByteArray();
+    }
+    return "HTTP/1.0 404 Not Found\r\n"
+           "Content-Length: 0\r\n"
+           "Connection: close\r\n"
+           "\r\n";
+}
@@ -0,0 +1,38 @@
+#ifndef MOCKSTREAMSERVER_H
+#define MOCKSTREAMSERVER_H
+
+#include <QByteArray>
+#include <QTcpServer>
+
+// A stand-in for a stream host, listening on the loopback interface, so that
+// the checker can be run (and timed) without a network. It knows these paths:
+//   /ok/N          200 with ICY headers, followed by some data, and the
+//                  connection is kept open like a real stream.
+//   /redirect/N    302 to /ok/N.
+//   /missing/N     404.
+//   /slow/N        Reads the request and never answers.
+class MockStreamServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    explicit MockStreamServer(QObject *parent = 0);
+
+    bool start(int host);           // On a free port of 127.0.0.host.
+    QString url(const QString& path) const;
+    void setLatency(int msecs);     // Before answering, to look like a remote host.
+    int requestCount() const;
+
+private slots:
+    void acceptConnections();
+    void readRequest();
+    void answer();
+
+private:
+    int latency_;
+    int requests_;
+
+    static QByteArray response(const QByteArray& path);
+};
+
+#endif // MOCKSTREAMSERVER_H
@@ -0,0 +1,265 @@
+#include "selftest.h"
+#include "parser.h"
+#include "streammerger.h"
+#include "streamurl.h"
+
+#include <QFile>
+#include <QTemporaryDir>
+
+static const char kSampleDefinition[] = "live_stream_def : _nameless.2c0.ea20 {";
+
+SelfTest::SelfTest(QTextStream& out):
+out_(out),
+checks_(0),
+failures_(0)
+{
+}
+
+int SelfTest::run()
+{
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        out_ << "Cannot create a temporary directory." << endl;
+        return 1;
+    }
+
+    checkRoundTrip(dir.path());
+    checkMerge(dir.path());
+    checkCodec();
+    checkUrls();
+
+    out_ << QString("%1 checks, %2 failed").arg(checks_).arg(failures_) << endl;
+    return failures_ == 0 ? 0 : 1;
+}
+
+void SelfTest::checkRoundTrip(const QString& dir)
+{
+/*
+The sample is written as saves write files, so every reader has to give it
+back byte for byte, definition line included. The line reader (which the
+readers fall back to for files that are not valid documents, and which the
+merger uses) is also run on its own.
+*/
+    const QString file = dir + "/live_streams.sii";
+    const QByteArray sample = sampleFile();
+    QFile out(file);
+    if (!check(out.open(QIODevice::WriteOnly) && out.write(sample) == sample.size(), "write sample")) {
+        return;
+    }
+    out.close();
+
+    struct Reader {
+        const char* name;
+        Parser::ReadMode mode;
+    };
+    const Reader readers[] = {
+        { "mapped",     Parser::MappedReader },
+        { "parallel",   Parser::ParallelReader },
+        { "text",       Parser::TextStreamReader },
+        { "validating", Parser::ValidatingReader },
+        { "cached",     Parser::CachedReader },     // Writes the cache...
+        { "cached",     Parser::CachedReader }      // ...and reads it.
+    };
+    for (size_t i = 0; i < sizeof(readers) / sizeof(readers[0]); i++) {
+        Parser parser(file, readers[i].mode, 2);
+        checkSaved(parser, QString("round trip/") + readers[i].name, dir + "/saved.sii", sample);
+    }
+
+    // Files with the other line breaks are read as documents, and written
+    // back with the ones they had.
+    QByteArray other = sample;
+#ifdef Q_OS_WIN
+    other.replace("\r\n", "\n");
+#else
+    other.replace("\n", "\r\n");
+#endif
+    const QString other_file = dir + "/other_breaks.sii";
+    QFile out_other(other_file);
+    if (check(out_other.open(QIODevice::WriteOnly) && out_other.write(other) == other.size(), "write sample with other line breaks")) {
+        out_other.close();
+        for (size_t i = 0; i < sizeof(readers) / sizeof(readers[0]); i++) {
+            if (readers[i].mode != Parser::TextStreamReader) {
+                Parser parser(other_file, readers[i].mode, 2);
+                checkSaved(parser, QString("line breaks/") + readers[i].name, dir + "/saved.sii", other);
+            }
+        }
+    }
+
+    Parser lines(QString(), Parser::DeferredReader);
+    lines.appendBlock(Parser::parseBlock(sample.constData(), sample.constData(), sample.constData() + sample.size()));
+    checkSaved(lines, "round trip/lines", dir + "/saved.sii", sample);
+}
+
+void SelfTest::checkMerge(const QString& dir)
+{
+/*
+As the merge command does it: a file merged with itself is the file again,
+written from scratch, so the definition line can only come from the inputs.
+*/
+    const QString file = dir + "/live_streams.sii";
+    StreamMerger merger;
+    if (!check(merger.addFile(file) && merger.addFile(file), "merge/read")) {
+        return;
+    }
+    check(merger.duplicates() == merger.entriesRead() / 2, "merge/duplicates",
+          QString("%1 of %2 entries").arg(merger.duplicates()).arg(merger.entriesRead()));
+
+    Parser merged(QString(), Parser::DeferredReader);
+    merger.apply(merged);
+    checkSaved(merged, "merge/saved", dir + "/merged.sii", sampleFile());
+
+    // What the first file has besides the entries is kept as well.
+    QByteArray units = sampleFile();
+    QByteArray unit = "other_unit : _nameless.2c0.ea30 {\n value: 1\n}\n";
+#ifdef Q_OS_WIN
+    unit.replace("\n", "\r\n");
+#endif
+    units.insert(units.lastIndexOf('}'), unit);
+    const QString units_file = dir + "/units.sii";
+    QFile out(units_file);
+    if (!check(out.open(QIODevice::WriteOnly) && out.write(units) == units.size(), "merge/write units")) {
+        return;
+    }
+    out.close();
+
+    StreamMerger with_units;
+    with_units.addFile(units_file);
+    with_units.addFile(file);
+    Parser merged_units(QString(), Parser::DeferredReader);
+    with_units.apply(merged_units);
+    checkSaved(merged_units, "merge/other units", dir + "/merged.sii", units);
+}
+
+void SelfTest::checkCodec()
+{
+/*
+Strings are given as they are in the file and as UTF-8 (which is easier to
+read here than UTF-16). Round trips must decode and encode to each other;
+the rest are only decoded (broken or unusual input, which is read as well as
+it can be but not written back the same) or only encoded.
+*/
+    struct CodecCase {
+        const char* escaped;
+        const char* utf8;
+    };
+    static const CodecCase kRoundTrips[] = {
+        { "Jazz FM|Jazz|EN|128|0",                          "Jazz FM|Jazz|EN|128|0" },
+        { "R\\xc3\\xa1dio Espa\\xc3\\xb1a",               "R\xC3\xA1" "dio Espa\xC3\xB1" "a" },
+        { "\\xd0\\xa0\\xd0\\xb0\\xd0\\xb4\\xd0\\xb8\\xd0\\xbe", "\xD0\xA0\xD0\xB0\xD0\xB4\xD0\xB8\xD0\xBE" },
+        { "\\xe6\\x9d\\xb1\\xe4\\xba\\xac FM",           "\xE6\x9D\xB1\xE4\xBA\xAC FM" },
+        { "\\xf0\\x9f\\x8e\\xb5 Hits",                     "\xF0\x9F\x8E\xB5 Hits" },      // Surrogate pair.
+        { "Back\\slash \\ and C:\\x",                      "Back\\slash \\ and C:\\x" }  // Literal backslashes.
+    };
+    static const CodecCase kDecodeOnly[] = {
+        { "R\\xc3",                       "R\xEF\xBF\xBD" },             // Sequence cut short...
+        { "\\xe2\\x82",                   "\xEF\xBF\xBD" },              // ...at the end.
+        { "\\xc3\\xa",                    "\xEF\xBF\xBD\\xa" },         // Truncated escape.
+        { "\\xzz\\x4",                    "\\xzz\\x4" },                // Invalid escapes.
+        { "\\xff",                        "\xEF\xBF\xBD" },              // Invalid lead byte.
+        { "\\xc0\\xaf",                   "\xEF\xBF\xBD\xEF\xBF\xBD" },  // Overlong.
+        { "\\xed\\xa0\\x80",              "\xEF\xBF\xBD" },              // Encoded surrogate.
+        { "\\xF0\\x9F\\x8E\\xB5",         "\xF0\x9F\x8E\xB5" },         // Upper-case digits.
+        { "Caf\xC3\xA9",                   "Caf\xC3\xA9" }                 // Raw UTF-8.
+    };
+
+    for (size_t i = 0; i < sizeof(kRoundTrips) / sizeof(kRoundTrips[0]); i++) {
+        const QByteArray escaped(kRoundTrips[i].escaped);
+        const QString text = QString::fromUtf8(kRoundTrips[i].utf8);
+        const QString decoded = Parser::unescapeString(escaped.constData(), escaped.size());
+        const QByteArray encoded = Parser::escapeString(text);
+        check(decoded == text && encoded == escaped, "codec/round trip " + QString::fromUtf8(escaped),
+              "decoded as \"" + decoded + "\", encoded as \"" + QString::fromUtf8(encoded) + "\"");
+    }
+    for (size_t i = 0; i < sizeof(kDecodeOnly) / sizeof(kDecodeOnly[0]); i++) {
+        const QByteArray escaped(kDecodeOnly[i].escaped);
+        const QString decoded = Parser::unescapeString(escaped.constData(), escaped.size());
+        check(decoded == QString::fromUtf8(kDecodeOnly[i].utf8), "codec/decode " + QString::fromUtf8(escaped),
+              "decoded as \"" + decoded + "\"");
+    }
+
+    // Unpaired surrogates, which QStrings can hold and UTF-8 cannot.
+    const QString unpaired = QString("a") + QChar(0xD800) + QString("b") + QChar(0xDC00);
+    const QByteArray encoded = Parser::escapeString(unpaired);
+    check(encoded == "a\\xef\\xbf\\xbdb\\xef\\xbf\\xbd", "codec/encode unpaired surrogates",
+          "encoded as \"" + QString::fromUtf8(encoded) + "\"");
+}
+
+void SelfTest::checkUrls()
+{
+    // Only the scheme and the host are case-insensitive, wherever the host
+    // ends; trailing slashes and blanks do not count.
+    struct UrlCase {
+        const char* url;
+        const char* normalized;
+        const char* host;
+    };
+    static const UrlCase kUrls[] = {
+        { " HTTP://Radio.Example.COM:8000/Live/ ",  "http://radio.example.com:8000/Live",      "radio.example.com" },
+        { "http://Radio.Example.COM?Station=Jazz",  "http://radio.example.com?Station=Jazz",   "radio.example.com" },
+        { "http://Radio.Example.COM#Jazz",          "http://radio.example.com#Jazz",           "radio.example.com" },
+        { "Radio.Example.COM/Jazz.MP3",             "radio.example.com/Jazz.MP3",              "radio.example.com" },
+        { "Radio.Example.COM/Go?To=HTTP://X.Y",     "radio.example.com/Go?To=HTTP://X.Y",      "radio.example.com" },
+        { "Radio.Example.COM?To=HTTP://X.Y",        "radio.example.com?To=HTTP://X.Y",         "radio.example.com" }
+    };
+
+    for (size_t i = 0; i < sizeof(kUrls) / sizeof(kUrls[0]); i++) {
+        const QString url(kUrls[i].url);
+        const StreamUrl parts = StreamUrl::parse(QStringRef(&url));
+        check(parts.normalized == kUrls[i].normalized && parts.host == kUrls[i].host,
+              "url/" + url.trimmed(), "normalized as \"" + parts.normalized + "\", host \"" + parts.host + "\"");
+    }
+}
+
+bool SelfTest::check(bool ok, const QString& name, const QString& detail)
+{
+    checks_++;
+    if (!ok) {
+        failures_++;
+        out_ << "FAIL " << name << (detail.isEmpty() ? QString() : ": " + detail) << endl;
+    }
+    else {
+        out_ << "ok   " << name << endl;
+    }
+    return ok;
+}
+
+bool SelfTest::checkSaved(Parser& parser, const QString& name, const QString& output, const QByteArray& expected)
+{
+    if (parser.liveStreamDefLine() != kSampleDefinition) {
+        return check(false, name, "definition line \"" + parser.liveStreamDefLine() + "\"");
+    }
+    if (!parser.saveStreams(output)) {
+        return check(false, name, "cannot write " + output);
+    }
+    const QByteArray saved = readAll(output);
+    int at = 0;
+    while (at < qMin(saved.size(), expected.size()) && saved.at(at) == expected.at(at)) {
+        at++;
+    }
+    return check(saved == expected, name, QString("differs from byte %1").arg(at));
+}
+
+QByteArray SelfTest::sampleFile()
+{
+    QByteArray text =
+        "SiiNunit\n"
+        "{\n"
+        "live_stream_def : _nameless.2c0.ea20 {\n"
+        " stream_data: 4\n"
+        " stream_data[0]: \"http://streams.example.com:8000/jazz|Jazz FM|Jazz|EN|128|0\"\n"
+        " stream_data[1]: \"http://radio.example.es/live.mp3|R\\xc3\\xa1dio Espa\\xc3\\xb1a|Pop|ES|96|1\"\n"
+        " stream_data[2]: \"https://example.pl/stream?type=.mp3|Polskie Radio \\xe2\\x80\\x93 Tr\\xc3\\xb3jka|News|PL|128|0\"\n"
+        " stream_data[3]: \"http://192.0.2.7:8080/;|\\xe6\\x9d\\xb1\\xe4\\xba\\xac \\xf0\\x9f\\x8e\\xb5|Anime|JP|64|0\"\n"
+        "}\n"
+        "}\n";
+#ifdef Q_OS_WIN
+    text.replace("\n", "\r\n");     // As saves write them.
+#endif
+    return text;
+}
+
+QByteArray SelfTest::readAll(const QString& filename)
+{
+    QFile file(filename);
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
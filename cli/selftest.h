@@ -0,0 +1,37 @@
+#ifndef SELFTEST_H
+#define SELFTEST_H
+
+#include <QByteArray>
+#include <QString>
+#include <QTextStream>
+
+class Parser;
+
+// The selftest command: reads and writes known files through every reader and
+// the merger, and known strings through the .sii string codec and the URL
+// normalization, and checks that nothing is lost on the way, so that a build
+// can be checked on the machine it runs on.
+// Prints one line per check, and the failures.
+class SelfTest {
+public:
+    explicit SelfTest(QTextStream& out);
+
+    int run();                          // Returns the exit code.
+
+private:
+    QTextStream& out_;
+    int checks_;
+    int failures_;
+
+    void checkRoundTrip(const QString& dir);
+    void checkMerge(const QString& dir);
+    void checkCodec();
+    void checkUrls();
+
+    bool check(bool ok, const QString& name, const QString& detail = QString());
+    bool checkSaved(Parser&, const QString& name, const QString& output, const QByteArray& expected);
+    static QByteArray sampleFile();     // A live_streams.sii as the game writes it.
+    static QByteArray readAll(const QString&);
+};
+
+#endif // SELFTEST_H
@@ -0,0 +1,104 @@
+#include "diagnosticsdialog.h"
+#include "ui_diagnosticsdialog.h"
+#include "profiler.h"
+
+#include <QFileDialog>
+#include <QMessageBox>
+
+static QTableWidgetItem* numberItem(const QString& text)
+{
+    QTableWidgetItem* item = new QTableWidgetItem(text);
+    item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+    return item;
+}
+
+static QString milliseconds(qint64 ns)
+{
+    return QString::number(ns / 1e6, 'f', 3);
+}
+
+
+DiagnosticsDialog::DiagnosticsDialog(QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::DiagnosticsDialog),
+    directory_(QDir::home())
+{
+    ui->setupUi(this);
+
+    const bool enabled = Profiler::isEnabled();
+    ui->refreshButton->setEnabled(enabled);
+    ui->resetButton->setEnabled(enabled);
+    ui->exportButton->setEnabled(enabled);
+    on_refreshButton_clicked();
+}
+
+DiagnosticsDialog::~DiagnosticsDialog()
+{
+    delete ui;
+}
+
+void DiagnosticsDialog::setDirectory(const QDir& directory)
+{
+    directory_ = directory;
+}
+
+void DiagnosticsDialog::on_refreshButton_clicked()
+{
+    if (!Profiler::isEnabled()) {
+        ui->statusLabel->setText(tr("This build does not measure anything: "
+                                    "rebuild it with \"qmake CONFIG+=profiling\"."));
+        return;
+    }
+
+    const Profiler& profiler = Profiler::instance();
+    const QList<Profiler::ScopeStats> scopes = profiler.scopes();
+    ui->scopeTable->setRowCount(scopes.size());
+    for (int row = 0; row < scopes.size(); row++) {
+        const Profiler::ScopeStats& s = scopes.at(row);
+        ui->scopeTable->setItem(row, 0, new QTableWidgetItem(s.name));
+        ui->scopeTable->setItem(row, 1, numberItem(QString::number(s.calls)));
+        ui->scopeTable->setItem(row, 2, numberItem(milliseconds(s.total)));
+        ui->scopeTable->setItem(row, 3, numberItem(milliseconds(s.total / s.calls)));
+        ui->scopeTable->setItem(row, 4, numberItem(milliseconds(s.max)));
+    }
+    ui->scopeTable->resizeColumnsToContents();
+
+    const QList<Profiler::CounterStats> counters = profiler.counters();
+    ui->counterTable->setRowCount(counters.size());
+    for (int row = 0; row < counters.size(); row++) {
+        ui->counterTable->setItem(row, 0, new QTableWidgetItem(counters.at(row).name));
+        ui->counterTable->setItem(row, 1, numberItem(QString::number(counters.at(row).value)));
+    }
+    ui->counterTable->resizeColumnsToContents();
+
+    // Phases run concurrently (the parser's workers, for one) add up to more
+    // than the time that went by.
+    QString status = tr("Times are added up over all threads.");
+    if (profiler.droppedEvents() > 0) {
+        status += QString(tr(" The trace is full: "))+QString::number(profiler.droppedEvents())+
+                  QString(tr(" later calls were not recorded (reset to start over)."));
+    }
+    ui->statusLabel->setText(status);
+}
+
+void DiagnosticsDialog::on_resetButton_clicked()
+{
+    Profiler::instance().reset();
+    on_refreshButton_clicked();
+}
+
+void DiagnosticsDialog::on_exportButton_clicked()
+{
+    const QString file_name =
+        QFileDialog::getSaveFileName(this,
+                                     tr("Export Trace"),
+                                     directory_.filePath("etsradiomanager-trace.json"),
+                                     tr("Chrome trace files (*.json)"));
+    if (file_name.isEmpty()) {
+        return;
+    }
+
+    if (!Profiler::instance().writeTrace(file_name)) {
+        QMessageBox::warning(this, tr("Diagnostics"), tr("The trace could not be written to ") + file_name);
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef DIAGNOSTICSDIALOG_H
+#define DIAGNOSTICSDIALOG_H
+
+#include <QDialog>
+#include <QDir>
+
+namespace Ui {
+class DiagnosticsDialog;
+}
+
+// Shows what the profiler measured (see profiler.h): the time spent in each
+// phase and the counters, which can be exported as a Chrome trace.
+class DiagnosticsDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit DiagnosticsDialog(QWidget *parent = 0);
+    ~DiagnosticsDialog();
+
+    void setDirectory(const QDir&);    // Where traces are exported by default.
+
+private slots:
+    void on_refreshButton_clicked();
+
+    void on_resetButton_clicked();
+
+    void on_exportButton_clicked();
+
+private:
+    Ui::DiagnosticsDialog *ui;
+    QDir directory_;
+};
+
+#endif // DIAGNOSTICSDIALOG_H
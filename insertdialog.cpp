@@ -3,7 +3,8 @@
 
 InsertDialog::InsertDialog(QWidget *parent) :
     QDialog(parent),
-    ui(new Ui::InsertDialog)
+    ui(new Ui::InsertDialog),
+    parser_(NULL)
 {
     ui->setupUi(this);
     ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(false);
@@ -24,6 +25,11 @@ QString InsertDialog::getUrl() const
     return url_;
 }
 
+void InsertDialog::setParser(const Parser* parser)
+{
+    parser_ = parser;
+}
+
 void InsertDialog::on_buttonBox_accepted()
 {
     url_    = ui->insertUrl->text();
@@ -42,4 +48,15 @@ void InsertDialog::on_insertUrl_textChanged(const QString &arg1)
     ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(
                 !(arg1.isEmpty() || ui->insertName->text().isEmpty())
                 );
+
+    // Warning about duplicates (a hash lookup, cheap enough for every key).
+    int existing = (parser_ != NULL && !arg1.isEmpty()) ? parser_->findUrl(arg1) : -1;
+    if (existing != -1) {
+        ui->duplicateWarning->setText(tr("This URL is already in the list (entry %1: %2).")
+                                      .arg(existing + 1)
+                                      .arg(parser_->streamAt(existing).name));
+    }
+    else {
+        ui->duplicateWarning->clear();
+    }
 }
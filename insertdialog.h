@@ -5,6 +5,8 @@
 #include <QDialogButtonBox>
 #include <QPushButton>
 
+#include "parser.h"
+
 namespace Ui {
 class InsertDialog;
 }
@@ -18,6 +20,7 @@ public:
     ~InsertDialog();
     QString getName() const;
     QString getUrl() const;
+    void setParser(const Parser*);  // To warn about URLs already in the list.
 
 private slots:
     void on_buttonBox_accepted();
@@ -28,6 +31,7 @@ private slots:
 
 private:
     Ui::InsertDialog *ui;
+    const Parser* parser_;
     QString name_;
     QString url_;
 };
@@ -0,0 +1,194 @@
+#include "linescanner.h"
+
+#include <QtAlgorithms>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define LINESCANNER_X86
+#endif
+
+#if defined(LINESCANNER_X86) && (defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define LINESCANNER_SSE2
+#include <emmintrin.h>
+#endif
+
+// AVX2 is compiled for a single function through the target attribute, so the
+// rest of the binary still runs on CPUs without it.
+#if defined(LINESCANNER_X86) && defined(__GNUC__)
+#define LINESCANNER_AVX2
+#include <immintrin.h>
+#endif
+
+
+// Builds the line table while the kernels report the positions they find.
+class LineBuilder {
+public:
+    LineBuilder(const char* base, QVector<LineInfo>& lines):
+    base_(base),
+    lines_(lines)
+    {
+        reset(base);
+    }
+
+    inline void hit(const char* p)
+    {
+        const qint32 offset = qint32(p - line_);
+        switch (*p) {
+        case '"':
+            if (current_.first_quote < 0) {
+                current_.first_quote = offset;
+            }
+            current_.last_quote = offset;
+            break;
+        case '|':
+            if (current_.separator < 0) {
+                current_.separator = offset;
+            }
+            break;
+        case '\\':
+            current_.escaped = true;
+            break;
+        default: // '\n'
+            current_.length = quint32(offset);
+            if (offset > 0 && p[-1] == '\r') {
+                current_.length--;
+            }
+            lines_.append(current_);
+            reset(p + 1);
+        }
+    }
+
+    // Checks a single byte (used by the scalar kernel and for block tails).
+    inline void check(const char* p)
+    {
+        if (*p == '"' || *p == '|' || *p == '\\' || *p == '\n') {
+            hit(p);
+        }
+    }
+
+    // Adds the last line, if it was not terminated by a '\n'.
+    void finish(const char* end)
+    {
+        if (end > line_) {
+            current_.length = quint32(end - line_);
+            if (end[-1] == '\r') {
+                current_.length--;
+            }
+            lines_.append(current_);
+        }
+    }
+
+private:
+    const char* base_;
+    const char* line_;
+    QVector<LineInfo>& lines_;
+    LineInfo current_;
+
+    void reset(const char* line)
+    {
+        line_ = line;
+        current_.begin          = quint32(line - base_);
+        current_.length         = 0;
+        current_.first_quote    = -1;
+        current_.last_quote     = -1;
+        current_.separator      = -1;
+        current_.escaped        = false;
+    }
+};
+
+
+static void scanScalar(const char* begin, const char* end, LineBuilder& builder)
+{
+    for (const char* p = begin; p < end; p++) {
+        builder.check(p);
+    }
+}
+
+#ifdef LINESCANNER_SSE2
+static void scanSse2(const char* begin, const char* end, LineBuilder& builder)
+{
+    const __m128i quote     = _mm_set1_epi8('"');
+    const __m128i separator = _mm_set1_epi8('|');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i newline   = _mm_set1_epi8('\n');
+
+    const char* p = begin;
+    for (; end - p >= 16; p += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i found =
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, separator)),
+                         _mm_or_si128(_mm_cmpeq_epi8(v, backslash), _mm_cmpeq_epi8(v, newline)));
+
+        quint32 mask = quint32(_mm_movemask_epi8(found));
+        while (mask != 0) {
+            builder.hit(p + qCountTrailingZeroBits(mask));
+            mask &= mask - 1;   // Clearing the lowest bit.
+        }
+    }
+    scanScalar(p, end, builder);
+}
+#endif
+
+#ifdef LINESCANNER_AVX2
+__attribute__((target("avx2")))
+static void scanAvx2(const char* begin, const char* end, LineBuilder& builder)
+{
+    const __m256i quote     = _mm256_set1_epi8('"');
+    const __m256i separator = _mm256_set1_epi8('|');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i newline   = _mm256_set1_epi8('\n');
+
+    const char* p = begin;
+    for (; end - p >= 32; p += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        const __m256i found =
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, separator)),
+                            _mm256_or_si256(_mm256_cmpeq_epi8(v, backslash), _mm256_cmpeq_epi8(v, newline)));
+
+        quint32 mask = quint32(_mm256_movemask_epi8(found));
+        while (mask != 0) {
+            builder.hit(p + qCountTrailingZeroBits(mask));
+            mask &= mask - 1;
+        }
+    }
+    scanScalar(p, end, builder);
+}
+#endif
+
+
+LineScanner::Kernel LineScanner::bestKernel()
+{
+#ifdef LINESCANNER_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        return Avx2Kernel;
+    }
+#endif
+#ifdef LINESCANNER_SSE2
+    return Sse2Kernel;
+#else
+    return ScalarKernel;
+#endif
+}
+
+void LineScanner::scan(const char* begin, const char* end, QVector<LineInfo>& lines, Kernel kernel)
+{
+    LineBuilder builder(begin, lines);
+
+    switch (kernel) {
+#ifdef LINESCANNER_AVX2
+    case Avx2Kernel:
+        scanAvx2(begin, end, builder);
+        break;
+#endif
+#ifdef LINESCANNER_SSE2
+    case Sse2Kernel:
+        scanSse2(begin, end, builder);
+        break;
+#endif
+    default: // Requested kernel not available in this build.
+        scanScalar(begin, end, builder);
+    }
+
+    builder.finish(end);
+}
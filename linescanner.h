@@ -0,0 +1,35 @@
+#ifndef LINESCANNER_H
+#define LINESCANNER_H
+
+#include <QVector>
+
+// Positions of the interesting characters of one line. All offsets are
+// relative to the start of the line; -1 means "not found".
+struct LineInfo {
+    quint32 begin;      // Offset of the line from the start of the block.
+    quint32 length;     // Without the line terminator ("\n" or "\r\n").
+    qint32 first_quote;
+    qint32 last_quote;
+    qint32 separator;   // First '|'.
+    bool escaped;       // Whether the line contains a '\'.
+};
+
+
+class LineScanner {
+public:
+    enum Kernel {
+        ScalarKernel,
+        Sse2Kernel,
+        Avx2Kernel
+    };
+
+    // Fastest kernel supported by the CPU we are running on.
+    static Kernel bestKernel();
+
+    // Finds every '"', '|', '\' and '\n' in [begin, end) in a single pass and
+    // appends one LineInfo per line to the table.
+    static void scan(const char*, const char*, QVector<LineInfo>&,
+                     Kernel kernel = bestKernel());
+};
+
+#endif // LINESCANNER_H
@@ -1,13 +1,27 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
+#include <algorithm>
+
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow),
     parser_(NULL),
+    model_(new StreamTableModel(this)),
+    filter_(new StreamFilterModel(this)),
+    loader_(new StreamLoader(this)),
+    checker_(new StreamChecker(this)),
+    checks_done_(0),
+    undo_stack_(new QUndoStack(this)),
+    watcher_(new QFileSystemWatcher(this)),
+    reload_timer_(new QTimer(this)),
+    reloading_(false),
     status_message(new QLabel(this)),
+    load_progress_(new QProgressBar(this)),
+    cancel_load_(new QToolButton(this)),
     last_directory_(QDir::homePath()),
-    changes_made_(false)
+    changes_made_(false),
+    partial_load_(false)
 {
     ui->setupUi(this);
 
@@ -18,12 +32,51 @@ MainWindow::MainWindow(QWidget *parent) :
     status_message->setText(tr("No file opened."));
     ui->statusBar->addPermanentWidget(status_message);
 
-    // Setting column labels.
-    ui->dataTable->setColumnCount(2);
-    QTableWidgetItem *name  = new QTableWidgetItem(tr("Description"));
-    QTableWidgetItem *url   = new QTableWidgetItem(tr("URL"));
-    ui->dataTable->setHorizontalHeaderItem(DESC_COL, name);
-    ui->dataTable->setHorizontalHeaderItem(URL_COL, url);
+    // Loading progress (hidden until a file is opened).
+    load_progress_->setRange(0, 1000);
+    load_progress_->setMaximumWidth(160);
+    load_progress_->hide();
+    cancel_load_->setDefaultAction(ui->actionCancelLoading);
+    cancel_load_->hide();
+    ui->statusBar->addPermanentWidget(load_progress_);
+    ui->statusBar->addPermanentWidget(cancel_load_);
+    connect(loader_, SIGNAL(batchReady(ParsedBlock)), this, SLOT(loadBatchReady(ParsedBlock)));
+    connect(loader_, SIGNAL(progress(qint64,qint64)), this, SLOT(loadProgress(qint64,qint64)));
+    connect(loader_, SIGNAL(finished(bool)), this, SLOT(loadFinished(bool)));
+
+    // Stream checks: the model shows the results as they arrive.
+    connect(checker_, SIGNAL(checked(QString,CheckResult)), model_, SLOT(setCheckResult(QString,CheckResult)));
+    connect(checker_, SIGNAL(checked(QString,CheckResult)), this, SLOT(streamChecked()));
+    connect(checker_, SIGNAL(finished()), this, SLOT(checkFinished()));
+
+    // The table shows the parser's entries through the model (column labels
+    // included), filtered by the search box. Fixed row heights spare the view
+    // from measuring every row.
+    filter_->setSourceModel(model_);
+    ui->dataTable->setModel(filter_);
+    ui->dataTable->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    connect(ui->dataTable->selectionModel(),
+            SIGNAL(selectionChanged(QItemSelection,QItemSelection)),
+            this, SLOT(dataTableSelectionChanged()));
+    connect(model_, SIGNAL(dropRequested(QList<int>,int)), this, SLOT(dropRequested(QList<int>,int)));
+
+    // Undo and redo, in the Edit menu. The file has pending changes whenever
+    // the history is not where it was when last saved.
+    QAction* undo = undo_stack_->createUndoAction(this, tr("&Undo"));
+    QAction* redo = undo_stack_->createRedoAction(this, tr("&Redo"));
+    undo->setShortcuts(QKeySequence::Undo);
+    redo->setShortcuts(QKeySequence::Redo);
+    ui->menuEdit->insertAction(ui->actionRemoveDuplicates, undo);
+    ui->menuEdit->insertAction(ui->actionRemoveDuplicates, redo);
+    ui->menuEdit->insertSeparator(ui->actionRemoveDuplicates);
+    connect(undo_stack_, SIGNAL(cleanChanged(bool)), this, SLOT(undoCleanChanged(bool)));
+    connect(undo_stack_, SIGNAL(indexChanged(int)), this, SLOT(dataTableSelectionChanged()));
+
+    // Changes of the opened file made by other programs.
+    reload_timer_->setSingleShot(true);
+    reload_timer_->setInterval(500);
+    connect(watcher_, SIGNAL(fileChanged(QString)), this, SLOT(fileChangedOnDisk(QString)));
+    connect(reload_timer_, SIGNAL(timeout()), this, SLOT(reloadChangedFile()));
 }
 
 
@@ -40,9 +93,17 @@ void MainWindow::on_actionAbout_triggered()
 }
 
 
+void MainWindow::on_actionDiagnostics_triggered()
+{
+    DiagnosticsDialog d(this);
+    d.setDirectory(last_directory_);
+    d.exec();
+}
+
+
 void MainWindow::resizeEvent(QResizeEvent *) {
-  ui->dataTable->setColumnWidth(DESC_COL, this->width()/2);
-  ui->dataTable->setColumnWidth(URL_COL,  this->width()/2);
+  ui->dataTable->setColumnWidth(StreamTableModel::DESC_COL, this->width()*2/5);
+  ui->dataTable->setColumnWidth(StreamTableModel::URL_COL,  this->width()*2/5);
 }
 
 
@@ -54,9 +115,8 @@ void MainWindow::on_actionOpen_triggered()
         if (ret == QMessageBox::Cancel) {
             return;
         }
-        if (ret == QMessageBox::Yes) {
-                this->parser_->saveStreams();
-                clearChangesMade();
+        if (ret == QMessageBox::Yes && !saveOpenedFile()) {
+            return;
         }
     }
 
@@ -78,69 +138,261 @@ void MainWindow::on_actionOpen_triggered()
         return;
     }
 
+    // Opening another file: stop reading (and checking) the current one,
+    // now that it is sure to be replaced.
+    loader_->cancel();
+    checker_->cancel();
+
     this->opened_file_      = file_name;
+    this->partial_load_     = false;
     this->last_directory_   = QDir(file_name); // Saving directory for future accesses.
+    undo_stack_->clear();   // The history belongs to the previous file.
     clearChangesMade();
 
 
     // Checking if a file was already loaded.
     // If that is the case, we clean up the current data:
+    model_->setParser(NULL);
     if (this->parser_ != NULL) {
         delete this->parser_;
     }
-    // Creating new parser:
-    this->parser_ = new Parser(file_name);
+    // Watching the new file instead.
+    if (!watcher_->files().isEmpty()) {
+        watcher_->removePaths(watcher_->files());
+    }
+    watcher_->addPath(file_name);
 
+    // Creating new parser (its entries are read in the background, unless the
+    // file has not changed since it was cached):
+    this->parser_ = new Parser(file_name, Parser::DeferredReader);
+    const bool cached = this->parser_->loadCache();
+    model_->setParser(this->parser_);
 
-    // Populating the table...
-    ui->dataTable->clearContents();
+    // Populating the table as the entries arrive (the view only asks for the
+    // visible rows):
+    ui->dataTable->setEnabled(true);
+    ui->dataTable->setDragEnabled(false);
+    ui->searchEdit->setEnabled(true);
+    ui->actionSave_As->setEnabled(false);
+    ui->actionMergeFiles->setEnabled(false);
+    ui->insertNew->setEnabled(false);
+    ui->actionRemoveDuplicates->setEnabled(false);
+    ui->menuSort->setEnabled(false);
+    ui->actionCheckStreams->setEnabled(false);
+    ui->actionCancelLoading->setEnabled(true);
+    load_progress_->setValue(0);
+    load_progress_->show();
+    cancel_load_->show();
+    ui->statusBar->showMessage(tr("Loading..."));
+
+    if (cached) {
+        loadFinished(false);
+        return;
+    }
+    loader_->start(file_name);
+}
 
-    StreamList::const_iterator it;
-    unsigned int row = 0;
-    for (it = this->parser_->streamsBegin(); it != this->parser_->streamsEnd(); it++) {
-        ui->dataTable->insertRow(row);
 
-        QTableWidgetItem *name = new QTableWidgetItem(it->name);
-        ui->dataTable->setItem(row, DESC_COL, name);
+void MainWindow::loadBatchReady(const ParsedBlock& block)
+{
+    model_->appendBlock(block);
+}
+
 
-        QTableWidgetItem *url = new QTableWidgetItem(it->url);
-        ui->dataTable->setItem(row, URL_COL, url);
-        row++;
+void MainWindow::loadProgress(qint64 bytes_read, qint64 total_bytes)
+{
+    if (total_bytes > 0) {
+        load_progress_->setValue(int(bytes_read * 1000 / total_bytes));
     }
+}
+
+
+void MainWindow::loadFinished(bool cancelled)
+{
+    load_progress_->hide();
+    cancel_load_->hide();
+    ui->actionCancelLoading->setEnabled(false);
 
-    ui->dataTable->setRowCount(row);
-    ui->dataTable->setEnabled(true);
     // Status message.
-    ui->statusBar->showMessage(QString(tr("Loaded "))+QString::number(row)+QString(tr(" URLs.")));
-    // Enabling buttons:
+    QString loaded = QString::number(parser_->streamCount());
+    if (cancelled) {
+        ui->statusBar->showMessage(QString(tr("Loading cancelled: only "))+loaded+QString(tr(" URLs were loaded.")));
+    }
+    else if (!parser_->errorString().isEmpty()) {
+        ui->statusBar->showMessage(QString(tr("The file cannot be read: "))+parser_->errorString());
+    }
+    else {
+        ui->statusBar->showMessage(QString(tr("Loaded "))+loaded+QString(tr(" URLs.")));
+    }
+    // Searching the whole list from now on:
+    filter_->buildIndex();
+
+    // Read from the file (not from its cache): caching it for the next time.
+    if (!cancelled && sender() == loader_) {
+        parser_->writeCache();
+    }
+
+    // Enabling buttons (and reordering by dragging):
+    ui->dataTable->setDragEnabled(true);
     ui->actionSave_As->setEnabled(true);
+    ui->actionMergeFiles->setEnabled(true);
     ui->insertNew->setEnabled(true);
+    ui->actionRemoveDuplicates->setEnabled(true);
+    ui->menuSort->setEnabled(true);
+    ui->actionCheckStreams->setEnabled(true);
+    ui->actionSave->setEnabled(changes_made_);
+    dataTableSelectionChanged();
+
+    this->partial_load_ = cancelled;
+    saved_streams_ = parser_->streamList();
+}
+
+
+void MainWindow::on_actionCancelLoading_triggered()
+{
+    loader_->cancel();
 }
 
 
-void MainWindow::on_dataTable_itemSelectionChanged()
+void MainWindow::fileChangedOnDisk(const QString& path)
+{
+    // A file replaced by renaming another one over it (as QSaveFile and many
+    // other writers do) is no longer watched: watching its replacement.
+    if (!watcher_->files().contains(path) && QFileInfo(path).exists()) {
+        watcher_->addPath(path);
+    }
+    reload_timer_->start();
+}
+
+
+void MainWindow::reloadChangedFile()
+{
+/*
+Our own saves record the new state of the file, so they are not taken for
+changes. Without local edits the file is just read again; with them, the user
+chooses between merging them into the new contents, discarding them, or
+keeping the current list (which the next save writes over the file).
+*/
+    if (parser_ == NULL || reloading_ || loader_->isRunning() ||
+        !QFileInfo(parser_->fileName()).isFile() || !parser_->fileChanged()) {
+        return;
+    }
+    if (!watcher_->files().contains(parser_->fileName())) {
+        watcher_->addPath(parser_->fileName());
+    }
+
+    reloading_ = true;
+    Parser fresh(parser_->fileName(), Parser::ParallelReader);
+    if (!changes_made_) {
+        reloadFromDisk(fresh);
+        reloading_ = false;
+        return;
+    }
+
+    QMessageBox box(QMessageBox::Question, tr("ETS Radio Manager"),
+                    tr("The file was changed by another program while it had unsaved changes.\n"
+                       "Merge your changes into its new contents, or reload it and discard them?"),
+                    QMessageBox::NoButton, this);
+    QPushButton* merge = box.addButton(tr("&Merge"), QMessageBox::AcceptRole);
+    QPushButton* reload = box.addButton(tr("&Reload"), QMessageBox::DestructiveRole);
+    box.addButton(tr("&Keep Mine"), QMessageBox::RejectRole);
+    box.setDefaultButton(merge);
+    box.exec();
+
+    if (box.clickedButton() == reload) {
+        reloadFromDisk(fresh);
+    }
+    else if (box.clickedButton() == merge) {
+        // Replayed as one step of the history, so that undoing it gives the
+        // new contents of the file.
+        const StreamRebase rebase = StreamRebase::compute(saved_streams_, parser_->streamList(), fresh.streamList());
+        reloadFromDisk(fresh);
+        if (!rebase.isEmpty()) {
+            undo_stack_->beginMacro(tr("Merge unsaved changes"));
+            for (int i = 0; i < rebase.edited_rows.size(); i++) {
+                undo_stack_->push(new EditStreamCommand(model_, rebase.edited_rows.at(i), rebase.edited.at(i)));
+            }
+            if (!rebase.removed_rows.isEmpty()) {
+                undo_stack_->push(new RemoveStreamsCommand(model_, rebase.removed_rows, tr("Remove entries")));
+            }
+            foreach (const Stream& stream, rebase.added) {
+                undo_stack_->push(new InsertStreamCommand(model_, stream));
+            }
+            undo_stack_->endMacro();
+        }
+        ui->statusBar->showMessage(QString(tr("The file changed on disk; your changes were merged ("))+
+                                   QString::number(rebase.conflicts)+QString(tr(" conflicts, where yours were kept).")));
+    }
+    reloading_ = false;
+}
+
+
+void MainWindow::reloadFromDisk(const Parser& fresh)
+{
+    const StreamDiff diff = model_->reloadStreams(fresh);
+    saved_streams_ = parser_->streamList();
+    partial_load_ = false;
+    undo_stack_->clear();   // The history was about the previous contents.
+    clearChangesMade();
+    dataTableSelectionChanged();
+
+    const int changed = qMax(diff.old_end, diff.new_end) - diff.first;
+    ui->statusBar->showMessage(QString(tr("The file changed on disk: reloaded, "))+QString::number(changed)+
+                               QString(tr(" entries changed.")));
+}
+
+
+int MainWindow::selectedRow() const
+{ // -1 if nothing is selected. Rows are the parser's, not the view's.
+    QModelIndexList rows = ui->dataTable->selectionModel()->selectedRows();
+    return rows.isEmpty() ? -1 : filter_->mapToSource(rows.first()).row();
+}
+
+
+QList<int> MainWindow::selectedRows() const
+{ // In ascending order.
+    QList<int> rows;
+    foreach (const QModelIndex& i, ui->dataTable->selectionModel()->selectedRows()) {
+        rows.append(filter_->mapToSource(i).row());
+    }
+    std::sort(rows.begin(), rows.end());
+    return rows;
+}
+
+
+void MainWindow::dataTableSelectionChanged()
 { // Update line edits with selected content.
     // Read selected info:
-    QList<QTableWidgetItem*> items  = ui->dataTable->selectedItems();
-
-    if (!items.empty()) {
-        QTableWidgetItem* url       = items.at(URL_COL);
-        QTableWidgetItem* name      = items.at(DESC_COL);
-        // Updating line edits...
-        ui->urlEdit->setText(url->text());
-        ui->nameEdit->setText(name->text());
+    QList<int> rows = selectedRows();
+
+    if (!rows.isEmpty()) {
+        // Entries can be browsed while the file loads, but not modified.
+        bool editable = !loader_->isRunning();
+        // Several entries can be moved or removed, but not edited.
+        bool single = (rows.size() == 1);
+
+        if (single) {
+            Stream selected = this->parser_->streamAt(rows.first());
+            // Updating line edits...
+            ui->urlEdit->setText(selected.url);
+            ui->nameEdit->setText(selected.name);
+        }
+        else {
+            ui->urlEdit->clear();
+            ui->nameEdit->clear();
+        }
         // ... and enabling them:
-        ui->urlEdit->setEnabled(true);
-        ui->nameEdit->setEnabled(true);
+        ui->urlEdit->setEnabled(editable && single);
+        ui->nameEdit->setEnabled(editable && single);
 
         // Disable save button (until a change is made):
         ui->saveEdit->setEnabled(false);
         // Enable remove button:
-        ui->remove->setEnabled(true);
+        ui->remove->setEnabled(editable);
 
-        // Enable move icons:
-        ui->moveUp->setEnabled(true);
-        ui->moveDown->setEnabled(true);
+        // Enable move icons (unless the selection is already at that end):
+        ui->moveUp->setEnabled(editable && rows.first() > 0);
+        ui->moveDown->setEnabled(editable && rows.last() < model_->rowCount()-1);
     }
     else { // There is nothing to edit.
         ui->urlEdit->setEnabled(false);
@@ -164,44 +416,54 @@ void MainWindow::entryEdited(){
 
 void MainWindow::on_moveUp_clicked()
 {
-    QTableWidgetSelectionRange selected = ui->dataTable->selectedRanges().first();
-    unsigned int selected_row = selected.topRow();
+    QList<int> rows = selectedRows();
 
-    if (selected_row > 0) {
-        swapItems(selected_row-1, selected_row);
-        // Changing selection to "chase" the item:
-        ui->dataTable->selectRow(selected_row-1);
+    if (!rows.isEmpty() && rows.first() > 0) {
+        // The selected rows go (together) above the row over the first one.
+        moveItems(rows, rows.first()-1);
     }
 }
 
 
 void MainWindow::on_moveDown_clicked()
 {
-    QTableWidgetSelectionRange selected = ui->dataTable->selectedRanges().first();
-    int selected_row = selected.topRow();
+    QList<int> rows = selectedRows();
 
-    if (selected_row < ui->dataTable->rowCount()-1) {
-        swapItems(selected_row, selected_row+1);
-        // Changing selection to "chase" the item:
-        ui->dataTable->selectRow(selected_row+1);
+    if (!rows.isEmpty() && rows.last() < model_->rowCount()-1) {
+        // The selected rows go (together) below the row under the last one.
+        moveItems(rows, rows.last()+2);
     }
 }
 
 
-void MainWindow::swapItems(unsigned int a, unsigned int b)
-{// This function will call parser.swap() and update the view.
+void MainWindow::moveItems(const QList<int>& rows, int target)
+{// Moves the rows in one go (the model updates the view).
 
-    // Swapping elements in the structure.
-    this->parser_->swapStreams(a, b);
+    // The selection follows the moved entries, which end up starting at
+    // target, minus the ones that were above it.
+    int first = target;
+    foreach (int row, rows) {
+        first -= (row < target) ? 1 : 0;
+    }
+    undo_stack_->push(new MoveStreamsCommand(model_, rows, target));
+    ui->dataTable->scrollTo(filter_->mapFromSource(model_->index(first, 0)));
+}
 
-    // Updating the view:
-    StreamList::iterator it(parser_->streamsBegin());
-    ui->dataTable->item(a, URL_COL)->setText(it[a].url);
-    ui->dataTable->item(a, DESC_COL)->setText(it[a].name);
-    ui->dataTable->item(b, URL_COL)->setText(it[b].url);
-    ui->dataTable->item(b, DESC_COL)->setText(it[b].name);
 
-    setChangesMade();
+void MainWindow::dropRequested(const QList<int>& rows, int target)
+{
+    moveItems(rows, target);
+}
+
+
+void MainWindow::undoCleanChanged(bool clean)
+{
+    if (clean) {
+        clearChangesMade();
+    }
+    else {
+        setChangesMade();
+    }
 }
 
 
@@ -212,8 +474,8 @@ void MainWindow::setChangesMade()
         // Add a symbol next to the path to show there are unsaved changes:
         QString path = status_message->text();
         status_message->setText(path + " *");
-        // Enable save button:
-        ui->actionSave->setEnabled(true);
+        // Enable save button (once the whole file is loaded):
+        ui->actionSave->setEnabled(!loader_->isRunning());
     }
 }
 
@@ -231,15 +493,7 @@ void MainWindow::clearChangesMade()
 
 void MainWindow::on_actionSave_triggered()
 {
-    bool saved = this->parser_->saveStreams();
-    if (!saved) {
-        QMessageBox error;
-        error.setIcon(QMessageBox::Warning);
-        error.setText(tr("Error saving file."));
-        error.exec();
-        return;
-    }
-    clearChangesMade();
+    saveOpenedFile();
 }
 
 
@@ -271,11 +525,65 @@ void MainWindow::on_actionSave_As_triggered()
         }
         this->opened_file_ = file_name;
         this->last_directory_ = QDir(file_name); // Saving directory for future accesses.
+        undo_stack_->setClean();
         clearChangesMade();
     }
 }
 
 
+void MainWindow::on_actionMergeFiles_triggered()
+{
+    QString starting_directory;
+    if (this->last_directory_ != QDir::homePath()) {
+        starting_directory = this->last_directory_.path();
+    }
+    QStringList files = QFileDialog::getOpenFileNames(this,
+                                                      tr("Merge Files"),
+                                                      starting_directory,
+                                                      tr(".sii files (*.sii)"));
+    if (files.isEmpty()) {
+        return;
+    }
+
+    // Which entry stays when a URL is repeated. The list is the first source
+    // of the merge, and the files come after it.
+    QStringList rules;
+    rules << tr("Keep the entries already in the list") << tr("Keep the longest names");
+    foreach (const QString& file, files) {
+        rules << QString(tr("Prefer the entries of "))+QFileInfo(file).fileName();
+    }
+    bool ok = false;
+    const int rule = rules.indexOf(QInputDialog::getItem(this, tr("Merge Files"), tr("For repeated URLs:"),
+                                                         rules, 0, false, &ok));
+    if (!ok) {
+        return;
+    }
+
+    StreamMerger merger(parser_,
+                        rule == 0 ? StreamMerger::KeepFirst :
+                        rule == 1 ? StreamMerger::KeepLongestName : StreamMerger::PreferSource,
+                        rule - 1);
+    QStringList unreadable;
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    foreach (const QString& file, files) {
+        if (!merger.addFile(file)) {
+            unreadable.append(QFileInfo(file).fileName());
+        }
+    }
+    QApplication::restoreOverrideCursor();
+
+    if (!merger.replacedRows().isEmpty() || !merger.added().isEmpty()) {
+        undo_stack_->push(new MergeStreamsCommand(model_, merger));
+    }
+    QString message = QString(tr("Added "))+QString::number(merger.added().size())+QString(tr(" URLs, "))+
+                      QString::number(merger.duplicates())+QString(tr(" were already there."));
+    if (!unreadable.isEmpty()) {
+        message += QString(tr(" Cannot read: "))+unreadable.join(", ");
+    }
+    ui->statusBar->showMessage(message);
+}
+
+
 int MainWindow::saveChangesPrompt() {
     QMessageBox mBox;
     mBox.setWindowTitle(tr("ETS Radio Manager"));
@@ -289,6 +597,38 @@ int MainWindow::saveChangesPrompt() {
 }
 
 
+bool MainWindow::saveOpenedFile()
+{
+/*
+Every save of the opened file (the save action, and the save-changes prompt
+when opening another file or quitting) goes through here, so that a partly
+loaded file is never overwritten without asking.
+*/
+    if (this->partial_load_) {
+        int ret = QMessageBox::warning(this, tr("ETS Radio Manager"),
+                                       tr("Only part of the file was loaded. Saving will drop the remaining entries.\n"
+                                          "Do you want to save anyway?"),
+                                       QMessageBox::Yes | QMessageBox::No, QMessageBox::No);
+        if (ret != QMessageBox::Yes) {
+            return false;
+        }
+    }
+
+    bool saved = this->parser_->saveStreams();
+    if (!saved) {
+        QMessageBox error;
+        error.setIcon(QMessageBox::Warning);
+        error.setText(tr("Error saving file."));
+        error.exec();
+        return false;
+    }
+    undo_stack_->setClean();
+    clearChangesMade();
+    saved_streams_ = parser_->streamList();
+    return true;
+}
+
+
 void MainWindow::closeEvent(QCloseEvent* event)
 {
     // No changes made => exit.
@@ -304,14 +644,9 @@ void MainWindow::closeEvent(QCloseEvent* event)
         return;
     }
 
-    if (res == QMessageBox::Yes) {
-        if (!this->parser_->saveStreams()) {
-            QMessageBox error;
-            error.setWindowTitle(tr("ETS Radio Manager"));
-            error.setIcon(QMessageBox::Critical);
-            error.setText(tr("Error saving file."));
-            error.exec();
-        }
+    if (res == QMessageBox::Yes && !saveOpenedFile()) {   // Keeping the changes.
+        event->ignore();
+        return;
     }
 
     event->accept();
@@ -320,19 +655,12 @@ void MainWindow::closeEvent(QCloseEvent* event)
 
 void MainWindow::on_saveEdit_clicked()
 {
-    QTableWidgetSelectionRange selected = ui->dataTable->selectedRanges().first();
-    int row = selected.topRow();
-    // Getting iterator to the item:
-    StreamList::iterator it = this->parser_->streamsBegin();
-    // Modifying data:
-    it[row].name    = ui->nameEdit->text();
-    it[row].url     = ui->urlEdit->text();
-    // Updating view:
-    ui->dataTable->item(row, URL_COL)->setText(it[row].url);
-    ui->dataTable->item(row, DESC_COL)->setText(it[row].name);
+    int row = selectedRow();
+    // Modifying data (and updating the view):
+    Stream edited(ui->urlEdit->text(), ui->nameEdit->text());
+    undo_stack_->push(new EditStreamCommand(model_, row, edited));
     // Disabling confirm-edit button:
     ui->saveEdit->setEnabled(false);
-    setChangesMade();
 
 }
 
@@ -340,32 +668,137 @@ void MainWindow::on_saveEdit_clicked()
 void MainWindow::on_insertNew_clicked()
 {
     InsertDialog i(this);
+    i.setParser(this->parser_);
     int res = i.exec();
     if (res == QDialog::Accepted ) {
         Stream ns (i.getUrl(), i.getName());
-        this->parser_->insertStream(ns);
+        undo_stack_->push(new InsertStreamCommand(model_, ns));
+    }
+}
+
+
+void MainWindow::on_remove_clicked()
+{ // PRE: At least a row is selected.
 
-        // Creating table item:
-        QTableWidgetItem* url_i     = new QTableWidgetItem(ns.url);
-        QTableWidgetItem* name_i    = new QTableWidgetItem(ns.name);
+    undo_stack_->push(new RemoveStreamsCommand(model_, selectedRows(), tr("Remove entries")));
+}
+
+
+void MainWindow::on_actionSortByName_triggered()
+{
+    sortStreams(Parser::SortByName, tr("name"));
+}
 
-        // Inserting into table:
-        int row = ui->dataTable->rowCount();
-        ui->dataTable->insertRow(row);
-        ui->dataTable->setItem(row, URL_COL, url_i);
-        ui->dataTable->setItem(row, DESC_COL, name_i);
-        this->setChangesMade();
+
+void MainWindow::on_actionSortByUrl_triggered()
+{
+    sortStreams(Parser::SortByUrl, tr("URL"));
+}
+
+
+void MainWindow::on_actionSortByHost_triggered()
+{
+    sortStreams(Parser::SortByHost, tr("host"));
+}
+
+
+void MainWindow::on_actionSortByPrefix_triggered()
+{
+    sortStreams(Parser::SortByPrefix, tr("name prefix"));
+}
+
+
+void MainWindow::sortStreams(Parser::SortKey key, const QString& key_name)
+{
+/*
+The order is worked out on all cores, and applied as a single step of the
+history that the views get as one layout change (the selection follows the
+entries).
+*/
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    const QVector<int> order = parser_->sortOrder(key);
+    QApplication::restoreOverrideCursor();
+
+    int moved = 0;
+    for (int i = 0; i < order.size(); i++) {
+        moved += (order.at(i) != i) ? 1 : 0;
+    }
+    if (moved == 0) {
+        ui->statusBar->showMessage(QString(tr("The entries are already sorted by "))+key_name+".");
+        return;
     }
+
+    undo_stack_->push(new SortStreamsCommand(model_, order, tr("Sort by ")+key_name));
+    ui->statusBar->showMessage(QString(tr("Sorted by "))+key_name+QString(tr(": "))+
+                               QString::number(moved)+QString(tr(" entries moved.")));
 }
 
 
-void MainWindow::on_remove_clicked()
-{ // PRE: A row is selected.
+void MainWindow::on_actionRemoveDuplicates_triggered()
+{
+    QList<int> duplicates = parser_->duplicateRows();
+    int removed = duplicates.size();
+    if (removed > 0) {
+        undo_stack_->push(new RemoveStreamsCommand(model_, duplicates, tr("Remove duplicates")));
+    }
+    ui->statusBar->showMessage(QString(tr("Removed "))+QString::number(removed)+QString(tr(" duplicate URLs.")));
+}
 
-    QTableWidgetSelectionRange selected = ui->dataTable->selectedRanges().first();
-    int row = selected.topRow();
 
-    this->parser_->deleteStream(row);
-    ui->dataTable->removeRow(row);
-    setChangesMade();
+void MainWindow::on_searchEdit_textChanged(const QString& text)
+{
+    filter_->setSearchText(text);
+    if (!text.isEmpty()) {
+        ui->statusBar->showMessage(QString::number(filter_->matchCount())+QString(tr(" matching URLs.")));
+    }
+    else {
+        ui->statusBar->clearMessage();
+    }
+}
+
+
+void MainWindow::on_actionCheckStreams_triggered()
+{
+    // Several selected entries: only those. Otherwise, the whole list.
+    QStringList urls;
+    QList<int> rows = selectedRows();
+    if (rows.size() > 1) {
+        foreach (int row, rows) {
+            urls.append(parser_->urlAt(row).toString());
+        }
+    }
+    else {
+        urls.reserve(parser_->streamCount());
+        for (int row = 0; row < parser_->streamCount(); row++) {
+            urls.append(parser_->urlAt(row).toString());
+        }
+    }
+
+    // Cached results come back (and may finish the check) right away.
+    checker_->check(urls);
+    ui->actionStopChecking->setEnabled(checker_->isRunning());
+}
+
+
+void MainWindow::on_actionStopChecking_triggered()
+{
+    const int done = checks_done_;
+    checker_->cancel();
+    ui->statusBar->showMessage(QString(tr("Checking stopped after "))+QString::number(done)+QString(tr(" URLs.")));
+}
+
+
+void MainWindow::streamChecked()
+{
+    checks_done_++;
+    ui->statusBar->showMessage(QString(tr("Checked "))+QString::number(checks_done_)+QString(tr(" URLs, "))+
+                               QString::number(checker_->pendingCount())+QString(tr(" left.")));
+}
+
+
+void MainWindow::checkFinished()
+{
+    ui->statusBar->showMessage(QString(tr("Checked "))+QString::number(checks_done_)+QString(tr(" URLs.")));
+    checks_done_ = 0;
+    ui->actionStopChecking->setEnabled(false);
 }
@@ -2,6 +2,7 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QApplication>
 #include <QFileDialog>
 #include <QString>
 #include <QLabel>
@@ -9,10 +10,25 @@
 #include <QDesktopWidget>
 #include <QMessageBox>
 #include <QCloseEvent>
+#include <QHeaderView>
+#include <QProgressBar>
+#include <QToolButton>
+#include <QUndoStack>
+#include <QInputDialog>
+#include <QFileSystemWatcher>
+#include <QPushButton>
+#include <QTimer>
 
 #include "aboutdialog.h"
+#include "diagnosticsdialog.h"
 #include "insertdialog.h"
 #include "parser.h"
+#include "streamtablemodel.h"
+#include "streamfiltermodel.h"
+#include "streamloader.h"
+#include "streamcommands.h"
+#include "streamchecker.h"
+#include "streammerger.h"
 
 namespace Ui {
 class MainWindow;
@@ -29,9 +45,11 @@ public:
 private slots:
     void on_actionAbout_triggered();
 
+    void on_actionDiagnostics_triggered();
+
     void on_actionOpen_triggered();
 
-    void on_dataTable_itemSelectionChanged();
+    void dataTableSelectionChanged();
 
     void resizeEvent(QResizeEvent *);
 
@@ -43,6 +61,16 @@ private slots:
 
     void on_actionSave_As_triggered();
 
+    void on_actionMergeFiles_triggered();
+
+    void on_actionSortByName_triggered();
+
+    void on_actionSortByUrl_triggered();
+
+    void on_actionSortByHost_triggered();
+
+    void on_actionSortByPrefix_triggered();
+
     void entryEdited();
 
     void closeEvent(QCloseEvent*);
@@ -53,25 +81,78 @@ private slots:
 
     void on_remove_clicked();
 
+    void on_actionCancelLoading_triggered();
+
+    void on_actionRemoveDuplicates_triggered();
+
+    void on_searchEdit_textChanged(const QString&);
+
+    void on_actionCheckStreams_triggered();
+
+    void on_actionStopChecking_triggered();
+
+    void streamChecked();
+
+    void checkFinished();
+
+    void dropRequested(const QList<int>&, int);
+
+    void undoCleanChanged(bool);
+
+    void loadBatchReady(const ParsedBlock&);
+
+    void loadProgress(qint64, qint64);
+
+    void loadFinished(bool);
+
+    void fileChangedOnDisk(const QString&);
+
+    void reloadChangedFile();
+
 
 private:
     Ui::MainWindow *ui;
     Parser* parser_;
+    StreamTableModel* model_;
+    // What the table shows: the entries matching the search box.
+    StreamFilterModel* filter_;
+    StreamLoader* loader_;
+    StreamChecker* checker_;
+    int checks_done_;
+    // Every edit of the entries goes through here, so it can be undone.
+    QUndoStack* undo_stack_;
+    // Notices other programs (the game, among them) rewriting the file, which
+    // is read again once it has been quiet for a moment.
+    QFileSystemWatcher* watcher_;
+    QTimer* reload_timer_;
+    bool reloading_;
+    // The entries as the file has them (as of the last read or save): the
+    // base of the merge when the file changes while there are local edits.
+    StreamList saved_streams_;
 
     // Right-hand side message.
     QLabel* status_message;
+    // Shown while a file is being loaded.
+    QProgressBar* load_progress_;
+    QToolButton* cancel_load_;
     // Last directory from which a file was opened/saved.
     QDir last_directory_;
     // Currently opened file.
     QString opened_file_;
 
     bool changes_made_;
+    // Whether loading the opened file was cancelled.
+    bool partial_load_;
 
     void setChangesMade();
     void clearChangesMade();
     int saveChangesPrompt();
-    enum ColumnInfo {DESC_COL=0, URL_COL=1};
-    void swapItems(unsigned int, unsigned int);
+    bool saveOpenedFile();      // False if it was not saved (declined or failed).
+    int selectedRow() const;
+    QList<int> selectedRows() const;
+    void reloadFromDisk(const Parser&);
+    void sortStreams(Parser::SortKey, const QString& key_name);
+    void moveItems(const QList<int>&, int);
 
 };
 
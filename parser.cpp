@@ -1,10 +1,261 @@
 #include "parser.h"
+#include "linescanner.h"
+#include "profiler.h"
+#include "siibinary.h"
+#include "streamcache.h"
+#include "streamsorter.h"
 
-Parser::Parser(const QString& filename):
-filename_(filename)
+#include <QFileInfo>
+#include <QSet>
+#include <QSaveFile>
+#include <QThread>
+#include <QThreadPool>
+#include <QVarLengthArray>
+#include <QtConcurrent>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+static inline char toLowerAscii(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? char(c | 0x20) : c;
+}
+
+// Case-insensitive search of an ASCII, lower-case needle inside [begin, end).
+// Only letters are folded: '_' | 0x20 would be DEL.
+static bool containsNoCase(const char* begin, const char* end, const char* needle)
+{
+    const qptrdiff needle_length = qstrlen(needle);
+    for (const char* p = begin; end - p >= needle_length; p++) {
+        qptrdiff i = 0;
+        while (i < needle_length && toLowerAscii(p[i]) == needle[i]) {
+            i++;
+        }
+        if (i == needle_length) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Lookup tables for the .sii string codec.
+struct CodecTables {
+    signed char hex_value[256];     // -1 for characters that are not hex digits.
+    unsigned char utf8_length[256]; // Sequence length given its lead byte, 0 if invalid.
+
+    CodecTables()
+    {
+        for (int c = 0; c < 256; c++) {
+            hex_value[c] = -1;
+            if (c < 0x80)       utf8_length[c] = 1;
+            else if (c < 0xC2)  utf8_length[c] = 0; // Continuation bytes or overlong leads.
+            else if (c < 0xE0)  utf8_length[c] = 2;
+            else if (c < 0xF0)  utf8_length[c] = 3;
+            else if (c < 0xF5)  utf8_length[c] = 4;
+            else                utf8_length[c] = 0;
+        }
+        for (int c = 0; c < 10; c++) {
+            hex_value['0' + c] = c;
+        }
+        for (int c = 0; c < 6; c++) {
+            hex_value['a' + c] = 10 + c;
+            hex_value['A' + c] = 10 + c;
+        }
+    }
+};
+
+static const CodecTables kCodecTables;
+
+// Number of "\xNN" escapes in [p, end). Only used for profiling.
+static inline qint64 countEscapes(const char* p, const char* end)
+{
+    qint64 n = 0;
+    for (; end - p >= 4; p++) {
+        if (p[0] == '\\' && p[1] == 'x') {
+            n++;
+            p += 3;
+        }
+    }
+    return n;
+}
+
+// Whether a node of a document is the stream_data array (its items or their
+// number).
+static bool isStreamData(const SiiDocument& document, int n)
+{
+    const SiiDocument::Node& node = document.node(n);
+    return node.type == SiiDocument::AttributeNode && node.key_length == 11 &&
+           memcmp(document.text().constData() + node.key, "stream_data", 11) == 0;
+}
+
+// Line terminator of the files we write (QIODevice::Text used to add the '\r').
+#ifdef Q_OS_WIN
+static const char kNewline[] = "\r\n";
+#else
+static const char kNewline[] = "\n";
+#endif
+static const char kHexDigits[] = "0123456789abcdef";
+
+
+// Reads the next byte of a string, decoding "\xNN" escapes if unescape is set.
+static inline uint nextByte(const char*& p, const char* end, bool unescape)
+{
+    if (unescape && *p == '\\' && end - p >= 4 && p[1] == 'x') {
+        const int high  = kCodecTables.hex_value[uchar(p[2])];
+        const int low   = kCodecTables.hex_value[uchar(p[3])];
+        if ((high | low) >= 0) {
+            p += 4;
+            return uint((high << 4) | low);
+        }
+    }
+    return uchar(*p++);
+}
+
+// Decodes the (escaped, if unescape is set) UTF-8 string in [p, end) into
+// UTF-16 code units. At most one code unit is written per input byte.
+static ushort* decodeString(const char* p, const char* end, ushort* out, bool unescape)
+{
+    while (p < end) {
+        if (uchar(*p) < 0x80 && (*p != '\\' || !unescape)) { // Plain ASCII.
+            *out++ = uchar(*p++);
+            continue;
+        }
+
+        uint c = nextByte(p, end, unescape);
+        const int length = kCodecTables.utf8_length[c];
+        if (length <= 1) {  // ASCII (or a lone backslash) / invalid lead byte.
+            *out++ = ushort(length == 1 ? c : 0xFFFD);
+            continue;
+        }
+
+        c &= 0x7F >> length;
+        int i = 1;
+        for (; i < length && p < end; i++) {
+            const char* before = p;
+            const uint b = nextByte(p, end, unescape);
+            if ((b & 0xC0) != 0x80) {   // Not a continuation byte: truncated sequence.
+                p = before;
+                break;
+            }
+            c = (c << 6) | (b & 0x3F);
+        }
+
+        static const uint kMinimum[] = {0, 0, 0x80, 0x800, 0x10000};
+        if (i < length || c < kMinimum[length] || c > 0x10FFFF || (c >= 0xD800 && c < 0xE000)) {
+            *out++ = 0xFFFD;
+        }
+        else if (c >= 0x10000) {    // Surrogate pair.
+            *out++ = ushort(0xD800 + ((c - 0x10000) >> 10));
+            *out++ = ushort(0xDC00 + ((c - 0x10000) & 0x3FF));
+        }
+        else {
+            *out++ = ushort(c);
+        }
+    }
+    return out;
+}
+
+// Encodes the UTF-16 code units in [p, end) as UTF-8, escaping every
+// non-ASCII byte if escape is set.
+static char* encodeString(const ushort* p, const ushort* end, char* out, bool escape)
+{
+    while (p < end) {
+        uint c = *p++;
+        if (c < 0x80) {
+            *out++ = char(c);
+            continue;
+        }
+
+        if (c >= 0xD800 && c < 0xDC00 && p < end && *p >= 0xDC00 && *p < 0xE000) {
+            c = 0x10000 + ((c - 0xD800) << 10) + (*p++ - 0xDC00);
+        }
+        else if (c >= 0xD800 && c < 0xE000) {  // Unpaired surrogate.
+            c = 0xFFFD;
+        }
+
+        uchar bytes[4];
+        int length;
+        if (c < 0x800) {
+            bytes[0] = uchar(0xC0 | (c >> 6));
+            length = 2;
+        }
+        else if (c < 0x10000) {
+            bytes[0] = uchar(0xE0 | (c >> 12));
+            bytes[1] = uchar(0x80 | ((c >> 6) & 0x3F));
+            length = 3;
+        }
+        else {
+            bytes[0] = uchar(0xF0 | (c >> 18));
+            bytes[1] = uchar(0x80 | ((c >> 12) & 0x3F));
+            bytes[2] = uchar(0x80 | ((c >> 6) & 0x3F));
+            length = 4;
+        }
+        bytes[length - 1] = uchar(0x80 | (c & 0x3F));
+
+        if (!escape) {
+            memcpy(out, bytes, length);
+            out += length;
+            continue;
+        }
+
+        for (int i = 0; i < length; i++) {
+            out[0] = '\\';
+            out[1] = 'x';
+            out[2] = kHexDigits[bytes[i] >> 4];
+            out[3] = kHexDigits[bytes[i] & 0x0F];
+            out += 4;
+        }
+    }
+    return out;
+}
+
+// Whether an entry whose URL and name were decoded from the text in [raw, end)
+// (URL, '|' and escaped name) would be written back as the same bytes.
+static bool writesBack(const char* raw, const char* end, const ushort* url, int url_length, int name_length)
+{
+    QVarLengthArray<char, 1024> out(url_length * 3 + 1 + name_length * Parser::kMaxEscapedLength);
+    char* p = encodeString(url, url + url_length, out.data(), false);
+    *p++ = '|';
+    p = encodeString(url + url_length, url + url_length + name_length, p, true);
+    return p - out.data() == end - raw && memcmp(out.data(), raw, end - raw) == 0;
+}
+
+
+Parser::Parser(const QString& filename, ReadMode mode, int threads):
+filename_(filename),
+first_dirty_(0),
+offsets_valid_(false),
+file_size_(-1),
+url_index_valid_(false)
 {
     // Populating the list...
-    readStreams();
+    if (mode == TextStreamReader) {
+        readStreams();
+    }
+    else if (mode == ParallelReader) {
+        readStreamsMapped(threads > 0 ? threads : QThread::idealThreadCount());
+    }
+    else if (mode == DeferredReader) {
+        // The blocks will come from the file as it is now.
+        QFile file(filename_);
+        if (file.open(QIODevice::ReadOnly)) {
+            recordFileStamp(file);
+            offsets_valid_ = true;
+        }
+    }
+    else if (mode == CachedReader) {
+        if (!loadCache()) {
+            readStreamsMapped(threads > 0 ? threads : QThread::idealThreadCount());
+            writeCache();
+        }
+    }
+    else if (mode == ValidatingReader) {
+        readStreamsValidated();
+    }
+    else {
+        readStreamsMapped(1);
+    }
 }
 
 void Parser::readStreams()
@@ -17,18 +268,30 @@ corresponding descriptions, into a memory structure (a list).
 Example entry:
     stream_data[1]: "http://pub1.sky.fm/sky_cafedeparis|SKY.FM - Café de Paris"
 */
+  ETS_PROFILE_SCOPE("Parser::readStreams");
+
   // Opening file:
   QFile file(filename_);
   if (!file.open(QIODevice::ReadOnly|QIODevice::Text)){
       return;
   }
 
+  // Binary files have no lines to read.
+  const QByteArray magic = file.peek(4);
+  if (isBinary(magic.constData(), magic.constData() + magic.size())) {
+      file.close();
+      readStreamsMapped(1);
+      return;
+  }
+
   QTextStream in(&file);
   in.setCodec("UTF-8");
+  ETS_PROFILE_COUNT("bytes read", file.size());
 
   // Scanning and adding entries to list:
   while (!in.atEnd()) {
     QString l = in.readLine();
+    ETS_PROFILE_COUNT("lines scanned", 1);
 
     // Save the definition line (just in case it can't be an arbitrary name).
     if (l.contains("live_stream_def", Qt::CaseInsensitive)) {
@@ -40,6 +303,9 @@ Example entry:
     if (first_quote != -1) {    // Is it a stream_data[] definition?
         int last_quote          = l.lastIndexOf('"');
         int separator           = l.indexOf('|');
+        if (separator < first_quote || separator > last_quote) {
+            continue;   // No separator between the quotes (or no closing quote).
+        }
 
         QString url             = l.mid(first_quote+1, separator-first_quote-1);
         QString name            = unescapeString(l.mid(separator+1, last_quote-separator-1));
@@ -51,76 +317,463 @@ Example entry:
     file.close();
 }
 
-QString Parser::unescapeString(const QString& str) const {
-/* This function looks for and unescapes unicode characters encoded like string literals.
-For example: "Rádio" appears as "R\xc3\xa1dio" in the .sii file.
+void Parser::readStreamsMapped(int threads)
+{
+/*
+Same as readStreams(), but instead of decoding the whole file line by line it
+maps it into memory and parses the raw UTF-8 bytes as a document (see
+siidocument.h), which takes a single pass over them. QStrings are only created
+for the URL and name of each entry.
+If the file cannot be mapped (for example, it is not a regular file), its
+contents are read into a buffer and parsed the same way.
+
+With more than one thread, the entries are cut into chunks that are decoded
+concurrently into their own lists. These are concatenated in file order, so
+the result is identical to the sequential one. Files that are not valid
+documents are read line by line, in chunks of the file, the same way.
 */
-    QString res;
-    int i = 0;
-    while (i < str.length()) {
-        if (str[i] == '\\') { // Found an escape character.
-            // Reading the character's 2 bytes after "\x".
-            // In the string they are represented by 8 characters ("\xh1h0\xl1l0").
-            QString high    = str.mid(i+2, 2);  // High byte: "c3"
-            QString low     = str.mid(i+6, 2);  // Low byte: "a1"
-            i = i + 8;
-
-            QString code_str(high);             // Raw bytes as a string.
-            code_str.append(low);
-
-            // Decoding the bytes and getting the codepoint.
-            // For example: codepoint('á') == 0xE1.
-            QChar c(getCodePoint(code_str.toInt(NULL, 16)));
-            res.append(c);
+    ETS_PROFILE_SCOPE("Parser::readStreamsMapped");
+
+    QFile file(filename_);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    const qint64 size = file.size();
+    if (size <= 0) {
+        recordFileStamp(file);
+        return;
+    }
+
+    QByteArray buffer;
+    const char* file_begin = reinterpret_cast<const char*>(file.map(0, size));
+    if (file_begin == NULL) {
+        buffer = file.readAll();
+        file_begin = buffer.constData();
+    }
+    const char* data = file_begin;
+    const char* end = file_begin + (buffer.isNull() ? size : buffer.size());
+    recordFileStamp(file);
+    ETS_PROFILE_COUNT("bytes read", end - file_begin);
+
+    if (isBinary(file_begin, end)) {
+        appendBlock(parseBinary(file_begin, end));
+        file.close();
+        return;
+    }
+    offsets_valid_ = true;
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    QList< QFuture<ParsedBlock> > results;
+
+    SiiDocument document;
+    if (end - file_begin <= INT_MAX &&
+        document.parse(QByteArray::fromRawData(file_begin, int(end - file_begin)))) {
+        // A few chunks per thread, so that a slow one does not keep the
+        // others waiting.
+        static const int kMinChunkEntries = 1 << 14;
+        const QVector<int> entries = entryNodes(document);
+        const int chunks = qBound(1, entries.size() / kMinChunkEntries, threads * 4);
+
+        if (threads <= 1 || chunks == 1) {
+            appendBlock(parseEntries(document, entries, 0, entries.size()));
+            file.close(); // Also unmaps the file.
+            return;
         }
-        else {
-            res.append(str[i]);
-            i++;
+        for (int i = 0; i < chunks; i++) {
+            results.append(QtConcurrent::run(&pool, &Parser::parseEntries, document, entries,
+                                             int(qint64(entries.size()) * i / chunks),
+                                             int(qint64(entries.size()) * (i + 1) / chunks)));
         }
     }
+    else {
+        // Skipping the UTF-8 BOM, if any (QTextStream does the same).
+        if (end - data >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+            data += 3;
+        }
 
-    return res;
+        // Splitting into chunks of at least kMinChunkSize bytes.
+        static const qint64 kMinChunkSize = 1 << 20;
+        const qint64 chunks = qBound(qint64(1), (end - data) / kMinChunkSize, qint64(threads) * 4);
+
+        if (threads <= 1 || chunks == 1) {
+            appendBlock(parseBlock(file_begin, data, end));
+            file.close();
+            return;
+        }
+
+        const qint64 chunk_size = (end - data) / chunks;
+        const char* chunk = data;
+        while (chunk < end) {
+            const char* chunk_end = end;
+            if (end - chunk > chunk_size) {
+                chunk_end = static_cast<const char*>(memchr(chunk + chunk_size, '\n', end - chunk - chunk_size));
+                chunk_end = chunk_end ? chunk_end + 1 : end;
+            }
+            results.append(QtConcurrent::run(&pool, &Parser::parseBlock, file_begin, chunk, chunk_end));
+            chunk = chunk_end;
+        }
+    }
+
+    // Collecting the chunks in file order.
+    for (int i = 0; i < results.size(); i++) {
+        appendBlock(results[i].result());
+    }
+    file.close();
+}
+
+void Parser::readStreamsValidated()
+{
+/*
+The validator goes through the file on its own (it checks lines, while the
+reader parses a document), and the file is then read like with MappedReader.
+*/
+    ETS_PROFILE_SCOPE("Parser::readStreamsValidated");
+
+    StreamValidator validator;
+    if (validator.checkFile(filename_)) {
+        diagnostics_ = validator.diagnostics();
+        readStreamsMapped(1);
+    }
 }
 
-QString Parser::escapeString(const QString& str) const {
-    QString res;
+void Parser::appendBlock(const ParsedBlock& block)
+{
+    // New entries come straight from the file, so they are not dirty (unless
+    // something before them already is).
+    const bool clean = (first_dirty_ >= streams_.size());
+    url_index_valid_ = false;
+    streams_.append(block.streams);
+    entry_offsets_ += block.offsets;
+    if (clean) {
+        first_dirty_ = streams_.size();
+    }
+    if (!block.live_stream_def_line.isNull()) {
+        live_stream_def_line_ = block.live_stream_def_line;
+    }
+    if (!block.error.isEmpty()) {
+        error_ = block.error;
+    }
+    if (!block.skeleton.isEmpty()) {
+        // Delta saves rewrite the file from an entry on, followed by the end
+        // of the skeleton. That is only what the file had after its entries
+        // if nothing else was between them.
+        skeleton_ = block.skeleton;
+        if (skeleton_.hasMovedText()) {
+            offsets_valid_ = false;
+        }
+    }
+}
+
+bool Parser::loadCache()
+{
+    ETS_PROFILE_SCOPE("Parser::loadCache");
+
+    ParsedBlock block;
+    if (!StreamCache::read(filename_, block)) {
+        return false;
+    }
+
+    streams_.clear();
+    entry_offsets_.clear();
+    live_stream_def_line_.clear();
+    skeleton_ = SiiDocument();
+    error_.clear();
+    first_dirty_ = 0;
+    appendBlock(block);
+
+    // The cache matched the file, so the offsets are good for delta saves.
+    QFile file(filename_);
+    recordFileStamp(file);
+    offsets_valid_ = true;
+    return true;
+}
+
+bool Parser::writeCache() const
+{
+/*
+The cache must describe the file as it is on disk: there can be no unsaved
+changes, and the file must still be the one that was read or written last.
+*/
+    if (!offsets_valid_ || first_dirty_ < streams_.size() || entry_offsets_.size() != streams_.size()) {
+        return false;
+    }
+    if (fileChanged()) {
+        return false;
+    }
+
+    ParsedBlock block;
+    block.streams               = streams_;
+    block.offsets               = entry_offsets_;
+    block.live_stream_def_line  = live_stream_def_line_;
+    block.skeleton              = skeleton_;
+    return StreamCache::write(filename_, block);
+}
+
+int Parser::definitionBlock(const SiiDocument& document)
+{
+    return document.findBlock("live_stream_def");
+}
+
+QVector<int> Parser::entryNodes(const SiiDocument& document)
+{
+    QVector<int> entries;
+    const int definition = definitionBlock(document);
+    if (definition == -1) {
+        return entries;
+    }
+    foreach (int n, document.children(definition)) {
+        if (isStreamData(document, n) && document.node(n).index != SiiDocument::kNoIndex) {
+            entries.append(n);
+        }
+    }
+    return entries;
+}
+
+ParsedBlock Parser::parseEntries(const SiiDocument& document, const QVector<int>& nodes, int begin, int end)
+{
+/*
+Items that are not a quoted URL and name, with a '|' between them, are not
+entries, like the lines the other readers skip; they are left out of the
+skeleton all the same, and so are not written back.
+The skeleton also goes without the number of entries ("stream_data: n"),
+which saves write again before the entries.
+*/
+    ETS_PROFILE_SCOPE("Parser::parseEntries");
+
+    ParsedBlock block;
+    const char* text = document.text().constData();
+    for (int i = begin; i < end; i++) {
+        const SiiDocument::Node& node = document.node(nodes.at(i));
+        const char* url = text + node.value;
+        const char* separator = static_cast<const char*>(memchr(url, '|', node.value_length));
+        if (!node.quoted || separator == NULL) {
+            continue;
+        }
+        const char* value_end = url + node.value_length;
+        const bool escaped = memchr(separator, '\\', value_end - separator) != NULL;
+        parseEntry(block, node.begin, url, separator, value_end, escaped);
+    }
+    ETS_PROFILE_COUNT("entries parsed", block.streams.size());
 
-    for (int i = 0; i < str.length(); i++) {
-        if (str[i].unicode() > 127) { // Found a unicode character.
-            QByteArray ca;
-            ca.append(str[i]);
-            ca = ca.toHex();        // Now ca has the code in hexa. Ex: 0xC3A1
-            bool ok = false;
-            unsigned int code = ca.toUInt(&ok, 16);
-            if (!ok) {
+    const int definition = definitionBlock(document);
+    if (begin > 0 || definition == -1) {
+        return block;
+    }
+
+    const qint64 line = document.lineStart(document.node(definition).key);
+    block.live_stream_def_line = QString::fromUtf8(text + line, int(document.lineEnd(line) - line));
+
+    QVector<int> cut;
+    foreach (int n, document.children(definition)) {
+        if (isStreamData(document, n)) {
+            cut.append(n);
+        }
+    }
+    block.skeleton = document;
+    block.skeleton.cut(cut, definition);
+    return block;
+}
+
+ParsedBlock Parser::parseBlock(const char* file_begin, const char* begin, const char* end)
+{
+/*
+Scans the lines in [begin, end) and returns the stream_data entries found,
+along with the last definition line in the block (if any) and the position of
+each entry's line relative to file_begin.
+The block is processed in windows of about kScanWindow bytes: the LineScanner
+finds all quotes, separators and backslashes of a window in one pass, and the
+entries are then cut directly from its line table.
+
+Lines are handled like in readStreams(), except that only lines without
+quotes can be the definition line.
+*/
+    static const qptrdiff kScanWindow = 1 << 20;
+    ETS_PROFILE_SCOPE("Parser::parseBlock");
+
+    ParsedBlock block;
+    QVector<LineInfo> lines;
+    while (begin < end) {
+        // Extending the window up to the end of its last line.
+        const char* window_end = end;
+        if (end - begin > kScanWindow) {
+            window_end = static_cast<const char*>(memchr(begin + kScanWindow, '\n', end - begin - kScanWindow));
+            window_end = window_end ? window_end + 1 : end;
+        }
+
+        lines.clear();
+        LineScanner::scan(begin, window_end, lines);
+        ETS_PROFILE_COUNT("lines scanned", lines.size());
+
+        QVector<LineInfo>::const_iterator it = lines.constBegin();
+        for (; it != lines.constEnd(); it++) {
+            const char* line = begin + it->begin;
+
+            if (it->first_quote < 0) {
+                // Save the definition line (just in case it can't be an arbitrary name).
+                if (containsNoCase(line, line + it->length, "live_stream_def")) {
+                    block.live_stream_def_line = QString::fromUtf8(line, it->length);
+                }
                 continue;
             }
-            unsigned int high = (code & 0xFF00)>>8; // High = 0xC3.
-            unsigned int low = code & 0x00FF;       // Low = 0xA1.
-            QString high_str = QString::number(high, 16);   // Converting both parts into strings.
-            QString low_str = QString::number(low, 16);     // Format: "\xH1H0\xL1L0".
-            QString escaped = "\\x" + high_str + "\\x" + low_str;
 
-            res.append(escaped);
+            // Is it a stream_data[] definition?
+            if (it->separator > it->first_quote && it->separator < it->last_quote) {
+                parseEntry(block, line - file_begin, line + it->first_quote + 1, line + it->separator,
+                           line + it->last_quote, it->escaped);
+            }
+        }
+        begin = window_end;
+    }
+    ETS_PROFILE_COUNT("entries parsed", block.streams.size());
+    return block;
+}
+
+bool Parser::isBinary(const char* begin, const char* end)
+{
+    return SiiBinary::format(begin, end) != SiiBinary::TextFormat;
+}
+
+ParsedBlock Parser::parseBinary(const char* begin, const char* end)
+{
+/*
+ScsC files are decrypted and inflated in memory, never to disk, and what comes
+out is read like any other file: as a BSII file, or as text, which is parsed
+as a document (keeping its skeleton, as saves write text anyway).
+The items of a BSII file's stream_data are found in one pass over it, and
+decoded straight into the list's arena like the lines of text files are. Its
+strings are not escaped, and its units have no definition line: one is made
+from the unit's name.
+*/
+    ETS_PROFILE_SCOPE("Parser::parseBinary");
+
+    ParsedBlock block;
+    QByteArray contents;
+    if (SiiBinary::format(begin, end) == SiiBinary::EncryptedFormat) {
+        if (!SiiBinary::decrypt(begin, end, contents, block.error)) {
+            return block;
         }
-        else { // Regular, ASCII character.
-            res.append(str[i]);
+        begin = contents.constData();
+        end = begin + contents.size();
+    }
+
+    const SiiBinary::Format format = SiiBinary::format(begin, end);
+    if (format == SiiBinary::TextFormat) {
+        SiiDocument document;
+        if (document.parse(contents)) {
+            const QVector<int> entries = entryNodes(document);
+            block = parseEntries(document, entries, 0, entries.size());
+        }
+        else {
+            const char* data = begin;
+            if (end - data >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+                data += 3;
+            }
+            block = parseBlock(begin, data, end);
         }
+        block.offsets.clear();
+        return block;
+    }
+    if (format == SiiBinary::EncryptedFormat) {
+        block.error = "encrypted twice";
+        return block;
+    }
+
+    QByteArray unit_name;
+    QVector<SiiBinary::Span> items;
+    if (!SiiBinary::findStrings(begin, end, "live_stream_def", "stream_data", unit_name, items, block.error)) {
+        return block;
+    }
+    for (int i = 0; i < items.size(); i++) {
+        const char* url = items.at(i).begin;
+        const char* item_end = items.at(i).end;
+        const char* separator = static_cast<const char*>(memchr(url, '|', item_end - url));
+        if (separator == NULL) {
+            continue;   // Not an entry, as in text files.
+        }
+
+        ushort* text        = block.streams.reserveText(int(item_end - url));
+        ushort* name_text   = decodeString(url, separator, text, false);
+        ushort* text_end    = decodeString(separator + 1, item_end, name_text, false);
+        block.streams.commitEntry(int(name_text - text), int(text_end - name_text));
     }
+    ETS_PROFILE_COUNT("entries parsed", block.streams.size());
 
-   return res;
+    if (!unit_name.isNull()) {
+        block.live_stream_def_line = QString::fromLatin1("live_stream_def : " + unit_name + " {");
+    }
+    return block;
 }
 
-QChar Parser::getCodePoint(unsigned int word) const {
+void Parser::parseEntry(ParsedBlock& block, qint64 offset, const char* url, const char* separator,
+                        const char* end, bool escaped)
+{
+    const char* name = separator + 1;
+
+    // Decoding both fields straight into the list's arena.
+    ushort* text        = block.streams.reserveText(int(end - url));
+    ushort* name_text   = decodeString(url, separator, text, false);
+    ushort* text_end    = decodeString(name, end, name_text, escaped);
+    if (escaped) {
+        ETS_PROFILE_COUNT("escapes decoded", countEscapes(name, end));
+    }
+
+    // Plain ASCII text is always written back as it was; text with escapes or
+    // other bytes is kept if it would not be.
+    const int url_length    = int(name_text - text);
+    const int name_length   = int(text_end - name_text);
+    const bool original     = (escaped || text_end - text != end - url - 1) &&
+                              !writesBack(url, end, text, url_length, name_length);
+    block.streams.commitEntry(url_length, name_length);
+    if (original) {
+        block.streams.setOriginalText(block.streams.size() - 1, QByteArray(url, int(end - url)));
+    }
+    block.offsets.append(offset);
+}
+
+QString Parser::unescapeString(const char* data, int size)
+{
 /*
-Example: 0xC3A1 == (110)0 0000 (10)00 0000
-According to the UTF-8 standard, bits outside of () represent the character.
-The three most significant bits determine the length in bytes that need to be read.
+This function looks for and unescapes unicode characters encoded like string
+literals. For example: "Rádio" appears as "R\xc3\xa1dio" in the .sii file.
+The escaped bytes, as well as any raw non-ASCII bytes, are decoded as UTF-8
+sequences of any length; invalid sequences become U+FFFD.
+Every output character consumes at least one input byte, so the result is
+decoded straight into a buffer of the input's size.
 */
-    unsigned int high   = (word & 0x1F00);
-    unsigned int low    = (word & 0x003F);
+    ETS_PROFILE_COUNT("escapes decoded", countEscapes(data, data + size));
+    QString res(size, Qt::Uninitialized);
+    ushort* begin   = reinterpret_cast<ushort*>(res.data());
+    ushort* end     = decodeString(data, data + size, begin, true);
+    res.resize(int(end - begin));
+    return res;
+}
 
-    return (high>>2) | low ;
+QString Parser::unescapeString(const QString& str)
+{
+    const QByteArray utf8 = str.toUtf8();
+    return unescapeString(utf8.constData(), utf8.size());
+}
+
+QByteArray Parser::escapeString(const QString& str)
+{
+    QByteArray res(str.size() * kMaxEscapedLength, Qt::Uninitialized);
+    const char* end = escapeString(str, res.data());
+    res.resize(int(end - res.constData()));
+    return res;
+}
+
+char* Parser::escapeString(const QString& str, char* out)
+{
+/*
+Writes the escaped version of str to out and returns a pointer past the last
+character written. Non-ASCII characters are encoded as the "\xNN" escapes of
+their UTF-8 bytes. out must have room for kMaxEscapedLength bytes per
+character of str.
+*/
+    const ushort* begin = str.utf16();
+    return encodeString(begin, begin + str.size(), out, true);
 }
 
 StreamList::iterator Parser::streamsBegin()
@@ -155,9 +808,15 @@ void Parser::swapStreams(unsigned int a, unsigned int b)
     advance(it1, a);
     advance(it2, b);
     //swap(*it1, *it2);*/
-    Stream temp = streams_[a];
-    streams_[a] = streams_[b];
-    streams_[b] = temp;
+    if (a == b) {
+        return;     // Indexing the row twice would list it twice.
+    }
+    unindexUrl(a);
+    unindexUrl(b);
+    streams_.swap(a, b);
+    indexUrl(a);
+    indexUrl(b);
+    markDirty(qMin(a, b));
 }
 
 void Parser::deleteStream(unsigned int s)
@@ -166,53 +825,520 @@ void Parser::deleteStream(unsigned int s)
     advance(it, s);
     streams_.erase(it);*/
     streams_.removeAt(s);
+    url_index_valid_ = false;   // Rows after s moved.
+    markDirty(s);
+}
+
+const StreamList& Parser::streamList() const
+{
+    return streams_;
+}
+
+Stream Parser::streamAt(unsigned int s) const
+{
+    return streams_.at(s);
+}
+
+QStringRef Parser::urlAt(unsigned int s) const
+{
+    return streams_.url(s);
+}
+
+QStringRef Parser::nameAt(unsigned int s) const
+{
+    return streams_.name(s);
+}
+
+int Parser::streamCount() const
+{
+    return streams_.size();
+}
+
+void Parser::editStream(unsigned int s, const Stream& stream)
+{
+    unindexUrl(s);
+    streams_.replace(s, stream);
+    indexUrl(s);
+    markDirty(s);
+}
+
+QVector<int> Parser::sortOrder(SortKey key, int threads, SortKeyFunction custom) const
+{
+    return StreamSorter::order(streams_, key, threads, custom);
+}
+
+void Parser::sortStreams(SortKey key, int threads, SortKeyFunction custom)
+{
+/*
+Sorts a permutation of the rows instead of the entries themselves, and then
+applies it to the list in one go.
+*/
+    permuteStreams(sortOrder(key, threads, custom));
+}
+
+void Parser::permuteStreams(const QVector<int>& order)
+{
+    // Only the rows from the first one that moved are dirty.
+    int first_moved = 0;
+    while (first_moved < order.size() && order.at(first_moved) == first_moved) {
+        first_moved++;
+    }
+    if (first_moved == order.size()) {
+        return;
+    }
+
+    streams_.permute(order);
+    url_index_valid_ = false;
+    markDirty(first_moved);
+}
+
+int Parser::moveStreams(const QList<int>& rows, int target)
+{
+    int before_target = 0;
+    while (before_target < rows.size() && rows.at(before_target) < target) {
+        before_target++;
+    }
+    if (rows.isEmpty()) {
+        return target;
+    }
+
+    streams_.moveRows(rows, target);
+    url_index_valid_ = false;
+    markDirty(qMin(rows.first(), target));
+    return target - before_target;
+}
+
+void Parser::removeStreams(const QList<int>& rows)
+{
+    if (rows.isEmpty()) {
+        return;
+    }
+    streams_.removeRows(rows);
+    url_index_valid_ = false;
+    markDirty(rows.first());
+}
+
+void Parser::insertStreams(const QList<int>& rows, const QList<Stream>& streams)
+{
+    if (rows.isEmpty()) {
+        return;
+    }
+    streams_.insertRows(rows, streams);
+    url_index_valid_ = false;
+    markDirty(rows.first());
+}
+
+void Parser::appendStreams(const Parser& other)
+{
+    appendStreams(other.streams_);
+}
+
+void Parser::appendStreams(const StreamList& streams)
+{
+    markDirty(streams_.size());
+    streams_.append(streams);
+    url_index_valid_ = false;
+}
+
+QString Parser::fileName() const
+{
+    return filename_;
+}
+
+bool Parser::fileChanged() const
+{
+    // Our own saves record the new stamp, so they do not count.
+    const QFileInfo info(filename_);
+    return info.size() != file_size_ || info.lastModified() != file_modified_;
+}
+
+QString Parser::liveStreamDefLine() const
+{
+    return live_stream_def_line_;
+}
+
+void Parser::setLiveStreamDefLine(const QString& line)
+{
+    // It is part of the header, which only full saves write. In a skeleton,
+    // it replaces the line of the definition block; should that break the
+    // document, the usual header is written instead.
+    live_stream_def_line_ = line;
+    offsets_valid_ = false;
+
+    const int definition = definitionBlock(skeleton_);
+    if (definition != -1) {
+        const qint64 begin = skeleton_.lineStart(skeleton_.node(definition).key);
+        if (!skeleton_.replaceText(begin, skeleton_.lineEnd(begin), line.toUtf8())) {
+            skeleton_ = SiiDocument();
+        }
+    }
+}
+
+const QList<StreamDiagnostic>& Parser::diagnostics() const
+{
+    return diagnostics_;
+}
+
+QString Parser::errorString() const
+{
+    return error_;
+}
+
+void Parser::markDirty(unsigned int s)
+{
+    first_dirty_ = qMin(first_dirty_, int(s));
+}
+
+void Parser::recordFileStamp(const QFileDevice& file)
+{
+    const QFileInfo info(file.fileName());
+    file_size_      = info.size();
+    file_modified_  = info.lastModified();
 }
 
 bool Parser::saveStreams()
 {
+    if (canSaveDelta()) {
+        return this->saveDelta();
+    }
     return(this->saveStreams(filename_));
 }
 
+bool Parser::canSaveDelta() const
+{
+/*
+Only the entries from first_dirty_ onwards need to be rewritten if we know
+where each entry starts in the file, the number of entries (and therefore the
+header) did not change, and nobody else modified the file since we last read
+or wrote it.
+Delta saves write in place, so they are kept to small tails: past
+kMaxDeltaBytes, or 1/kMaxDeltaShare of the file (after a sort, or an edit of
+one of the first entries), the atomic full save is worth what it costs.
+*/
+    static const qint64 kMaxDeltaBytes = 1 << 20;
+    static const qint64 kMaxDeltaShare = 8;
+
+    if (!offsets_valid_ || entry_offsets_.size() != streams_.size()) {
+        return false;
+    }
+
+    if (fileChanged()) {
+        return false;
+    }
+
+    if (first_dirty_ < streams_.size()) {
+        const qint64 tail = file_size_ - entry_offsets_[first_dirty_];
+        if (tail > kMaxDeltaBytes || tail > file_size_ / kMaxDeltaShare) {
+            return false;
+        }
+    }
+
+    // The timestamp may be too coarse to notice a quick rewrite, so checking
+    // that the first dirty entry is still where we expect it.
+    if (first_dirty_ < streams_.size()) {
+        QFile file(filename_);
+        if (!file.open(QIODevice::ReadOnly) || !file.seek(entry_offsets_[first_dirty_])) {
+            return false;
+        }
+        const QByteArray line = file.readLine(64);
+        if (!line.trimmed().startsWith("stream_data[")) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Parser::saveDelta()
+{
+/*
+Rewrites the file from the line of the first dirty entry to its end (the
+entries, then the footer), leaving everything before it (header included)
+untouched.
+Unlike full saves this writes in place, so it is not atomic; it is only used
+for the small tails it was designed for.
+*/
+    ETS_PROFILE_SCOPE("Parser::saveDelta");
+
+    if (first_dirty_ >= streams_.size()) {
+        return true;    // Nothing changed since the file was read or written.
+    }
+
+    QFile file(filename_);
+    if (!file.open(QIODevice::ReadWrite) || !file.seek(entry_offsets_[first_dirty_])) {
+        return false;
+    }
+
+    const char* newline = lineBreak();
+    QByteArray buffer;
+    qint64 offset = entry_offsets_[first_dirty_];
+    for (int i = first_dirty_; i < streams_.size(); i++) {
+        entry_offsets_[i] = offset + buffer.size();
+        appendEntry(buffer, streams_, i, newline);
+    }
+    appendFooter(buffer);
+
+    if (file.write(buffer) != buffer.size() || !file.resize(offset + buffer.size())) {
+        offsets_valid_ = false; // We do not know what the file looks like anymore.
+        return false;
+    }
+    file.close();
+    ETS_PROFILE_COUNT("bytes written", buffer.size());
+
+    recordFileStamp(file);
+    first_dirty_ = streams_.size();
+    return true;
+}
+
 bool Parser::saveStreams(const QString& filename)
 {
 /*
 This function saves the current information contained in the streams_ list in
 the .sii format. It overwrites the previous contents.
+
+The output is formatted into a buffer that is written every kWriteChunk bytes,
+and goes through a QSaveFile: the previous file is only replaced once
+everything has been written, so a failed save leaves it untouched.
 */
-    QFile file(filename);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+    static const int kWriteChunk = 1 << 20;
+    ETS_PROFILE_SCOPE("Parser::saveStreams");
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
         return false;
     }
 
-    QTextStream out(&file);
-    out.setCodec("ASCII");
+    // Entry positions are only kept for the file we are bound to.
+    const bool own_file = (QFileInfo(filename) == QFileInfo(filename_));
+    QVector<qint64> offsets;
+    qint64 written = 0;
+
+    const char* newline = lineBreak();
+    QByteArray buffer;
+    buffer.reserve(kWriteChunk + kWriteChunk / 4);
 
-    // Header
-    out << "SiiNunit" << endl;
-    out << "{" << endl;
-        out << live_stream_def_line_ << endl;
-        out << " stream_data: " << streams_.size() << endl;
-    // /Header
+    appendHeader(buffer);
 
     // Items (stream_data[n]: "http://.com|Name")
-    unsigned int i = 0;
-    StreamList::const_iterator it = this->streams_.begin();
-    for (; it != streams_.end(); it++) {
-        out << " stream_data[" << i++ << "]: ";
-        out << '\"' << it->url << "|" << escapeString(it->name) << '\"';
-        out << endl;
+    for (int i = 0; i < streams_.size(); i++) {
+        if (own_file) {
+            offsets.append(written + buffer.size());
+        }
+        appendEntry(buffer, streams_, i, newline);
+
+        if (buffer.size() >= kWriteChunk) {
+            if (file.write(buffer) != buffer.size()) {
+                return false;   // QSaveFile discards everything.
+            }
+            written += buffer.size();
+            buffer.resize(0);   // Keeps the allocated capacity.
+        }
     }
     // /Items
 
-    // Close
-        out << "}" << endl;
-    out << "}" << endl;
+    appendFooter(buffer);
 
-    file.close();
+    if (file.write(buffer) != buffer.size() || !file.commit()) {
+        return false;
+    }
+    ETS_PROFILE_COUNT("bytes written", written + buffer.size());
+
+    if (own_file) {
+        entry_offsets_  = offsets;
+        offsets_valid_  = true;
+        first_dirty_    = streams_.size();
+        recordFileStamp(file);
+    }
     return true;
 }
 
+void Parser::appendHeader(QByteArray& out) const
+{
+/*
+Everything before the entries: the part of the skeleton before its insertion
+point, if the file had one, or else the usual header. Either way, the number
+of entries comes last.
+*/
+    const qint64 insertion_point = skeleton_.insertionPoint();
+    if (insertion_point >= 0) {
+        out.append(skeleton_.text().constData(), int(insertion_point));
+    }
+    else {
+        out.append("SiiNunit").append(kNewline);
+        out.append("{").append(kNewline);
+        out.append(live_stream_def_line_.toUtf8()).append(kNewline);
+    }
+    out.append(" stream_data: ");
+    appendNumber(out, streams_.size());
+    out.append(lineBreak());
+}
+
+void Parser::appendFooter(QByteArray& out) const
+{
+    const qint64 insertion_point = skeleton_.insertionPoint();
+    if (insertion_point >= 0) {
+        const QByteArray& text = skeleton_.text();
+        out.append(text.constData() + insertion_point, text.size() - int(insertion_point));
+    }
+    else {
+        out.append("}").append(kNewline);
+        out.append("}").append(kNewline);
+    }
+}
+
+const char* Parser::lineBreak() const
+{
+    // The one the file was read with, so that what is written around the
+    // skeleton matches it; ours for files without one.
+    const QByteArray& text = skeleton_.text();
+    const int line_end = text.indexOf('\n');
+    if (line_end == -1) {
+        return kNewline;
+    }
+    return (line_end > 0 && text.at(line_end - 1) == '\r') ? "\r\n" : "\n";
+}
+
+void Parser::appendNumber(QByteArray& out, unsigned int n)
+{
+    char digits[10];
+    int i = sizeof(digits);
+    do {
+        digits[--i] = char('0' + n % 10);
+        n /= 10;
+    } while (n != 0);
+    out.append(digits + i, int(sizeof(digits)) - i);
+}
+
+void Parser::appendEntry(QByteArray& out, const StreamList& streams, int row, const char* newline)
+{
+    out.append(" stream_data[");
+    appendNumber(out, row);
+    out.append("]: \"");
+    const QByteArray original = streams.originalText(row);
+    if (!original.isNull()) {
+        out.append(original);   // Byte for byte as it was read.
+    }
+    else {
+        appendText(out, streams.url(row), false);
+        out.append('|');
+        appendText(out, streams.name(row), true);
+    }
+    out.append('"').append(newline);
+}
+
+void Parser::appendText(QByteArray& out, const QStringRef& text, bool escape)
+{
+    // Encoding in place, right at the end of the buffer.
+    const int size = out.size();
+    out.resize(size + text.size() * (escape ? kMaxEscapedLength : 3));
+
+    const ushort* begin = reinterpret_cast<const ushort*>(text.unicode());
+    const char* end = encodeString(begin, begin + text.size(), out.data() + size, escape);
+    out.resize(int(end - out.constData()));
+}
+
 void Parser::insertStream(const Stream& s)
 {
+    markDirty(streams_.size());
     this->streams_.push_back(s);
+    indexUrl(streams_.size() - 1);
+}
+
+int Parser::findUrl(const QString& url) const
+{
+/*
+Looks the URL up in the index. Entries that only share the hash are told
+apart by comparing their normalized URLs.
+*/
+    buildUrlIndex();
+
+    const QString normalized = normalizeUrl(url);
+    const uint hash = qHash(normalized);
+    int first = -1;
+    QMultiHash<uint, int>::const_iterator it = url_index_.constFind(hash);
+    for (; it != url_index_.constEnd() && it.key() == hash; it++) {
+        if ((first == -1 || it.value() < first) &&
+            streams_.urlParts(it.value()).normalized == normalized) {
+            first = it.value();
+        }
+    }
+    return first;
+}
+
+QList<int> Parser::urlRows(const QString& url) const
+{
+    buildUrlIndex();
+
+    const QString normalized = normalizeUrl(url);
+    const uint hash = qHash(normalized);
+    QList<int> rows;
+    QMultiHash<uint, int>::const_iterator it = url_index_.constFind(hash);
+    for (; it != url_index_.constEnd() && it.key() == hash; it++) {
+        if (streams_.urlParts(it.value()).normalized == normalized) {
+            rows.append(it.value());
+        }
+    }
+    std::sort(rows.begin(), rows.end());
+    return rows;
+}
+
+QList<int> Parser::duplicateRows() const
+{
+    QList<int> duplicates;
+    QSet<QString> seen;
+    seen.reserve(streams_.size());
+    for (int i = 0; i < streams_.size(); i++) {
+        const QString& normalized = streams_.urlParts(i).normalized;
+        if (seen.contains(normalized)) {
+            duplicates.append(i);
+        }
+        else {
+            seen.insert(normalized);
+        }
+    }
+    return duplicates;
+}
+
+int Parser::removeDuplicates()
+{
+    const QList<int> duplicates = duplicateRows();
+    removeStreams(duplicates);
+    return duplicates.size();
+}
+
+QString Parser::normalizeUrl(const QString& url)
+{
+    return StreamUrl::normalize(url);
+}
+
+const StreamUrl& Parser::urlPartsAt(unsigned int s) const
+{
+    return streams_.urlParts(s);
+}
+
+void Parser::buildUrlIndex() const
+{
+    if (url_index_valid_) {
+        return;
+    }
+
+    url_index_.clear();
+    url_index_.reserve(streams_.size());
+    for (int i = 0; i < streams_.size(); i++) {
+        url_index_.insert(streams_.urlParts(i).hash, i);
+    }
+    url_index_valid_ = true;
+}
+
+void Parser::indexUrl(int row)
+{
+    if (url_index_valid_) {
+        url_index_.insert(streams_.urlParts(row).hash, row);
+    }
+}
+
+void Parser::unindexUrl(int row)
+{
+    if (url_index_valid_) {
+        url_index_.remove(streams_.urlParts(row).hash, row);
+    }
 }
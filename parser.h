@@ -4,42 +4,180 @@
 #include <QString>
 #include <QDir>
 #include <QTextStream>
+#include <QVector>
+#include <QDateTime>
+#include <QFileDevice>
+#include <QMultiHash>
 
-struct Stream {
-    QString url;
-    QString name;
+#include "siidocument.h"
+#include "streamlist.h"
+#include "streamvalidator.h"
 
-    Stream(QString u, QString d): url(u), name(d) {};
+// Entries parsed from a block of a .sii file.
+struct ParsedBlock {
+    StreamList streams;
+    QString live_stream_def_line;   // Null if the block does not have one.
+    QVector<qint64> offsets;        // Position of each entry's line in the file.
+    SiiDocument skeleton;           // The rest of the file (see Parser::parseEntries()).
+    QString error;                  // Why the file could not be read, if it could not.
 };
 
-//typedef std::list<Stream> StreamList;
-typedef QList<Stream> StreamList;
-
 
 
 class Parser {
 public:
-    Parser(const QString&);
-    bool saveStreams();                 // Overwrite input file.
+    enum ReadMode {
+        MappedReader,       // Maps the file into memory and parses it as a
+                            // SiiNunit document (see parseEntries()), or
+                            // decodes it if binary (see parseBinary()).
+        ParallelReader,     // Same as MappedReader, decoding chunks concurrently.
+        TextStreamReader,   // Reads the file line by line through a QTextStream
+                            // (keeping only its entries and definition line:
+                            // saves write the usual header and footer, without
+                            // the file's other units and comments). Binary
+                            // files are read like with MappedReader.
+        DeferredReader,     // Reads nothing: entries are added with appendBlock().
+        CachedReader,       // Uses the file's cache if it is up to date, else
+                            // reads like ParallelReader and writes the cache.
+        ValidatingReader    // Same as MappedReader, after checking every line
+                            // for problems (see diagnostics()).
+    };
+
+    enum SortKey {
+        SortByName,
+        SortByUrl,
+        SortByHost,         // Labels reversed, so that hosts of a domain stay together.
+        SortByPrefix,       // The name's leading tag ("[Jazz] ...", "Rock: ...", "SKY.FM - ...").
+        SortByCustom        // Text returned by a SortKeyFunction.
+    };
+    typedef QString (*SortKeyFunction)(const QStringRef& url, const QStringRef& name);
+
+    // threads is only used by ParallelReader and CachedReader (0: one per core).
+    Parser(const QString&, ReadMode mode = MappedReader, int threads = 0);
+    bool saveStreams();                 // Overwrite input file (only the changed tail, if possible).
     bool saveStreams(const QString&);   // Save to new file.
     StreamList::iterator streamsBegin();
     StreamList::const_iterator streamsBegin() const;
     StreamList::iterator streamsEnd();
     StreamList::const_iterator streamsEnd() const;
 
+    const StreamList& streamList() const;
+    Stream streamAt(unsigned int) const;
+    QStringRef urlAt(unsigned int) const;   // Valid until the entries change.
+    QStringRef nameAt(unsigned int) const;
+    const StreamUrl& urlPartsAt(unsigned int) const;   // Parsed once, until the entry is edited.
+    int streamCount() const;
+
     void swapStreams(unsigned int, unsigned int);
     void deleteStream(unsigned int);
     void insertStream(const Stream&);
+    void editStream(unsigned int, const Stream&);
+    // Stable, in the user's locale, ignoring case (see streamsorter.h).
+    // threads: 0 for one per core.
+    QVector<int> sortOrder(SortKey, int threads = 0, SortKeyFunction = NULL) const;
+    void sortStreams(SortKey, int threads = 0, SortKeyFunction = NULL);
+
+    // Bulk edits, in one pass over the list. Rows must be in ascending order.
+    int moveStreams(const QList<int>&, int);    // Moves before the given row, returns where they start.
+    void removeStreams(const QList<int>&);
+    void insertStreams(const QList<int>&, const QList<Stream>&);  // Inverse of removeStreams().
+    void permuteStreams(const QVector<int>&);   // Entry i becomes the old entry order[i].
+    void appendStreams(const Parser&);  // Appends all the other parser's entries.
+    void appendStreams(const StreamList&);
+
+    QString fileName() const;
+    bool fileChanged() const;           // Whether it is not the file last read or written anymore.
+    QString liveStreamDefLine() const;
+    void setLiveStreamDefLine(const QString&);
+    // Problems found by ValidatingReader (the first kDefaultMaxDiagnostics
+    // of them, see streamvalidator.h). Empty with the other readers.
+    const QList<StreamDiagnostic>& diagnostics() const;
+    // Why the file could not be read (only said of encrypted and binary
+    // files, which can be damaged in ways text files cannot). Empty if it was.
+    QString errorString() const;
+
+    // Duplicate detection, through an index of the entries' normalized URLs.
+    int findUrl(const QString&) const;  // First entry with the same URL, -1 if none.
+    QList<int> urlRows(const QString&) const;   // Every entry with the same URL, in order.
+    QList<int> duplicateRows() const;   // All but the first entry of each URL.
+    int removeDuplicates();             // Keeps the first entry of each URL.
+    static QString normalizeUrl(const QString&);    // See StreamUrl::normalize().
+
+    // Blocks of the file can also be parsed elsewhere (e.g. in a background
+    // thread) and then appended, in file order.
+    //
+    // Files are parsed as SiiNunit documents (see siidocument.h). Their
+    // entries are the items of the stream_data array of the live_stream_def
+    // unit, which entryNodes() finds, and parseEntries() decodes those in
+    // [begin, end) of them. The block of the first ones also gets the
+    // definition line and the skeleton of the file: the document without
+    // those items, which saves write back around the entries.
+    // Files that are not valid documents are read line by line instead by
+    // parseBlock(), which takes any quoted line with a '|' for an entry.
+    static QVector<int> entryNodes(const SiiDocument&);
+    static ParsedBlock parseEntries(const SiiDocument&, const QVector<int>& nodes, int begin, int end);
+    static ParsedBlock parseBlock(const char* file_begin, const char* begin, const char* end);
+    // Encrypted and binary files (see siibinary.h) are decoded whole, into a
+    // single block. It has no offsets, as its entries are not lines of the
+    // file: the first save writes it as text.
+    static bool isBinary(const char* begin, const char* end);
+    static ParsedBlock parseBinary(const char* begin, const char* end);
+    // Adds the entry in [url, end) to the block, end being its closing quote,
+    // for readers that find the entries themselves. offset: of its line.
+    static void parseEntry(ParsedBlock&, qint64 offset, const char* url, const char* separator,
+                           const char* end, bool escaped);
+    void appendBlock(const ParsedBlock&);
+
+    // Binary cache of the entries, next to the file (see streamcache.h).
+    bool loadCache();                   // Replaces the entries, if the cache is up to date.
+    bool writeCache() const;            // Only while the entries are those of the file.
+
+    // String codec used by .sii files: non-ASCII characters are written as
+    // the "\xNN" escapes of their UTF-8 bytes.
+    static const int kMaxEscapedLength = 12;    // Output bytes per QChar, at most.
+    static QString unescapeString(const char*, int);
+    static QString unescapeString(const QString&);
+    static QByteArray escapeString(const QString&);
+    static char* escapeString(const QString&, char*);
 
 private:
     StreamList streams_;
     QString filename_;
     QString live_stream_def_line_;
+    SiiDocument skeleton_;              // Empty if the file was not read as a document.
+    QList<StreamDiagnostic> diagnostics_;
+    QString error_;
+
+    // Incremental saves: where each entry starts in filename_, as of the last
+    // read or write, and the first entry modified since then.
+    QVector<qint64> entry_offsets_;
+    int first_dirty_;
+    bool offsets_valid_;
+    qint64 file_size_;
+    QDateTime file_modified_;
+
+    // Rows by hash of their normalized URL. Built on first use, kept up to
+    // date by edits, swaps and inserts, and rebuilt after rows shift.
+    mutable QMultiHash<uint, int> url_index_;
+    mutable bool url_index_valid_;
 
-    void readStreams();
-    QString unescapeString(const QString&) const;
-    QString escapeString(const QString&) const;
-    QChar getCodePoint(unsigned int byte) const;
+    void readStreams();                 // QTextStream reader.
+    void readStreamsMapped(int threads);    // Memory-mapped reader.
+    void readStreamsValidated();        // Memory-mapped reader, through a StreamValidator.
+    void markDirty(unsigned int);
+    void recordFileStamp(const QFileDevice&);
+    bool canSaveDelta() const;
+    bool saveDelta();
+    void buildUrlIndex() const;
+    void indexUrl(int);
+    void unindexUrl(int);
+    static int definitionBlock(const SiiDocument&);
+    void appendHeader(QByteArray&) const;   // Up to the number of entries, included.
+    void appendFooter(QByteArray&) const;   // After the entries.
+    static void appendNumber(QByteArray&, unsigned int);
+    const char* lineBreak() const;          // Of the entries and the number of them.
+    static void appendEntry(QByteArray&, const StreamList&, int, const char* newline);
+    static void appendText(QByteArray&, const QStringRef&, bool escape);
 };
 
 #endif // PARSER_H
@@ -0,0 +1,38 @@
+# .sii parser and stream list, shared by the GUI and the command line tool.
+# They only depend on QtCore (and QtConcurrent, for the parallel reader).
+
+QT += concurrent
+
+# "qmake CONFIG+=profiling" builds in the timers and counters of profiler.h.
+profiling: DEFINES += ETS_PROFILING
+
+INCLUDEPATH += $$PWD
+DEPENDPATH  += $$PWD
+
+SOURCES += $$PWD/parser.cpp \
+    $$PWD/siidocument.cpp \
+    $$PWD/siibinary.cpp \
+    $$PWD/streamlist.cpp \
+    $$PWD/streamurl.cpp \
+    $$PWD/linescanner.cpp \
+    $$PWD/searchindex.cpp \
+    $$PWD/streamcache.cpp \
+    $$PWD/streammerger.cpp \
+    $$PWD/streamdiff.cpp \
+    $$PWD/profiler.cpp \
+    $$PWD/streamsorter.cpp \
+    $$PWD/streamvalidator.cpp
+
+HEADERS += $$PWD/parser.h \
+    $$PWD/siidocument.h \
+    $$PWD/siibinary.h \
+    $$PWD/streamlist.h \
+    $$PWD/streamurl.h \
+    $$PWD/linescanner.h \
+    $$PWD/searchindex.h \
+    $$PWD/streamcache.h \
+    $$PWD/streammerger.h \
+    $$PWD/streamdiff.h \
+    $$PWD/profiler.h \
+    $$PWD/streamsorter.h \
+    $$PWD/streamvalidator.h
@@ -0,0 +1,189 @@
+#include "profiler.h"
+
+#include <QHash>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+#include <algorithm>
+
+static bool moreTotalTime(const Profiler::ScopeStats& a, const Profiler::ScopeStats& b)
+{
+    return a.total > b.total;
+}
+
+// Names are literals from the code, but quotes and backslashes would still
+// break the JSON.
+static QByteArray jsonString(const QString& s)
+{
+    QByteArray res = s.toUtf8();
+    res.replace('\\', "\\\\").replace('"', "\\\"");
+    return '"' + res + '"';
+}
+
+// Trace timestamps are in microseconds.
+static QByteArray microseconds(qint64 ns)
+{
+    return QByteArray::number(ns / 1000) + '.' + QByteArray::number(ns % 1000).rightJustified(3, '0');
+}
+
+
+Profiler::Profiler():
+dropped_(0)
+{
+    clock_.start();
+}
+
+Profiler& Profiler::instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+bool Profiler::isEnabled()
+{
+#ifdef ETS_PROFILING
+    return true;
+#else
+    return false;
+#endif
+}
+
+qint64 Profiler::now() const
+{
+    return clock_.nsecsElapsed();
+}
+
+void Profiler::record(const char* name, qint64 start, qint64 end)
+{
+    Event event;
+    event.name      = name;
+    event.start     = start;
+    event.duration  = end - start;
+    event.thread    = quintptr(QThread::currentThreadId());
+
+    QMutexLocker locker(&mutex_);
+    if (events_.size() >= kMaxEvents) {
+        dropped_++;
+        return;
+    }
+    events_.append(event);
+}
+
+void Profiler::addCounter(ProfileCounter* counter)
+{
+    QMutexLocker locker(&mutex_);
+    counters_.append(counter);
+}
+
+QList<Profiler::ScopeStats> Profiler::scopes() const
+{
+    QMutexLocker locker(&mutex_);
+    QHash<QString, int> rows;
+    QList<ScopeStats> res;
+    foreach (const Event& event, events_) {
+        const QString name = QString::fromUtf8(event.name);
+        QHash<QString, int>::const_iterator it = rows.constFind(name);
+        if (it == rows.constEnd()) {
+            ScopeStats stats;
+            stats.name  = name;
+            stats.calls = 0;
+            stats.total = 0;
+            stats.max   = 0;
+            it = rows.insert(name, res.size());
+            res.append(stats);
+        }
+        ScopeStats& stats = res[it.value()];
+        stats.calls++;
+        stats.total += event.duration;
+        stats.max = qMax(stats.max, event.duration);
+    }
+    std::stable_sort(res.begin(), res.end(), moreTotalTime);
+    return res;
+}
+
+QList<Profiler::CounterStats> Profiler::counters() const
+{
+    // Counters of the same name, from different call sites, are added up.
+    QMutexLocker locker(&mutex_);
+    QHash<QString, int> rows;
+    QList<CounterStats> res;
+    foreach (const ProfileCounter* counter, counters_) {
+        const QString name = QString::fromUtf8(counter->name());
+        if (!rows.contains(name)) {
+            CounterStats stats;
+            stats.name  = name;
+            stats.value = 0;
+            rows.insert(name, res.size());
+            res.append(stats);
+        }
+        res[rows.value(name)].value += counter->value();
+    }
+    return res;
+}
+
+int Profiler::droppedEvents() const
+{
+    QMutexLocker locker(&mutex_);
+    return dropped_;
+}
+
+void Profiler::reset()
+{
+    QMutexLocker locker(&mutex_);
+    events_.clear();
+    dropped_ = 0;
+    foreach (ProfileCounter* counter, counters_) {
+        counter->reset();
+    }
+}
+
+bool Profiler::writeTrace(const QString& filename) const
+{
+/*
+Writes the Trace Event Format: a complete ("X") event per timed scope, and the
+final value of every counter as a counter ("C") event at the end of the trace.
+Threads are numbered in order of appearance, the first one being whichever
+recorded the first event (usually the main thread).
+*/
+    const QList<CounterStats> totals = counters();
+
+    QMutexLocker locker(&mutex_);
+    QHash<quintptr, int> threads;
+    qint64 last = 0;
+    QByteArray out;
+    out.reserve(events_.size() * 96 + 1024);
+    out.append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    foreach (const Event& event, events_) {
+        if (!threads.contains(event.thread)) {
+            threads.insert(event.thread, threads.size() + 1);
+        }
+        last = qMax(last, event.start + event.duration);
+        out.append("{\"name\":").append(jsonString(QString::fromUtf8(event.name)))
+           .append(",\"cat\":\"etsradio\",\"ph\":\"X\",\"pid\":1,\"tid\":")
+           .append(QByteArray::number(threads.value(event.thread)))
+           .append(",\"ts\":").append(microseconds(event.start))
+           .append(",\"dur\":").append(microseconds(event.duration))
+           .append("},\n");
+    }
+    foreach (const CounterStats& counter, totals) {
+        out.append("{\"name\":").append(jsonString(counter.name))
+           .append(",\"cat\":\"etsradio\",\"ph\":\"C\",\"pid\":1,\"tid\":1,\"ts\":").append(microseconds(last))
+           .append(",\"args\":{\"value\":").append(QByteArray::number(counter.value))
+           .append("}},\n");
+    }
+    out.append("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"ETS Radio Manager\"}}\n");
+    out.append("],\"otherData\":{\"droppedEvents\":").append(QByteArray::number(dropped_)).append("}}\n");
+    locker.unlock();
+
+    QSaveFile file(filename);
+    return file.open(QIODevice::WriteOnly) && file.write(out) == out.size() && file.commit();
+}
+
+
+ProfileCounter::ProfileCounter(const char* name):
+name_(name),
+value_(0)
+{
+    Profiler::instance().addCounter(this);
+}
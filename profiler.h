@@ -0,0 +1,123 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+// Timers and counters for the slow paths (reading, saving, filling the
+// table...), shown by the diagnostics dialog and exportable as a Chrome trace
+// (chrome://tracing, or https://ui.perfetto.dev).
+//
+// They are only built in with "qmake CONFIG+=profiling", which defines
+// ETS_PROFILING. Otherwise the macros below expand to nothing, arguments
+// included, so they cost nothing and may be given expressions that are only
+// worth computing when profiling.
+#ifdef ETS_PROFILING
+#define ETS_PROFILE_CONCAT_(a, b) a##b
+#define ETS_PROFILE_CONCAT(a, b) ETS_PROFILE_CONCAT_(a, b)
+// Times the rest of the enclosing block. name must be a string literal.
+#define ETS_PROFILE_SCOPE(name) ProfileScope ETS_PROFILE_CONCAT(ets_profile_scope_, __LINE__)(name)
+// Adds value to the named counter. name must be a string literal.
+#define ETS_PROFILE_COUNT(name, value) \
+    do { static ProfileCounter ets_profile_counter_(name); ets_profile_counter_.add(value); } while (0)
+#else
+#define ETS_PROFILE_SCOPE(name)
+#define ETS_PROFILE_COUNT(name, value) do { } while (0)
+#endif
+
+class ProfileCounter;
+
+class Profiler {
+public:
+    struct Event {
+        const char* name;
+        qint64 start;       // In ns, since the profiler was created.
+        qint64 duration;    // Same.
+        quintptr thread;
+    };
+
+    struct ScopeStats {
+        QString name;
+        int calls;
+        qint64 total;       // In ns.
+        qint64 max;
+    };
+
+    struct CounterStats {
+        QString name;
+        qint64 value;
+    };
+
+    static Profiler& instance();
+    static bool isEnabled();            // Built with ETS_PROFILING.
+
+    qint64 now() const;
+    void record(const char* name, qint64 start, qint64 end);
+    void addCounter(ProfileCounter*);
+
+    // By name, the scopes in order of total time.
+    QList<ScopeStats> scopes() const;
+    QList<CounterStats> counters() const;
+    int droppedEvents() const;
+
+    void reset();
+    bool writeTrace(const QString& filename) const;
+
+private:
+    // Enough for any session worth looking at: about 3 MB.
+    static const int kMaxEvents = 1 << 17;
+
+    mutable QMutex mutex_;
+    QElapsedTimer clock_;
+    QVector<Event> events_;
+    QList<ProfileCounter*> counters_;
+    int dropped_;
+
+    Profiler();
+    Q_DISABLE_COPY(Profiler)
+};
+
+
+// A counter of one call site. Counting is a relaxed atomic add, cheap enough
+// for the parser's workers.
+class ProfileCounter {
+public:
+    explicit ProfileCounter(const char* name);
+
+    void add(qint64 value) { value_.fetchAndAddRelaxed(value); }
+    qint64 value() const { return value_.load(); }
+    void reset() { value_.store(0); }
+    const char* name() const { return name_; }
+
+private:
+    const char* name_;
+    QAtomicInteger<qint64> value_;
+};
+
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name):
+    name_(name),
+    start_(Profiler::instance().now())
+    {
+    }
+
+    ~ProfileScope()
+    {
+        Profiler& profiler = Profiler::instance();
+        profiler.record(name_, start_, profiler.now());
+    }
+
+private:
+    const char* name_;
+    qint64 start_;
+
+    Q_DISABLE_COPY(ProfileScope)
+};
+
+#endif // PROFILER_H
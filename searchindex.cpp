@@ -0,0 +1,334 @@
+#include "searchindex.h"
+#include "parser.h"
+
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <algorithm>
+
+// Below this many candidates, checking the rows beats intersecting more lists.
+static const int kVerifyDirectly = 256;
+
+static inline int readVarint(const uchar*& p)
+{
+    int value = 0;
+    int shift = 0;
+    while (*p & 0x80) {
+        value |= (*p++ & 0x7F) << shift;
+        shift += 7;
+    }
+    return value | (*p++ << shift);
+}
+
+static inline void writeVarint(QByteArray& out, int value)
+{
+    while (value >= 0x80) {
+        out.append(char(0x80 | (value & 0x7F)));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+
+SearchIndex::SearchIndex():
+rows_(0),
+built_(false)
+{
+}
+
+void SearchIndex::build(const Parser& parser, int threads)
+{
+/*
+Like the parallel reader, the rows are split into chunks that are indexed
+concurrently. Chunks cover increasing ranges of rows, so their posting lists
+are joined by appending them in order (only the first difference of each
+needs to be re-encoded).
+*/
+    clear();
+
+    static const int kMinChunkRows = 16384;
+    const int count = parser.streamCount();
+    if (threads <= 0) {
+        threads = QThread::idealThreadCount();
+    }
+    const int chunks = qBound(1, count / kMinChunkRows, threads * 4);
+
+    if (chunks == 1) {
+        postings_ = buildRange(&parser, 0, count);
+    }
+    else {
+        QThreadPool pool;
+        pool.setMaxThreadCount(threads);
+
+        QList< QFuture<PostingHash> > results;
+        for (int c = 0; c < chunks; c++) {
+            const int begin = int(qint64(count) * c / chunks);
+            const int end = int(qint64(count) * (c + 1) / chunks);
+            results.append(QtConcurrent::run(&pool, &SearchIndex::buildRange, &parser, begin, end));
+        }
+        for (int c = 0; c < results.size(); c++) {
+            const PostingHash chunk = results[c].result();
+            for (PostingHash::const_iterator it = chunk.constBegin(); it != chunk.constEnd(); ++it) {
+                appendPosting(postings_[it.key()], it.value());
+            }
+        }
+    }
+
+    rows_ = count;
+    built_ = true;
+}
+
+void SearchIndex::clear()
+{
+    postings_.clear();
+    edited_.clear();
+    rows_ = 0;
+    built_ = false;
+}
+
+bool SearchIndex::isBuilt() const
+{
+    return built_;
+}
+
+void SearchIndex::rowEdited(int row)
+{
+    // Its old trigrams stay in the lists; rows are always checked anyway.
+    if (built_ && row < rows_) {
+        edited_.insert(row);
+    }
+}
+
+void SearchIndex::remap(const QVector<int>& new_rows, int count)
+{
+/*
+Every list is decoded, its rows mapped to where they are now (the removed ones
+dropped), and encoded again in order: one pass over the lists, instead of over
+the text of every entry as a build is. Rows the index did not cover (appended
+after the build, or just inserted) are checked directly from then on, like
+edited ones.
+*/
+    if (!built_) {
+        return;
+    }
+
+    PostingHash postings;
+    postings.reserve(postings_.size());
+    for (PostingHash::const_iterator it = postings_.constBegin(); it != postings_.constEnd(); ++it) {
+        QVector<int> rows = decode(it.value());
+        int kept = 0;
+        for (int i = 0; i < rows.size(); i++) {
+            const int row = new_rows.value(rows.at(i), -1);
+            if (row != -1) {
+                rows[kept++] = row;
+            }
+        }
+        if (kept == 0) {
+            continue;
+        }
+        rows.resize(kept);
+        std::sort(rows.begin(), rows.end());
+
+        Posting& posting = postings[it.key()];
+        foreach (int row, rows) {
+            appendRow(posting, row);
+        }
+    }
+    postings_.swap(postings);
+
+    // The lists are only right for the new rows of old indexed, unedited ones.
+    QVector<bool> indexed(count, false);
+    for (int row = 0; row < qMin(rows_, new_rows.size()); row++) {
+        const int new_row = new_rows.at(row);
+        if (new_row >= 0 && new_row < count && !edited_.contains(row)) {
+            indexed[new_row] = true;
+        }
+    }
+    QSet<int> edited;
+    for (int row = 0; row < count; row++) {
+        if (!indexed.at(row)) {
+            edited.insert(row);
+        }
+    }
+    edited_.swap(edited);
+    rows_ = count;
+}
+
+QVector<int> SearchIndex::find(const Parser& parser, const QString& text) const
+{
+/*
+The candidates are the rows of the rarest trigram of the text, narrowed down
+with the next rarest ones while there are many of them (and the lists are not
+much longer than the candidates). Every candidate is then checked, as having
+all the trigrams does not mean having them in the right order.
+*/
+    const int count = parser.streamCount();
+    QVector<int> res;
+
+    QVector<quint64> trigrams;
+    addTrigrams(QStringRef(&text), trigrams);
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+    // Nothing to look up: checking every row.
+    if (!built_ || trigrams.isEmpty()) {
+        for (int row = 0; row < count; row++) {
+            if (matches(parser, row, text)) {
+                res.append(row);
+            }
+        }
+        return res;
+    }
+
+    QVector<const Posting*> lists;
+    foreach (quint64 trigram, trigrams) {
+        PostingHash::const_iterator it = postings_.constFind(trigram);
+        if (it == postings_.constEnd()) {
+            lists.clear();  // No indexed row has it.
+            break;
+        }
+        lists.append(&it.value());
+    }
+    for (int i = 1; i < lists.size(); i++) {   // Few of them: insertion sort.
+        for (int j = i; j > 0 && lists[j]->count < lists[j - 1]->count; j--) {
+            qSwap(lists[j], lists[j - 1]);
+        }
+    }
+
+    QVector<int> candidates;
+    if (!lists.isEmpty()) {
+        candidates = decode(*lists.first());
+        for (int i = 1; i < lists.size() && candidates.size() > kVerifyDirectly; i++) {
+            if (lists[i]->count / 16 > candidates.size()) {
+                break;  // The rest are even longer.
+            }
+            candidates = intersect(candidates, *lists[i]);
+        }
+    }
+
+    const int indexed = qMin(rows_, count);
+    foreach (int row, candidates) {
+        if (row < indexed && !edited_.contains(row) && matches(parser, row, text)) {
+            res.append(row);
+        }
+    }
+    if (!edited_.isEmpty()) {
+        foreach (int row, edited_) {
+            if (row < indexed && matches(parser, row, text)) {
+                res.append(row);
+            }
+        }
+        std::sort(res.begin(), res.end());
+    }
+    for (int row = indexed; row < count; row++) {
+        if (matches(parser, row, text)) {
+            res.append(row);
+        }
+    }
+    return res;
+}
+
+bool SearchIndex::matches(const Parser& parser, int row, const QString& text)
+{
+    return parser.nameAt(row).contains(text, Qt::CaseInsensitive) ||
+           parser.urlAt(row).contains(text, Qt::CaseInsensitive);
+}
+
+qint64 SearchIndex::memoryUsage() const
+{
+    qint64 res = qint64(postings_.capacity()) * (sizeof(quint64) + sizeof(Posting) + 2 * sizeof(void*));
+    for (PostingHash::const_iterator it = postings_.constBegin(); it != postings_.constEnd(); ++it) {
+        res += it.value().rows.capacity();
+    }
+    return res;
+}
+
+SearchIndex::PostingHash SearchIndex::buildRange(const Parser* parser, int begin, int end)
+{
+    PostingHash res;
+    QVector<quint64> trigrams;
+    for (int row = begin; row < end; row++) {
+        trigrams.resize(0);
+        addTrigrams(parser->nameAt(row), trigrams);
+        addTrigrams(parser->urlAt(row), trigrams);
+        std::sort(trigrams.begin(), trigrams.end());
+        QVector<quint64>::iterator last = std::unique(trigrams.begin(), trigrams.end());
+
+        for (QVector<quint64>::iterator it = trigrams.begin(); it != last; ++it) {
+            appendRow(res[*it], row);
+        }
+    }
+    return res;
+}
+
+void SearchIndex::addTrigrams(const QStringRef& text, QVector<quint64>& out)
+{
+    // Three case-folded UTF-16 units per trigram, 16 bits each.
+    quint64 trigram = 0;
+    for (int i = 0; i < text.size(); i++) {
+        trigram = ((trigram << 16) | text.at(i).toCaseFolded().unicode()) & Q_UINT64_C(0xFFFFFFFFFFFF);
+        if (i >= 2) {
+            out.append(trigram);
+        }
+    }
+}
+
+void SearchIndex::appendRow(Posting& posting, int row)
+{
+    writeVarint(posting.rows, row - posting.last);
+    posting.last = row;
+    posting.count++;
+}
+
+void SearchIndex::appendPosting(Posting& posting, const Posting& next)
+{
+    if (next.count == 0) {
+        return;
+    }
+    if (posting.count == 0) {
+        posting = next;
+        return;
+    }
+
+    // The first difference of next is relative to -1.
+    const uchar* p = reinterpret_cast<const uchar*>(next.rows.constData());
+    const int first = readVarint(p) - 1;
+    writeVarint(posting.rows, first - posting.last);
+    posting.rows.append(reinterpret_cast<const char*>(p),
+                        next.rows.size() - int(p - reinterpret_cast<const uchar*>(next.rows.constData())));
+    posting.count += next.count;
+    posting.last = next.last;
+}
+
+QVector<int> SearchIndex::decode(const Posting& posting)
+{
+    QVector<int> res(posting.count);
+    const uchar* p = reinterpret_cast<const uchar*>(posting.rows.constData());
+    int row = -1;
+    for (int i = 0; i < posting.count; i++) {
+        row += readVarint(p);
+        res[i] = row;
+    }
+    return res;
+}
+
+QVector<int> SearchIndex::intersect(const QVector<int>& rows, const Posting& posting)
+{
+    QVector<int> res;
+    const uchar* p = reinterpret_cast<const uchar*>(posting.rows.constData());
+    int row = -1;
+    int read = 0;
+    foreach (int candidate, rows) {
+        while (row < candidate && read < posting.count) {
+            row += readVarint(p);
+            read++;
+        }
+        if (row == candidate) {
+            res.append(candidate);
+        }
+        else if (row < candidate) {
+            break;  // No more rows in the list.
+        }
+    }
+    return res;
+}
@@ -0,0 +1,66 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringRef>
+#include <QVector>
+
+class Parser;
+
+// Trigram index over the names and URLs of a parser's entries, for
+// case-insensitive substring search: every three consecutive (case-folded)
+// characters of a field map to the rows containing them, so a query only has
+// to check the rows that have all of its trigrams.
+//
+// Edited rows, and rows appended after the index was built, are checked
+// directly until the next build. Rows that shift (removals, moves, insertions
+// in the middle) are remapped in the posting lists, without reading the
+// entries again.
+class SearchIndex {
+public:
+    SearchIndex();
+
+    void build(const Parser&, int threads = 0);     // 0: one per core.
+    void clear();
+    bool isBuilt() const;
+
+    void rowEdited(int);
+    // new_rows: new position of each old row, -1 if it was removed; count:
+    // rows after the change (rows no old row moved to are new ones).
+    void remap(const QVector<int>& new_rows, int count);
+
+    // Rows (in ascending order) whose name or URL contains the text.
+    QVector<int> find(const Parser&, const QString&) const;
+    static bool matches(const Parser&, int, const QString&);
+
+    qint64 memoryUsage() const;     // Bytes used by the posting lists.
+
+private:
+    // Rows containing a trigram, as varint-encoded differences between
+    // consecutive rows (most of them fit in a byte).
+    struct Posting {
+        QByteArray rows;
+        int count;
+        int last;
+
+        Posting(): count(0), last(-1) {}
+    };
+    typedef QHash<quint64, Posting> PostingHash;
+
+    PostingHash postings_;
+    QSet<int> edited_;
+    int rows_;                      // Rows [0, rows_) are in the index.
+    bool built_;
+
+    static PostingHash buildRange(const Parser*, int begin, int end);
+    static void addTrigrams(const QStringRef&, QVector<quint64>&);
+    static void appendRow(Posting&, int);
+    static void appendPosting(Posting&, const Posting&);
+    static QVector<int> decode(const Posting&);
+    static QVector<int> intersect(const QVector<int>&, const Posting&);
+};
+
+#endif // SEARCHINDEX_H
@@ -0,0 +1,529 @@
+#include "siibinary.h"
+#include "profiler.h"
+
+#include <QHash>
+#include <QtEndian>
+#include <climits>
+#include <cstring>
+
+// Key of the game's ScsC files.
+static const uchar kScsCKey[32] = {
+    0x2a, 0x5f, 0xcb, 0x17, 0x91, 0xd2, 0x2f, 0xb6, 0x02, 0x45, 0xb3, 0xd8, 0x36, 0x9e, 0xd0, 0xb2,
+    0xc2, 0x73, 0x71, 0x56, 0x3f, 0xbf, 0x1f, 0x3c, 0x9e, 0xdf, 0x6b, 0x11, 0x82, 0x5a, 0x5d, 0x0a
+};
+
+// ScsC header: magic, HMAC, IV and size of the inflated contents.
+static const int kScsCHmacOffset    = 4;
+static const int kScsCIvOffset      = kScsCHmacOffset + 32;
+static const int kScsCSizeOffset    = kScsCIvOffset + 16;
+static const int kScsCHeaderSize    = kScsCSizeOffset + 4;
+
+static const int kAesBlock          = 16;
+static const int kAes256Rounds      = 14;
+
+// BSII header: magic and version.
+static const int kBsiiHeaderSize    = 8;
+static const quint32 kBsiiMinVersion = 1;
+static const quint32 kBsiiMaxVersion = 3;
+
+
+static inline uint xtime(uint x)
+{
+    return ((x << 1) ^ ((x & 0x80) ? 0x1B : 0)) & 0xFF;
+}
+
+// Lookup tables for AES decryption, computed rather than spelled out.
+struct AesTables {
+    uchar sbox[256];
+    uchar inv_sbox[256];
+    uchar mul9[256];
+    uchar mul11[256];
+    uchar mul13[256];
+    uchar mul14[256];
+
+    AesTables()
+    {
+        // p goes through every non-zero element of GF(2^8) (powers of 3),
+        // and q through their inverses, which the affine map turns into the
+        // S-box.
+        uint p = 1;
+        uint q = 1;
+        do {
+            p = p ^ xtime(p);
+            q ^= q << 1;
+            q ^= q << 2;
+            q ^= q << 4;
+            q = (q ^ ((q & 0x80) ? 0x09 : 0)) & 0xFF;
+            uint x = q;
+            for (int i = 1; i <= 4; i++) {
+                x ^= ((q << i) | (q >> (8 - i))) & 0xFF;
+            }
+            sbox[p] = uchar(x ^ 0x63);
+        } while (p != 1);
+        sbox[0] = 0x63;
+
+        for (int c = 0; c < 256; c++) {
+            inv_sbox[sbox[c]] = uchar(c);
+            const uint x2 = xtime(c);
+            const uint x4 = xtime(x2);
+            const uint x8 = xtime(x4);
+            mul9[c]  = uchar(x8 ^ c);
+            mul11[c] = uchar(x8 ^ x2 ^ c);
+            mul13[c] = uchar(x8 ^ x4 ^ c);
+            mul14[c] = uchar(x8 ^ x4 ^ x2);
+        }
+    }
+};
+
+static const AesTables kAes;
+
+// Round keys of AES-256: 15 of 16 bytes each.
+static void expandKey(const uchar* key, uchar* round_keys)
+{
+    memcpy(round_keys, key, 32);
+    uint rcon = 1;
+    for (int i = 8; i < 4 * (kAes256Rounds + 1); i++) {
+        uchar t[4];
+        memcpy(t, round_keys + (i - 1) * 4, 4);
+        if (i % 8 == 0) {
+            const uchar first = t[0];
+            t[0] = uchar(kAes.sbox[t[1]] ^ rcon);
+            t[1] = kAes.sbox[t[2]];
+            t[2] = kAes.sbox[t[3]];
+            t[3] = kAes.sbox[first];
+            rcon = xtime(rcon);
+        }
+        else if (i % 8 == 4) {
+            for (int j = 0; j < 4; j++) {
+                t[j] = kAes.sbox[t[j]];
+            }
+        }
+        for (int j = 0; j < 4; j++) {
+            round_keys[i * 4 + j] = round_keys[(i - 8) * 4 + j] ^ t[j];
+        }
+    }
+}
+
+// Inverse cipher of one block, in place. The state is kept in column order,
+// as the block itself is.
+static void decryptBlock(uchar* s, const uchar* round_keys)
+{
+    for (int i = 0; i < kAesBlock; i++) {
+        s[i] ^= round_keys[kAes256Rounds * kAesBlock + i];
+    }
+
+    for (int round = kAes256Rounds - 1; round >= 0; round--) {
+        // InvShiftRows and InvSubBytes, then AddRoundKey.
+        uchar t[kAesBlock];
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) {
+                t[r + 4 * ((c + r) % 4)] = kAes.inv_sbox[s[r + 4 * c]];
+            }
+        }
+        for (int i = 0; i < kAesBlock; i++) {
+            s[i] = t[i] ^ round_keys[round * kAesBlock + i];
+        }
+        if (round == 0) {
+            break;
+        }
+
+        // InvMixColumns.
+        for (int c = 0; c < 4; c++) {
+            uchar* col = s + 4 * c;
+            const uchar a0 = col[0], a1 = col[1], a2 = col[2], a3 = col[3];
+            col[0] = kAes.mul14[a0] ^ kAes.mul11[a1] ^ kAes.mul13[a2] ^ kAes.mul9[a3];
+            col[1] = kAes.mul9[a0]  ^ kAes.mul14[a1] ^ kAes.mul11[a2] ^ kAes.mul13[a3];
+            col[2] = kAes.mul13[a0] ^ kAes.mul9[a1]  ^ kAes.mul14[a2] ^ kAes.mul11[a3];
+            col[3] = kAes.mul11[a0] ^ kAes.mul13[a1] ^ kAes.mul9[a2]  ^ kAes.mul14[a3];
+        }
+    }
+}
+
+
+// Size of a BSII value of the given type, 0 for those of variable size
+// (strings, unit names and arrays) and for unknown ones.
+static int valueSize(quint32 type)
+{
+    switch (type) {
+    case 0x35:                                  // Bool.
+        return 1;
+    case 0x29: case 0x2B:                       // 16 bit integers.
+        return 2;
+    case 0x05: case 0x25: case 0x27: case 0x2F: // Float, 32 bit integers.
+    case 0x37:                                  // Ordinal string.
+        return 4;
+    case 0x03: case 0x07:                       // Encoded string, 2 floats.
+    case 0x31: case 0x33:                       // 64 bit integers.
+        return 8;
+    case 0x09: case 0x11:                       // 3 floats or 32 bit integers.
+        return 12;
+    case 0x17:                                  // 4 floats.
+        return 16;
+    case 0x19:                                  // 8 floats.
+        return 32;
+    default:
+        return 0;
+    }
+}
+
+
+// Finds the strings of a BSII file in one pass over it. Structures are only
+// remembered for the types of their attributes, which is what it takes to
+// skip the units of those that are not wanted.
+class BsiiReader {
+public:
+    BsiiReader(const char* begin, const char* end);
+
+    bool read(const QByteArray& class_name, const QByteArray& attribute, QByteArray& unit_name,
+              QVector<SiiBinary::Span>& items);
+    QString error;
+
+private:
+    struct Structure {
+        bool wanted;                // Of the wanted class.
+        QVector<quint32> types;     // Of its attributes, in order.
+        int wanted_attribute;       // -1 if it has none.
+    };
+
+    const char* begin_;
+    const char* p_;
+    const char* end_;
+    QHash<quint32, Structure> structures_;
+
+    bool readStructure(const QByteArray& class_name, const QByteArray& attribute);
+    bool readUInt32(quint32&);
+    bool readString(SiiBinary::Span&);
+    bool readId(QByteArray*);
+    bool skip(qint64);
+    bool skipValue(quint32 type);
+    bool fail(const QString&);
+};
+
+BsiiReader::BsiiReader(const char* begin, const char* end):
+begin_(begin),
+p_(begin + kBsiiHeaderSize),
+end_(end)
+{
+}
+
+bool BsiiReader::read(const QByteArray& class_name, const QByteArray& attribute, QByteArray& unit_name,
+                      QVector<SiiBinary::Span>& items)
+{
+    quint32 type;
+    while (p_ < end_) {
+        if (!readUInt32(type)) {
+            return false;
+        }
+        if (type == 0) {
+            if (p_ == end_) {
+                return fail("truncated structure");
+            }
+            if (*p_++ == 0) {
+                return true;    // An empty structure ends the file.
+            }
+            if (!readStructure(class_name, attribute)) {
+                return false;
+            }
+            continue;
+        }
+
+        QHash<quint32, Structure>::const_iterator structure = structures_.constFind(type);
+        if (structure == structures_.constEnd()) {
+            return fail(QString("unit of undefined structure %1").arg(type));
+        }
+        if (!readId(structure->wanted ? &unit_name : NULL)) {
+            return false;
+        }
+        for (int i = 0; i < structure->types.size(); i++) {
+            if (i != structure->wanted_attribute) {
+                if (!skipValue(structure->types.at(i))) {
+                    return false;
+                }
+                continue;
+            }
+
+            quint32 count;
+            if (!readUInt32(count)) {
+                return false;
+            }
+            items.reserve(int(qMin(quint64(count), quint64(end_ - p_) / 4)));
+            for (quint32 j = 0; j < count; j++) {
+                SiiBinary::Span item;
+                if (!readString(item)) {
+                    return false;
+                }
+                items.append(item);
+            }
+        }
+        if (structure->wanted) {
+            return true;
+        }
+    }
+    return true;
+}
+
+bool BsiiReader::readStructure(const QByteArray& class_name, const QByteArray& attribute)
+{
+    quint32 id;
+    SiiBinary::Span name;
+    if (!readUInt32(id) || !readString(name)) {
+        return false;
+    }
+
+    Structure structure;
+    structure.wanted = (name.end - name.begin == class_name.size() &&
+                        qstrnicmp(name.begin, class_name.constData(), class_name.size()) == 0);
+    structure.wanted_attribute = -1;
+
+    quint32 type;
+    while (readUInt32(type) && type != 0) {
+        SiiBinary::Span field;
+        if (!readString(field)) {
+            return false;
+        }
+        if (structure.wanted && type == 0x02 && structure.wanted_attribute == -1 &&
+            field.end - field.begin == attribute.size() &&
+            memcmp(field.begin, attribute.constData(), attribute.size()) == 0) {
+            structure.wanted_attribute = structure.types.size();
+        }
+        structure.types.append(type);
+
+        if (type == 0x37) {     // Ordinal strings: their table of names.
+            quint32 count;
+            if (!readUInt32(count)) {
+                return false;
+            }
+            for (quint32 j = 0; j < count; j++) {
+                SiiBinary::Span ordinal;
+                if (!skip(4) || !readString(ordinal)) {
+                    return false;
+                }
+            }
+        }
+    }
+    if (!error.isNull()) {
+        return false;
+    }
+    structures_.insert(id, structure);
+    return true;
+}
+
+bool BsiiReader::readUInt32(quint32& value)
+{
+    if (end_ - p_ < 4) {
+        return fail("unexpected end of file");
+    }
+    value = qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(p_));
+    p_ += 4;
+    return true;
+}
+
+bool BsiiReader::readString(SiiBinary::Span& span)
+{
+    quint32 length;
+    if (!readUInt32(length)) {
+        return false;
+    }
+    span.begin = p_;
+    if (!skip(length)) {
+        return false;
+    }
+    span.end = p_;
+    return true;
+}
+
+bool BsiiReader::readId(QByteArray* name)
+{
+/*
+Either 0xFF and a 64 bit number, written in text as its 16 bit groups in hex
+("_nameless.1f0.7a80"), or a number of parts, each one a string of up to 12
+characters encoded as a number in base 38.
+*/
+    if (p_ == end_) {
+        return fail("unexpected end of file");
+    }
+    const uint parts = uchar(*p_++);
+    const qint64 size = (parts == 0xFF) ? 8 : qint64(parts) * 8;
+    if (end_ - p_ < size) {
+        return fail("unexpected end of file");
+    }
+    if (name == NULL) {
+        p_ += size;
+        return true;
+    }
+
+    *name = (parts == 0) ? QByteArray("null") : QByteArray("");
+    if (parts == 0xFF) {
+        const quint64 value = qFromLittleEndian<quint64>(reinterpret_cast<const uchar*>(p_));
+        name->append("_nameless");
+        bool leading = true;
+        for (int shift = 48; shift >= 0; shift -= 16) {
+            const uint group = uint(value >> shift) & 0xFFFF;
+            if (leading && group == 0 && shift > 0) {
+                continue;
+            }
+            name->append('.').append(QByteArray::number(group, 16).rightJustified(leading ? 0 : 4, '0'));
+            leading = false;
+        }
+    }
+    else {
+        static const char kChars[] = "0123456789abcdefghijklmnopqrstuvwxyz_";
+        for (uint i = 0; i < parts; i++) {
+            quint64 value = qFromLittleEndian<quint64>(reinterpret_cast<const uchar*>(p_ + i * 8));
+            if (i > 0) {
+                name->append('.');
+            }
+            for (; value != 0; value /= 38) {
+                const int c = int(value % 38);
+                if (c > 0) {
+                    name->append(kChars[c - 1]);
+                }
+            }
+        }
+    }
+    p_ += size;
+    return true;
+}
+
+bool BsiiReader::skip(qint64 size)
+{
+    if (end_ - p_ < size) {
+        return fail("unexpected end of file");
+    }
+    p_ += size;
+    return true;
+}
+
+bool BsiiReader::skipValue(quint32 type)
+{
+/*
+Arrays are a 32 bit count and then their items, and the type of an array is
+the type of its items plus one.
+*/
+    SiiBinary::Span string;
+    quint32 count;
+    switch (type) {
+    case 0x01:                          // String.
+        return readString(string);
+    case 0x39: case 0x3B: case 0x3D:    // Unit names.
+        return readId(NULL);
+
+    case 0x02: case 0x04: case 0x06: case 0x08: case 0x0A: case 0x12: case 0x18: case 0x1A:
+    case 0x26: case 0x28: case 0x2A: case 0x2C: case 0x32: case 0x34: case 0x36: case 0x3A: case 0x3C:
+        if (!readUInt32(count)) {
+            return false;
+        }
+        if (valueSize(type - 1) > 0) {
+            return skip(qint64(count) * valueSize(type - 1));
+        }
+        for (quint32 i = 0; i < count; i++) {
+            if (!skipValue(type - 1)) {
+                return false;
+            }
+        }
+        return true;
+
+    default:
+        if (valueSize(type) <= 0) {
+            return fail(QString("unknown value type 0x%1").arg(type, 0, 16));
+        }
+        return skip(valueSize(type));
+    }
+}
+
+bool BsiiReader::fail(const QString& message)
+{
+    if (error.isNull()) {
+        error = message + QString(" at byte %1").arg(p_ - begin_);
+    }
+    return false;
+}
+
+
+SiiBinary::Format SiiBinary::format(const char* begin, const char* end)
+{
+    if (end - begin >= 4 && memcmp(begin, "ScsC", 4) == 0) {
+        return EncryptedFormat;
+    }
+    if (end - begin >= 4 && memcmp(begin, "BSII", 4) == 0) {
+        return BinaryFormat;
+    }
+    return TextFormat;
+}
+
+bool SiiBinary::decrypt(const char* begin, const char* end, QByteArray& out, QString& error)
+{
+/*
+The contents are decrypted right after the 4 bytes qUncompress() wants in
+front of them (the expected size, big-endian), so they are inflated without
+another copy. The padding of the last block is left to zlib, which stops at
+the end of its stream.
+*/
+    ETS_PROFILE_SCOPE("SiiBinary::decrypt");
+
+    const qint64 length = end - begin - kScsCHeaderSize;
+    if (length < 0 || length % kAesBlock != 0 || length > INT_MAX - 4) {
+        error = "truncated encrypted file";
+        return false;
+    }
+    const uchar* header = reinterpret_cast<const uchar*>(begin);
+    const quint32 size = qFromLittleEndian<quint32>(header + kScsCSizeOffset);
+
+    QByteArray compressed(int(length) + 4, Qt::Uninitialized);
+    uchar* data = reinterpret_cast<uchar*>(compressed.data());
+    qToBigEndian<quint32>(size, data);
+    data += 4;
+    memcpy(data, header + kScsCHeaderSize, size_t(length));
+
+    uchar round_keys[kAesBlock * (kAes256Rounds + 1)];
+    expandKey(kScsCKey, round_keys);
+    uchar previous[kAesBlock];
+    memcpy(previous, header + kScsCIvOffset, kAesBlock);
+    for (qint64 i = 0; i < length; i += kAesBlock) {
+        uchar cipher[kAesBlock];
+        memcpy(cipher, data + i, kAesBlock);
+        decryptBlock(data + i, round_keys);
+        for (int j = 0; j < kAesBlock; j++) {
+            data[i + j] ^= previous[j];
+        }
+        memcpy(previous, cipher, kAesBlock);
+    }
+    ETS_PROFILE_COUNT("bytes decrypted", length);
+
+    out = qUncompress(compressed);
+    if (out.size() != int(size)) {
+        out.clear();
+        error = "cannot be decrypted";
+        return false;
+    }
+    return true;
+}
+
+bool SiiBinary::findStrings(const char* begin, const char* end, const QByteArray& class_name,
+                            const QByteArray& attribute, QByteArray& unit_name, QVector<Span>& items,
+                            QString& error)
+{
+    ETS_PROFILE_SCOPE("SiiBinary::findStrings");
+
+    unit_name.clear();
+    items.clear();
+    if (end - begin < kBsiiHeaderSize) {
+        error = "truncated binary file";
+        return false;
+    }
+    const quint32 version = qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(begin) + 4);
+    if (version < kBsiiMinVersion || version > kBsiiMaxVersion) {
+        error = QString("unsupported binary file version %1").arg(version);
+        return false;
+    }
+
+    BsiiReader reader(begin, end);
+    if (!reader.read(class_name, attribute, unit_name, items)) {
+        error = reader.error;
+        unit_name.clear();
+        items.clear();
+        return false;
+    }
+    ETS_PROFILE_COUNT("binary strings found", items.size());
+    return true;
+}
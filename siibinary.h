@@ -0,0 +1,50 @@
+#ifndef SIIBINARY_H
+#define SIIBINARY_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+// The other two forms in which the game writes .sii files, besides SiiNunit
+// text (see siidocument.h):
+//   ScsC   an encrypted container: a 56 byte header (magic, HMAC, IV and
+//          size of the contents), then the zlib-compressed contents,
+//          encrypted with AES-256 in CBC mode. The contents are a file in
+//          one of the other forms.
+//   BSII   binary SiiNunit: structure definitions (a class and the name and
+//          type of each of its attributes) and units, each laid out as the
+//          values of its structure, in order.
+// Both are only read: files are always written back as text, which the game
+// reads as well.
+class SiiBinary {
+public:
+    enum Format {
+        TextFormat,
+        EncryptedFormat,    // ScsC.
+        BinaryFormat        // BSII.
+    };
+
+    // Bytes of the file, which they point into.
+    struct Span {
+        const char* begin;
+        const char* end;
+    };
+
+    // From the magic bytes; anything else is taken for text.
+    static Format format(const char* begin, const char* end);
+
+    // ScsC: decrypts and inflates [begin, end) into out. The HMAC is not
+    // checked, as its key is not known; a wrong key or damaged data fail to
+    // inflate instead.
+    static bool decrypt(const char* begin, const char* end, QByteArray& out, QString& error);
+
+    // BSII: the items of the array of strings attribute of the first unit of
+    // class_name (ignoring case), and the unit's name as text would have it
+    // ("_nameless.1f0.7a80", or its parts joined by dots). Reading stops at
+    // that unit; a file without one gives no items and a null name.
+    static bool findStrings(const char* begin, const char* end, const QByteArray& class_name,
+                            const QByteArray& attribute, QByteArray& unit_name, QVector<Span>& items,
+                            QString& error);
+};
+
+#endif // SIIBINARY_H
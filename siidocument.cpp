@@ -0,0 +1,589 @@
+#include "siidocument.h"
+#include "profiler.h"
+
+#include <QVarLengthArray>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+// Characters that end keys and unquoted values.
+struct SiiCharClasses {
+    bool space[256];            // Blanks and line breaks.
+    bool key_end[256];
+    bool value_end[256];
+
+    SiiCharClasses()
+    {
+        for (int c = 0; c < 256; c++) {
+            space[c] = (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+            value_end[c] = space[c] || c == '{' || c == '}' || c == '"' || c == '#';
+            key_end[c] = value_end[c] || c == ':' || c == '[' || c == ']' || c == '(' || c == ')';
+        }
+    }
+};
+
+static const SiiCharClasses kSiiChars;
+
+static bool isBlank(const char* begin, const char* end)
+{
+    for (const char* p = begin; p < end; p++) {
+        if (!kSiiChars.space[uchar(*p)]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Builds the nodes of a document in one pass over its text. Nodes are added
+// in document order, so a node's subtree is the nodes right after it.
+class SiiDocumentReader {
+public:
+    SiiDocumentReader(const char* begin, const char* end, QVector<SiiDocument::Node>& nodes);
+
+    bool read();
+    QString error;
+    const char* error_at;
+
+private:
+    const char* base_;
+    const char* p_;
+    const char* end_;
+    const char* line_start_;
+    bool line_clean_;           // Nothing but blanks between line_start_ and p_.
+    QVector<SiiDocument::Node>& nodes_;
+    QVarLengthArray<int, 8> open_;  // Units and blocks not closed yet.
+
+    bool readStatement(const char* begin);
+    int addNode(SiiDocument::NodeType, const char* begin, const char* key);
+    void finishNode(int, const char* after);
+    quint32 endOfLine(const char* after);
+    const char* stringEnd(const char* quote) const;
+    bool fail(const char* at, const QString&);
+};
+
+SiiDocumentReader::SiiDocumentReader(const char* begin, const char* end, QVector<SiiDocument::Node>& nodes):
+error_at(NULL),
+base_(begin),
+p_(begin),
+end_(end),
+line_start_(begin),
+line_clean_(true),
+nodes_(nodes)
+{
+    // The BOM stays in the text, outside of any node.
+    if (end_ - p_ >= 3 && memcmp(p_, "\xEF\xBB\xBF", 3) == 0) {
+        p_ += 3;
+        line_start_ = p_;
+    }
+}
+
+bool SiiDocumentReader::read()
+{
+    while (true) {
+        while (p_ < end_ && kSiiChars.space[uchar(*p_)]) {
+            if (*p_ == '\n') {
+                line_start_ = p_ + 1;
+                line_clean_ = true;
+            }
+            p_++;
+        }
+        if (p_ == end_) {
+            break;
+        }
+
+        const char* begin = line_clean_ ? line_start_ : p_;
+        line_clean_ = false;
+        const char c = *p_;
+
+        if (c == '#' || (c == '/' && end_ - p_ >= 2 && p_[1] == '/')) {
+            const char* line_end = static_cast<const char*>(memchr(p_, '\n', end_ - p_));
+            const int n = addNode(SiiDocument::CommentNode, begin, p_);
+            finishNode(n, line_end != NULL ? line_end : end_);
+        }
+        else if (c == '/' && end_ - p_ >= 2 && p_[1] == '*') {
+            const char* close = p_ + 2;
+            while (close < end_ && !(close[0] == '*' && end_ - close >= 2 && close[1] == '/')) {
+                close++;
+            }
+            if (close == end_) {
+                return fail(p_, "comment without its closing \"*/\"");
+            }
+            const int n = addNode(SiiDocument::CommentNode, begin, p_);
+            finishNode(n, close + 2);
+        }
+        else if (c == '}') {
+            if (open_.isEmpty()) {
+                return fail(p_, "'}' without a matching '{'");
+            }
+            SiiDocument::Node& node = nodes_[open_.last()];
+            open_.removeLast();
+            node.close          = quint32(p_ - base_);
+            node.subtree_end    = nodes_.size();
+            node.end            = endOfLine(p_ + 1);
+        }
+        else if (c == '@') {
+            const char* word = p_;
+            while (p_ < end_ && !kSiiChars.value_end[uchar(*p_)]) {
+                p_++;
+            }
+            if (QByteArray::fromRawData(word, int(p_ - word)) != "@include") {
+                return fail(word, "unknown directive");
+            }
+            while (p_ < end_ && (*p_ == ' ' || *p_ == '\t')) {
+                p_++;
+            }
+            const char* close = (p_ < end_ && *p_ == '"') ? stringEnd(p_) : NULL;
+            if (close == NULL) {
+                return fail(p_, "@include without a quoted file name");
+            }
+            const int n = addNode(SiiDocument::IncludeNode, begin, word);
+            nodes_[n].value         = quint32(p_ + 1 - base_);
+            nodes_[n].value_length  = quint32(close - p_ - 1);
+            nodes_[n].quoted        = true;
+            finishNode(n, close + 1);
+        }
+        else if (kSiiChars.key_end[uchar(c)]) {
+            return fail(p_, QString("unexpected '%1'").arg(QLatin1Char(c)));
+        }
+        else if (!readStatement(begin)) {
+            return false;
+        }
+    }
+
+    if (!open_.isEmpty()) {
+        return fail(base_ + nodes_.at(open_.last()).key, "'{' that is never closed");
+    }
+    return true;
+}
+
+bool SiiDocumentReader::readStatement(const char* begin)
+{
+/*
+Units, blocks and attributes all start with a word. A ':' after it makes it
+an attribute, or a block if a '{' follows the value; a '{' right after it
+makes it a unit. The '{' may be on a later line.
+*/
+    const char* key = p_;
+    while (p_ < end_ && !kSiiChars.key_end[uchar(*p_)]) {
+        p_++;
+    }
+    const int n = addNode(SiiDocument::AttributeNode, begin, key);
+    nodes_[n].key_length = quint32(p_ - key);
+
+    if (p_ < end_ && *p_ == '[') {
+        const char* digits = ++p_;
+        qint64 index = 0;
+        while (p_ < end_ && *p_ >= '0' && *p_ <= '9' && index <= INT_MAX) {
+            index = index * 10 + (*p_++ - '0');
+        }
+        if (p_ == end_ || *p_ != ']' || index > INT_MAX) {
+            return fail(p_, "array index without its closing ']'");
+        }
+        nodes_[n].index = (p_ == digits) ? SiiDocument::kImplicitIndex : int(index);
+        p_++;
+    }
+    while (p_ < end_ && (*p_ == ' ' || *p_ == '\t')) {
+        p_++;
+    }
+
+    if (p_ < end_ && *p_ == ':') {
+        p_++;
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\t')) {
+            p_++;
+        }
+
+        const char* value = p_;
+        if (p_ < end_ && *p_ == '"') {
+            const char* close = stringEnd(p_);
+            if (close == NULL) {
+                return fail(p_, "string without its closing quote");
+            }
+            value++;
+            nodes_[n].quoted = true;
+            p_ = close + 1;
+        }
+        else if (p_ < end_ && *p_ == '(') {
+            while (p_ < end_ && *p_ != ')' && *p_ != '\n') {
+                p_++;
+            }
+            if (p_ == end_ || *p_ != ')') {
+                return fail(value, "'(' without its closing ')'");
+            }
+            p_++;
+        }
+        else {
+            while (p_ < end_ && !kSiiChars.value_end[uchar(*p_)]) {
+                p_++;
+            }
+            if (p_ == value) {
+                return fail(p_, "missing value");
+            }
+        }
+        nodes_[n].value         = quint32(value - base_);
+        nodes_[n].value_length  = quint32((nodes_[n].quoted ? p_ - 1 : p_) - value);
+
+        const char* brace = p_;
+        while (brace < end_ && kSiiChars.space[uchar(*brace)]) {
+            brace++;
+        }
+        if (brace < end_ && *brace == '{' && !nodes_[n].quoted && nodes_[n].index == SiiDocument::kNoIndex) {
+            nodes_[n].type = SiiDocument::BlockNode;
+            open_.append(n);
+            endOfLine(brace + 1);
+            return true;
+        }
+        if (open_.isEmpty()) {
+            return fail(key, "attribute outside of a unit");
+        }
+        finishNode(n, p_);
+        return true;
+    }
+
+    const char* brace = p_;
+    while (brace < end_ && kSiiChars.space[uchar(*brace)]) {
+        brace++;
+    }
+    if (brace < end_ && *brace == '{' && nodes_[n].index == SiiDocument::kNoIndex) {
+        nodes_[n].type = SiiDocument::UnitNode;
+        open_.append(n);
+        endOfLine(brace + 1);
+        return true;
+    }
+    return fail(p_, QString("expected ':' after \"%1\"").arg(QString::fromUtf8(key, int(p_ - key))));
+}
+
+int SiiDocumentReader::addNode(SiiDocument::NodeType type, const char* begin, const char* key)
+{
+    SiiDocument::Node node;
+    node.begin          = quint32(begin - base_);
+    node.end            = node.begin;
+    node.key            = quint32(key - base_);
+    node.key_length     = 0;
+    node.value          = node.key;
+    node.value_length   = 0;
+    node.close          = 0;
+    node.parent         = open_.isEmpty() ? -1 : open_.last();
+    node.subtree_end    = nodes_.size() + 1;
+    node.index          = SiiDocument::kNoIndex;
+    node.type           = quint8(type);
+    node.quoted         = false;
+    nodes_.append(node);
+    return nodes_.size() - 1;
+}
+
+void SiiDocumentReader::finishNode(int n, const char* after)
+{
+    nodes_[n].end = endOfLine(after);
+}
+
+quint32 SiiDocumentReader::endOfLine(const char* after)
+{
+    // What ends at after also takes the rest of its line, if that is blank.
+    p_ = after;
+    const char* q = after;
+    while (q < end_ && (*q == ' ' || *q == '\t' || *q == '\r')) {
+        q++;
+    }
+    if (q == end_ || *q == '\n') {
+        p_ = (q == end_) ? q : q + 1;
+        line_start_ = p_;
+        line_clean_ = true;
+    }
+    return quint32(p_ - base_);
+}
+
+const char* SiiDocumentReader::stringEnd(const char* quote) const
+{
+    const char* line_end = static_cast<const char*>(memchr(quote + 1, '\n', end_ - quote - 1));
+    for (const char* q = (line_end != NULL ? line_end : end_) - 1; q > quote; q--) {
+        if (*q == '"') {
+            return q;
+        }
+    }
+    return NULL;
+}
+
+bool SiiDocumentReader::fail(const char* at, const QString& message)
+{
+    error = message;
+    error_at = at;
+    return false;
+}
+
+
+SiiDocument::SiiDocument():
+insertion_point_(-1),
+moved_text_(false),
+error_offset_(-1)
+{
+}
+
+bool SiiDocument::parse(const QByteArray& text)
+{
+    ETS_PROFILE_SCOPE("SiiDocument::parse");
+
+    text_ = text;
+    nodes_.clear();
+    insertion_point_ = -1;
+    moved_text_ = false;
+    error_.clear();
+    error_offset_ = -1;
+
+    // About one node per entry line, which is the bulk of a live_streams file.
+    nodes_.reserve(text.size() / 48 + 16);
+    SiiDocumentReader reader(text_.constData(), text_.constData() + text_.size(), nodes_);
+    if (!reader.read()) {
+        error_ = reader.error;
+        error_offset_ = reader.error_at - text_.constData();
+        text_.clear();
+        nodes_.clear();
+        return false;
+    }
+    ETS_PROFILE_COUNT("document nodes", nodes_.size());
+    return true;
+}
+
+QString SiiDocument::errorString() const
+{
+    return error_;
+}
+
+qint64 SiiDocument::errorOffset() const
+{
+    return error_offset_;
+}
+
+bool SiiDocument::isEmpty() const
+{
+    return nodes_.isEmpty();
+}
+
+const QByteArray& SiiDocument::text() const
+{
+    return text_;
+}
+
+int SiiDocument::size() const
+{
+    return nodes_.size();
+}
+
+const SiiDocument::Node& SiiDocument::node(int n) const
+{
+    return nodes_.at(n);
+}
+
+QByteArray SiiDocument::key(int n) const
+{
+    return text_.mid(nodes_.at(n).key, nodes_.at(n).key_length);
+}
+
+QByteArray SiiDocument::value(int n) const
+{
+    return text_.mid(nodes_.at(n).value, nodes_.at(n).value_length);
+}
+
+QVector<int> SiiDocument::children(int parent) const
+{
+    QVector<int> res;
+    int n = (parent < 0) ? 0 : parent + 1;
+    const int end = (parent < 0) ? nodes_.size() : nodes_.at(parent).subtree_end;
+    while (n < end) {
+        res.append(n);
+        n = nodes_.at(n).subtree_end;
+    }
+    return res;
+}
+
+int SiiDocument::findBlock(const QByteArray& class_name) const
+{
+    for (int n = 0; n < nodes_.size(); n++) {
+        const Node& node = nodes_.at(n);
+        if (node.type == BlockNode && node.key_length == quint32(class_name.size()) &&
+            qstrnicmp(text_.constData() + node.key, class_name.constData(), class_name.size()) == 0) {
+            return n;
+        }
+    }
+    return -1;
+}
+
+qint64 SiiDocument::lineStart(qint64 offset) const
+{
+    while (offset > 0 && text_.at(int(offset - 1)) != '\n') {
+        offset--;
+    }
+    return offset;
+}
+
+qint64 SiiDocument::lineEnd(qint64 offset) const
+{
+    int end = text_.indexOf('\n', int(offset));
+    if (end == -1) {
+        end = text_.size();
+    }
+    if (end > offset && text_.at(end - 1) == '\r') {
+        end--;
+    }
+    return end;
+}
+
+void SiiDocument::cut(const QVector<int>& nodes, int parent)
+{
+/*
+The nodes become ranges of the text, merged when only blanks lie between
+them. The text is then rebuilt without them, and the nodes left are kept
+rather than parsed again: their offsets move back by the ranges before them,
+and their links to other nodes by the nodes taken out before those.
+*/
+    ETS_PROFILE_SCOPE("SiiDocument::cut");
+
+    const char* text = text_.constData();
+    QVector<quint32> ranges;    // Begin and end of each range.
+    bool adjacent = true;
+    foreach (int n, nodes) {
+        const Node& node = nodes_.at(n);
+        if (!ranges.isEmpty() && isBlank(text + ranges.last(), text + node.begin)) {
+            ranges.last() = node.end;
+            continue;
+        }
+        adjacent = adjacent && ranges.isEmpty();
+        ranges << node.begin << node.end;
+    }
+
+    qint64 insertion_point;
+    if (!ranges.isEmpty()) {
+        insertion_point = ranges.first();
+    }
+    else {
+        const quint32 close = nodes_.at(parent).close;
+        insertion_point = lineStart(close);
+        if (!isBlank(text + insertion_point, text + close)) {
+            insertion_point = close;
+        }
+    }
+
+    QByteArray rest;
+    rest.reserve(text_.size() - (ranges.isEmpty() ? 0 : int(ranges.last() - ranges.first())));
+    quint32 from = 0;
+    for (int i = 0; i < ranges.size(); i += 2) {
+        rest.append(text + from, int(ranges.at(i) - from));
+        from = ranges.at(i + 1);
+    }
+    rest.append(text + from, text_.size() - int(from));
+
+    // Bytes taken out up to the end of each range.
+    QVector<quint32> ends;
+    QVector<quint32> removed;
+    quint32 total = 0;
+    for (int i = 0; i < ranges.size(); i += 2) {
+        total += ranges.at(i + 1) - ranges.at(i);
+        ends << ranges.at(i + 1);
+        removed << total;
+    }
+
+    QVector<Node> kept;
+    kept.reserve(nodes_.size() - nodes.size());
+    int next = 0;
+    for (int i = 0; i <= nodes.size(); i++) {
+        const int until = (i < nodes.size()) ? nodes.at(i) : nodes_.size();
+        for (; next < until; next++) {
+            Node node = nodes_.at(next);
+            node.begin          = shiftedOffset(ends, removed, node.begin);
+            node.end            = shiftedOffset(ends, removed, node.end);
+            node.key            = shiftedOffset(ends, removed, node.key);
+            node.value          = shiftedOffset(ends, removed, node.value);
+            node.close          = shiftedOffset(ends, removed, node.close);
+            node.parent         = shiftedIndex(nodes, node.parent);
+            node.subtree_end    = shiftedIndex(nodes, node.subtree_end);
+            kept.append(node);
+        }
+        next = until + 1;
+    }
+
+    // Nodes that shared their lines with the ones taken out may now have them
+    // to themselves, or the other way around: their spans are found again as
+    // parse() finds them.
+    text_ = rest;
+    const char* left = text_.constData();
+    const quint32 size = quint32(text_.size());
+    for (int n = 0; n < kept.size() && !ranges.isEmpty(); n++) {
+        Node& node = kept[n];
+        if (node.key >= ranges.first()) {   // Before it, lines are the same.
+            const qint64 line = lineStart(node.key);
+            node.begin = isBlank(left + line, left + node.key) ? quint32(line) : node.key;
+        }
+
+        quint32 end = node.end;
+        if (end > 0 && left[end - 1] == '\n') {
+            continue;   // Already up to its line break.
+        }
+        while (end < size && (left[end] == ' ' || left[end] == '\t' || left[end] == '\r')) {
+            end++;
+        }
+        if (end == size) {
+            node.end = end;
+        }
+        else if (left[end] == '\n') {
+            node.end = end + 1;
+        }
+    }
+    nodes_ = kept;
+    insertion_point_ = insertion_point;
+    moved_text_ = !adjacent;
+    error_.clear();
+    error_offset_ = -1;
+}
+
+quint32 SiiDocument::shiftedOffset(const QVector<quint32>& ends, const QVector<quint32>& removed, quint32 offset)
+{
+    // The nodes that are left have no offsets inside the ranges.
+    const int before = int(std::upper_bound(ends.begin(), ends.end(), offset) - ends.begin());
+    return before > 0 ? offset - removed.at(before - 1) : offset;
+}
+
+qint32 SiiDocument::shiftedIndex(const QVector<int>& nodes, qint32 index)
+{
+    if (index < 0) {
+        return index;
+    }
+    return index - qint32(std::lower_bound(nodes.begin(), nodes.end(), index) - nodes.begin());
+}
+
+bool SiiDocument::hasMovedText() const
+{
+    return moved_text_;
+}
+
+qint64 SiiDocument::insertionPoint() const
+{
+    return insertion_point_;
+}
+
+void SiiDocument::setInsertionPoint(qint64 offset)
+{
+    insertion_point_ = offset;
+}
+
+bool SiiDocument::replaceText(qint64 begin, qint64 end, const QByteArray& replacement)
+{
+    qint64 insertion_point = insertion_point_;
+    if (insertion_point >= end) {
+        insertion_point += replacement.size() - (end - begin);
+    }
+    else if (insertion_point > begin) {
+        insertion_point = begin;
+    }
+
+    const bool moved_text = moved_text_;
+
+    QByteArray text = text_.left(int(begin));
+    text.append(replacement);
+    text.append(text_.constData() + end, text_.size() - int(end));
+    if (!parse(text)) {
+        return false;
+    }
+    insertion_point_ = insertion_point;
+    moved_text_ = moved_text;
+    return true;
+}
@@ -0,0 +1,106 @@
+#ifndef SIIDOCUMENT_H
+#define SIIDOCUMENT_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+// A SiiNunit text document ("SiiNunit { class : name { key: value ... } }")
+// as a tree of nodes over its text. The nodes only hold offsets into the
+// text, which is kept as it is: writing the document back is writing its text,
+// so nothing in it (comments, spacing, units and attributes nobody reads) is
+// ever lost.
+//
+// Grammar, as far as it is checked:
+//   document   := unit*
+//   unit       := tag '{' statement* '}'                        e.g. SiiNunit
+//   statement  := block | attribute | comment | include
+//   block      := class ':' name '{' statement* '}'
+//   attribute  := key ('[' index? ']')? ':' value
+//   value      := string | '(' ... ')' | word
+//   comment    := '#' ... | '//' ... | '/*' ... '*/'
+//   include    := '@include' string
+// A string ends at the last '"' of its line, as the game's own files (and
+// the entries we write, which do not escape quotes) expect.
+class SiiDocument {
+public:
+    enum NodeType {
+        UnitNode,
+        BlockNode,
+        AttributeNode,
+        CommentNode,
+        IncludeNode
+    };
+
+    static const int kNoIndex       = -1;   // "key: value"
+    static const int kImplicitIndex = -2;   // "key[]: value"
+
+    // Offsets are from the start of the text. A node that has its lines to
+    // itself spans them whole, from the indentation of the first one to the
+    // line break of the last one.
+    struct Node {
+        quint32 begin;
+        quint32 end;
+        quint32 key;            // Unit tag, block class or attribute name...
+        quint32 key_length;     // ...without the index.
+        quint32 value;          // Block name, attribute value (without its
+        quint32 value_length;   // quotes) or included file.
+        quint32 close;          // Units and blocks: their '}'.
+        qint32 parent;          // -1 for units.
+        qint32 subtree_end;     // Node after the last one of its subtree.
+        qint32 index;           // Array items: their index, or kImplicitIndex.
+        quint8 type;
+        bool quoted;            // Whether the value is a string.
+    };
+
+    SiiDocument();
+
+    // Replaces the document. The text is shared, not copied: one made by
+    // QByteArray::fromRawData() has to outlive the document (cut() leaves
+    // it with a copy of what remains). On a syntax error the document is
+    // left empty, and the error is kept.
+    bool parse(const QByteArray&);
+    QString errorString() const;
+    qint64 errorOffset() const;
+
+    bool isEmpty() const;
+    const QByteArray& text() const;     // What is written back.
+    int size() const;
+    const Node& node(int) const;
+    QByteArray key(int) const;
+    QByteArray value(int) const;        // Strings still escaped.
+
+    QVector<int> children(int parent) const;    // -1 for the units.
+    int findBlock(const QByteArray& class_name) const;  // Ignoring case; -1 if none.
+    qint64 lineStart(qint64 offset) const;
+    qint64 lineEnd(qint64 offset) const;        // Before its line break.
+
+    // Takes the given nodes (leaves, children of parent, in document order)
+    // out of the text, leaving the insertion point where the first of them
+    // was or, with none, just before parent's '}'. If they were not next to
+    // each other (but for blanks), whatever was between them is now after
+    // the insertion point, and hasMovedText() tells so.
+    void cut(const QVector<int>& nodes, int parent);
+    bool hasMovedText() const;
+
+    // Where content that is not part of the document goes (see cut()), -1
+    // if there is none. Kept in place by replaceText().
+    qint64 insertionPoint() const;
+    void setInsertionPoint(qint64);
+
+    // Replaces [begin, end) of the text and parses it again.
+    bool replaceText(qint64 begin, qint64 end, const QByteArray&);
+
+private:
+    QByteArray text_;
+    QVector<Node> nodes_;
+    qint64 insertion_point_;
+    bool moved_text_;
+    QString error_;
+    qint64 error_offset_;
+
+    static quint32 shiftedOffset(const QVector<quint32>& ends, const QVector<quint32>& removed, quint32);
+    static qint32 shiftedIndex(const QVector<int>& nodes, qint32);
+};
+
+#endif // SIIDOCUMENT_H
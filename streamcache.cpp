@@ -0,0 +1,253 @@
+#include "streamcache.h"
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSharedPointer>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+
+static const char kMagic[8] = {'E', 'T', 'S', 'R', 'M', 'C', 'A', '\0'};
+static const quint32 kVersion = 3;
+static const quint32 kByteOrder = 0x01020304;
+
+struct CacheHeader {
+    char magic[8];
+    quint32 version;
+    quint32 byte_order;         // kByteOrder, as written by the machine.
+    qint64 file_size;           // Of the .sii file the entries come from...
+    qint64 file_modified;       // ...its modification time (ms since the epoch)...
+    char md5[16];               // ...and its contents.
+    quint32 entries;
+    quint32 arena_length;       // In UTF-16 units.
+    quint32 definition_length;  // Same.
+    quint32 has_definition;     // The line may be missing, or empty.
+    quint32 originals;          // Entries with their original text...
+    quint32 originals_length;   // ...and its total size, in bytes.
+    quint32 skeleton_length;    // In bytes, 0 if there is no skeleton.
+    quint32 insertion_point;    // Of the skeleton.
+    quint32 checksum;           // qChecksum() of everything above.
+    quint32 reserved;
+};
+Q_STATIC_ASSERT(sizeof(CacheHeader) == 88);
+
+static quint32 headerChecksum(const CacheHeader& header)
+{
+    return qChecksum(reinterpret_cast<const char*>(&header), offsetof(CacheHeader, checksum));
+}
+
+
+QString StreamCache::cachePath(const QString& file)
+{
+    return file + ".cache";
+}
+
+bool StreamCache::read(const QString& file, ParsedBlock& block)
+{
+/*
+Everything in the cache is checked before it is used: the header against the
+file and itself, the size of the cache against the header, and every span
+against the arena. The checks are cheap but for the hash of the file, which
+is still much faster than parsing it.
+The spans and offsets are copied (they are small and the parser edits them),
+while the arena, the bulk of the cache, stays in the mapping, which the list
+keeps open for as long as it uses it.
+*/
+    const QFileInfo info(file);
+    QSharedPointer<QFile> cache(new QFile(cachePath(file)));
+    if (!info.isFile() || !cache->open(QIODevice::ReadOnly) ||
+        cache->size() < qint64(sizeof(CacheHeader))) {
+        return false;
+    }
+    const uchar* data = cache->map(0, cache->size());
+    if (data == NULL) {
+        return false;
+    }
+
+    CacheHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+        header.byte_order != kByteOrder || header.checksum != headerChecksum(header) ||
+        header.file_size != info.size() ||
+        header.file_modified != info.lastModified().toMSecsSinceEpoch()) {
+        return false;
+    }
+
+    const qint64 expected_size = qint64(sizeof(CacheHeader))
+        + qint64(header.entries) * qint64(sizeof(qint64) + sizeof(StreamSpan))
+        + (qint64(header.definition_length) + header.arena_length) * qint64(sizeof(QChar))
+        + qint64(header.originals) * qint64(2 * sizeof(quint32)) + header.originals_length
+        + header.skeleton_length;
+    if (cache->size() != expected_size || header.arena_length > quint32(INT_MAX) ||
+        fileHash(file) != QByteArray(header.md5, sizeof(header.md5))) {
+        return false;
+    }
+
+    const uchar* offsets    = data + sizeof(CacheHeader);
+    const uchar* spans      = offsets + qint64(header.entries) * sizeof(qint64);
+    const QChar* definition = reinterpret_cast<const QChar*>(spans + qint64(header.entries) * sizeof(StreamSpan));
+    const QChar* arena      = definition + header.definition_length;
+    const uchar* originals  = reinterpret_cast<const uchar*>(arena + header.arena_length);
+    const char* original    = reinterpret_cast<const char*>(originals + qint64(header.originals) * 2 * sizeof(quint32));
+    const char* skeleton    = original + header.originals_length;
+
+    QVector<StreamSpan> list(header.entries);
+    memcpy(list.data(), spans, list.size() * sizeof(StreamSpan));
+    for (int i = 0; i < list.size(); i++) {
+        const StreamSpan& s = list.at(i);
+        if (qint64(s.offset) + s.url_length + s.name_length > header.arena_length) {
+            return false;
+        }
+    }
+
+    // The table of originals is read as it goes (it is not aligned).
+    QVector<int> original_rows;
+    QList<QByteArray> original_texts;
+    qint64 original_end = 0;
+    for (quint32 i = 0; i < header.originals; i++) {
+        quint32 row_length[2];
+        memcpy(row_length, originals + i * sizeof(row_length), sizeof(row_length));
+        if (row_length[0] >= header.entries || original_end + row_length[1] > header.originals_length) {
+            return false;
+        }
+        original_rows.append(int(row_length[0]));
+        original_texts.append(QByteArray(original + original_end, int(row_length[1])));
+        original_end += row_length[1];
+    }
+
+    // The skeleton is small, and parsed again rather than stored as nodes.
+    SiiDocument document;
+    if (header.skeleton_length > 0 &&
+        (header.insertion_point > header.skeleton_length ||
+         !document.parse(QByteArray(skeleton, int(header.skeleton_length))))) {
+        return false;
+    }
+    if (!document.isEmpty()) {
+        document.setInsertionPoint(header.insertion_point);
+    }
+
+    block.offsets.resize(header.entries);
+    memcpy(block.offsets.data(), offsets, block.offsets.size() * sizeof(qint64));
+    block.live_stream_def_line = header.has_definition ? QString(definition, header.definition_length) : QString();
+    block.streams.setRawData(arena, int(header.arena_length), list, cache);
+    for (int i = 0; i < original_rows.size(); i++) {
+        block.streams.setOriginalText(original_rows.at(i), original_texts.at(i));
+    }
+    block.skeleton = document;
+    return true;
+}
+
+bool StreamCache::write(const QString& file, const ParsedBlock& block)
+{
+/*
+The entries are written without the garbage their list may have, so the
+spans are recomputed on the way. Like saves, this goes through a QSaveFile:
+an interrupted write leaves the previous cache (or none) behind.
+*/
+    static const int kWriteChunk = 1 << 20;
+
+    const StreamList& streams = block.streams;
+    if (block.offsets.size() != streams.size()) {
+        return false;
+    }
+
+    const QFileInfo info(file);
+    const QByteArray md5 = fileHash(file);
+    if (md5.size() != 16) {
+        return false;
+    }
+
+    QSaveFile out(cachePath(file));
+    if (!out.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version              = kVersion;
+    header.byte_order           = kByteOrder;
+    header.file_size            = info.size();
+    header.file_modified        = info.lastModified().toMSecsSinceEpoch();
+    memcpy(header.md5, md5.constData(), sizeof(header.md5));
+    header.entries              = streams.size();
+    header.definition_length    = block.live_stream_def_line.size();
+    header.has_definition       = !block.live_stream_def_line.isNull();
+    if (block.skeleton.insertionPoint() >= 0) {
+        header.skeleton_length  = block.skeleton.text().size();
+        header.insertion_point  = quint32(block.skeleton.insertionPoint());
+    }
+
+    QVector<StreamSpan> spans(streams.size());
+    QVector<quint32> originals;
+    quint32 offset = 0;
+    for (int i = 0; i < streams.size(); i++) {
+        spans[i].offset         = offset;
+        spans[i].url_length     = streams.url(i).size();
+        spans[i].name_length    = streams.name(i).size();
+        offset += spans[i].url_length + spans[i].name_length;
+
+        const QByteArray original = streams.originalText(i);
+        if (!original.isNull()) {
+            originals << quint32(i) << quint32(original.size());
+            header.originals_length += original.size();
+        }
+    }
+    header.arena_length         = offset;
+    header.originals            = originals.size() / 2;
+    header.checksum             = headerChecksum(header);
+
+    QByteArray buffer;
+    buffer.reserve(kWriteChunk + kWriteChunk / 4);
+    buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    buffer.append(reinterpret_cast<const char*>(block.offsets.constData()), block.offsets.size() * sizeof(qint64));
+    buffer.append(reinterpret_cast<const char*>(spans.constData()), spans.size() * sizeof(StreamSpan));
+    buffer.append(reinterpret_cast<const char*>(block.live_stream_def_line.constData()),
+                  block.live_stream_def_line.size() * sizeof(QChar));
+
+    for (int i = 0; i < streams.size(); i++) {
+        const QStringRef url = streams.url(i);
+        const QStringRef name = streams.name(i);
+        buffer.append(reinterpret_cast<const char*>(url.unicode()), url.size() * sizeof(QChar));
+        buffer.append(reinterpret_cast<const char*>(name.unicode()), name.size() * sizeof(QChar));
+
+        if (buffer.size() >= kWriteChunk) {
+            if (out.write(buffer) != buffer.size()) {
+                return false;   // QSaveFile discards everything.
+            }
+            buffer.resize(0);
+        }
+    }
+
+    buffer.append(reinterpret_cast<const char*>(originals.constData()), originals.size() * sizeof(quint32));
+    for (int i = 0; i < originals.size(); i += 2) {
+        buffer.append(streams.originalText(originals.at(i)));
+    }
+    if (header.skeleton_length > 0) {
+        buffer.append(block.skeleton.text());
+    }
+    return out.write(buffer) == buffer.size() && out.commit();
+}
+
+QByteArray StreamCache::fileHash(const QString& file)
+{
+    QFile in(file);
+    if (!in.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    const qint64 size = in.size();
+    const uchar* data = size > 0 ? in.map(0, size) : NULL;
+    if (data != NULL) {
+        for (qint64 done = 0; done < size; done += 1 << 30) {
+            hash.addData(reinterpret_cast<const char*>(data) + done, int(qMin(size - done, qint64(1 << 30))));
+        }
+    }
+    else if (!hash.addData(&in)) {
+        return QByteArray();
+    }
+    return hash.result();
+}
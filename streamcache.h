@@ -0,0 +1,40 @@
+#ifndef STREAMCACHE_H
+#define STREAMCACHE_H
+
+#include <QByteArray>
+#include <QString>
+
+#include "parser.h"
+
+// Binary sidecar of a .sii file ("<file>.cache") holding its entries as the
+// readers decode them, so that an unchanged file can be reopened without
+// parsing it again. The cache is tied to the size, modification time and MD5
+// of the file, and its text is laid out as a StreamList arena, which the list
+// uses straight from the mapped cache.
+//
+// Layout (native byte order, which the header records):
+//   header         88 bytes, see streamcache.cpp
+//   offsets        qint64 per entry, position of its line in the .sii file
+//   spans          StreamSpan per entry, into the arena below
+//   definition     UTF-16 live_stream_def line
+//   arena          UTF-16 text of the entries, URL then name, in list order
+//   originals      row and length (quint32 each) of every entry with an
+//                  original text (see StreamList::originalText()), then
+//                  their bytes, in the same order
+//   skeleton       text of the file's skeleton (see Parser::parseEntries()),
+//                  if it has one
+class StreamCache {
+public:
+    static QString cachePath(const QString& file);
+
+    // Both fail (returning false) rather than touch anything they are not
+    // sure about: a cache that is missing, stale, truncated or from another
+    // version is simply not read.
+    static bool read(const QString& file, ParsedBlock&);
+    static bool write(const QString& file, const ParsedBlock&);
+
+private:
+    static QByteArray fileHash(const QString&);     // Empty if it cannot be read.
+};
+
+#endif // STREAMCACHE_H
@@ -0,0 +1,361 @@
+#include "streamchecker.h"
+#include "parser.h"
+
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QTimer>
+#include <QUrl>
+
+QString CheckResult::summary() const
+{
+    switch (status) {
+    case Online:
+        return icy_bitrate > 0 ? QString("Online (%1 kbps)").arg(icy_bitrate) : QString("Online");
+    case Offline:
+        return QString("Offline (HTTP %1)").arg(http_status);
+    case Timeout:
+        return QString("Timed out");
+    default:
+        return QString("Error: %1").arg(error);
+    }
+}
+
+
+StreamChecker::StreamChecker(QObject *parent) :
+    QObject(parent),
+    network_(new QNetworkAccessManager(this)),
+    max_concurrent_(16),
+    max_per_host_(2),
+    timeout_(10000),
+    cache_ttl_(600),
+    queued_count_(0)
+{
+    qRegisterMetaType<CheckResult>("CheckResult");
+    clock_.start();
+}
+
+
+void StreamChecker::setMaxConcurrent(int n)
+{
+    max_concurrent_ = qMax(1, n);
+}
+
+
+int StreamChecker::maxConcurrent() const
+{
+    return max_concurrent_;
+}
+
+
+void StreamChecker::setMaxPerHost(int n)
+{
+    max_per_host_ = qMax(1, n);
+}
+
+
+int StreamChecker::maxPerHost() const
+{
+    return max_per_host_;
+}
+
+
+void StreamChecker::setTimeout(int msecs)
+{
+    timeout_ = msecs;
+}
+
+
+int StreamChecker::timeout() const
+{
+    return timeout_;
+}
+
+
+void StreamChecker::setCacheTtl(int secs)
+{
+    cache_ttl_ = secs;
+}
+
+
+int StreamChecker::cacheTtl() const
+{
+    return cache_ttl_;
+}
+
+
+int StreamChecker::check(const QStringList& urls)
+{
+    int res = 0;
+    QSet<QString> answered;     // From the cache, in this call.
+    foreach (const QString& url, urls) {
+        const QString key = Parser::normalizeUrl(url);
+        if (pending_.contains(key) || answered.contains(key)) {
+            continue;
+        }
+        res++;
+
+        CheckResult cached;
+        if (cachedResult(url, &cached)) {
+            answered.insert(key);
+            emit checked(url, cached);
+            continue;
+        }
+
+        const QString host = QUrl(url).host().toLower();
+        if (!queued_.contains(host)) {
+            hosts_.append(host);
+        }
+        queued_[host].enqueue(url);
+        queued_count_++;
+        pending_.insert(key);
+    }
+
+    startProbes();
+    if (!isRunning()) {
+        emit finished();
+    }
+    return res;
+}
+
+
+void StreamChecker::cancel()
+{
+    if (!isRunning()) {
+        return;
+    }
+
+    queued_.clear();
+    hosts_.clear();
+    queued_count_ = 0;
+    pending_.clear();
+    active_per_host_.clear();
+
+    QList<QNetworkReply*> replies = active_.keys();
+    active_.clear();
+    foreach (QNetworkReply* reply, replies) {
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+    }
+    emit finished();
+}
+
+
+bool StreamChecker::isRunning() const
+{
+    return !active_.isEmpty() || queued_count_ > 0;
+}
+
+
+int StreamChecker::pendingCount() const
+{
+    return active_.size() + queued_count_;
+}
+
+
+bool StreamChecker::cachedResult(const QString& url, CheckResult* result) const
+{
+    QHash<QString, CheckResult>::const_iterator it = cache_.constFind(Parser::normalizeUrl(url));
+    if (it == cache_.constEnd() || it->checked.secsTo(QDateTime::currentDateTimeUtc()) >= cache_ttl_) {
+        return false;
+    }
+    *result = it.value();
+    return true;
+}
+
+
+void StreamChecker::clearCache()
+{
+    cache_.clear();
+}
+
+
+void StreamChecker::startProbes()
+{
+/*
+Goes round the hosts with waiting URLs, starting one probe for each host that
+is below its limit, until the global limit is reached or every host is full.
+*/
+    int full_hosts = 0;
+    while (active_.size() < max_concurrent_ && full_hosts < hosts_.size()) {
+        const QString host = hosts_.takeFirst();
+        if (active_per_host_.value(host) >= max_per_host_) {
+            hosts_.append(host);
+            full_hosts++;
+            continue;
+        }
+        full_hosts = 0;
+
+        QQueue<QString>& queue = queued_[host];
+        const QString url = queue.dequeue();
+        queued_count_--;
+        if (queue.isEmpty()) {
+            queued_.remove(host);
+        }
+        else {
+            hosts_.append(host);
+        }
+        startProbe(url, host);
+    }
+}
+
+
+void StreamChecker::startProbe(const QString& url, const QString& host)
+{
+    QNetworkRequest request((QUrl(url)));
+    request.setRawHeader("Icy-MetaData", "1");
+    request.setRawHeader("User-Agent", "ETSRadioManager");
+    request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+
+    QNetworkReply* reply = network_->get(request);
+    connect(reply, SIGNAL(metaDataChanged()), this, SLOT(replyMetaDataChanged()));
+    connect(reply, SIGNAL(readyRead()), this, SLOT(replyReadyRead()));
+    connect(reply, SIGNAL(finished()), this, SLOT(replyFinished()));
+
+    // Owned by the reply, which is how probeTimedOut() finds it.
+    QTimer* timer = new QTimer(reply);
+    timer->setSingleShot(true);
+    connect(timer, SIGNAL(timeout()), this, SLOT(probeTimedOut()));
+    timer->start(timeout_);
+
+    Probe probe;
+    probe.url           = url;
+    probe.host          = host;
+    probe.timer         = timer;
+    probe.started_ms    = clock_.elapsed();
+    probe.bytes         = 0;
+    active_.insert(reply, probe);
+    active_per_host_[host]++;
+}
+
+
+void StreamChecker::replyMetaDataChanged()
+{
+    QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
+    QHash<QNetworkReply*, Probe>::iterator it = active_.find(reply);
+    if (it == active_.end()) {
+        return;
+    }
+
+    readHeaders(reply, it->result);
+    it->result.latency_ms = clock_.elapsed() - it->started_ms;
+
+    // Redirections are followed; errors need no data to be told apart.
+    if (it->result.http_status >= 400) {
+        CheckResult result = it->result;
+        result.status = CheckResult::Offline;
+        complete(reply, result);
+    }
+}
+
+
+void StreamChecker::replyReadyRead()
+{
+    QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
+    QHash<QNetworkReply*, Probe>::iterator it = active_.find(reply);
+    if (it == active_.end()) {
+        return;
+    }
+
+    // The data itself is of no interest: streams never end, so the first
+    // bytes are proof enough that the station is on the air.
+    it->bytes += reply->readAll().size();
+    const int status = it->result.http_status;
+    if (it->bytes > 0 && (status == 0 || (status >= 200 && status < 300))) {
+        CheckResult result = it->result;
+        result.status = CheckResult::Online;
+        complete(reply, result);
+    }
+}
+
+
+void StreamChecker::replyFinished()
+{
+    QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
+    QHash<QNetworkReply*, Probe>::iterator it = active_.find(reply);
+    if (it == active_.end()) {
+        return;
+    }
+
+    CheckResult result = it->result;
+    readHeaders(reply, result);
+    if (reply->error() == QNetworkReply::NoError) {
+        // Finished without data (e.g. a playlist that happened to be empty).
+        result.status = (result.http_status >= 200 && result.http_status < 300)
+                        ? CheckResult::Online : CheckResult::Offline;
+    }
+    else if (result.http_status >= 400) {
+        result.status = CheckResult::Offline;
+    }
+    else {
+        result.status = CheckResult::Error;
+        result.error = reply->errorString();
+    }
+    complete(reply, result);
+}
+
+
+void StreamChecker::probeTimedOut()
+{
+    QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender()->parent());
+    QHash<QNetworkReply*, Probe>::iterator it = active_.find(reply);
+    if (it == active_.end()) {
+        return;
+    }
+
+    CheckResult result = it->result;
+    result.status = CheckResult::Timeout;
+    complete(reply, result);
+}
+
+
+void StreamChecker::complete(QNetworkReply* reply, const CheckResult& result)
+{
+    QHash<QNetworkReply*, Probe>::iterator it = active_.find(reply);
+    const Probe probe = it.value();
+    active_.erase(it);
+    if (--active_per_host_[probe.host] <= 0) {
+        active_per_host_.remove(probe.host);
+    }
+    pending_.remove(Parser::normalizeUrl(probe.url));
+
+    // Aborting emits finished(), which must not reach us anymore.
+    reply->disconnect(this);
+    reply->abort();
+    reply->deleteLater();
+
+    CheckResult res = result;
+    res.checked = QDateTime::currentDateTimeUtc();
+    if (res.latency_ms == 0) {
+        res.latency_ms = clock_.elapsed() - probe.started_ms;
+    }
+    cache_.insert(Parser::normalizeUrl(probe.url), res);
+    emit checked(probe.url, res);
+
+    startProbes();
+    if (!isRunning()) {
+        emit finished();
+    }
+}
+
+
+void StreamChecker::readHeaders(QNetworkReply* reply, CheckResult& result)
+{
+    const QVariant status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+    if (status.isValid()) {
+        result.http_status = status.toInt();
+    }
+    if (reply->hasRawHeader("Content-Type")) {
+        result.content_type = QString::fromLatin1(reply->rawHeader("Content-Type"));
+    }
+    if (reply->hasRawHeader("icy-name")) {
+        result.icy_name = QString::fromUtf8(reply->rawHeader("icy-name"));
+    }
+    if (reply->hasRawHeader("icy-br")) {
+        result.icy_bitrate = reply->rawHeader("icy-br").toInt();
+    }
+    if (reply->hasRawHeader("icy-metaint")) {
+        result.icy_metaint = reply->rawHeader("icy-metaint").toInt();
+    }
+}
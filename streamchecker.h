@@ -0,0 +1,119 @@
+#ifndef STREAMCHECKER_H
+#define STREAMCHECKER_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMetaType>
+#include <QQueue>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+class QNetworkAccessManager;
+class QNetworkReply;
+class QTimer;
+
+// Outcome of probing a stream URL.
+struct CheckResult {
+    enum Status {
+        Online,         // Answered with 2xx and started sending data.
+        Offline,        // Answered with an error status.
+        Timeout,        // No answer (or no data) in time.
+        Error           // Connection or protocol error.
+    };
+
+    Status status;
+    int http_status;    // 0 if there was no HTTP answer.
+    QString content_type;
+    QString icy_name;   // ICY (SHOUTcast/Icecast) headers, if any.
+    int icy_bitrate;
+    int icy_metaint;    // Bytes between metadata blocks, 0 without metadata.
+    qint64 latency_ms;  // Until the answer (or the failure).
+    QString error;
+    QDateTime checked;
+
+    CheckResult(): status(Error), http_status(0), icy_bitrate(0), icy_metaint(0), latency_ms(0) {}
+    QString summary() const;
+};
+
+Q_DECLARE_METATYPE(CheckResult)
+
+
+// Probes stream URLs with a GET that asks for ICY metadata and is aborted as
+// soon as the headers and the first bytes of audio have arrived.
+// At most maxConcurrent() probes run at once, and at most maxPerHost() of them
+// against the same host. Results are cached by normalized URL for cacheTtl()
+// seconds, so checking a list again only probes what expired.
+class StreamChecker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit StreamChecker(QObject *parent = 0);
+
+    void setMaxConcurrent(int);
+    int maxConcurrent() const;
+    void setMaxPerHost(int);
+    int maxPerHost() const;
+    void setTimeout(int msecs);
+    int timeout() const;
+    void setCacheTtl(int secs);
+    int cacheTtl() const;
+
+    // Queues the URLs and returns how many checked() signals to expect
+    // (repeated URLs are checked once). Those with a fresh cached result are
+    // answered right away, before this returns.
+    int check(const QStringList&);
+    void cancel();                  // Drops the queue and aborts the probes.
+    bool isRunning() const;
+    int pendingCount() const;       // Queued or being probed.
+
+    bool cachedResult(const QString& url, CheckResult*) const;
+    void clearCache();
+
+signals:
+    void checked(const QString& url, const CheckResult&);
+    void finished();                // Nothing left to check.
+
+private slots:
+    void replyMetaDataChanged();
+    void replyReadyRead();
+    void replyFinished();
+    void probeTimedOut();
+
+private:
+    struct Probe {
+        QString url;
+        QString host;
+        QTimer* timer;
+        qint64 started_ms;
+        qint64 bytes;
+        CheckResult result;
+    };
+
+    QNetworkAccessManager* network_;
+    QElapsedTimer clock_;
+    int max_concurrent_;
+    int max_per_host_;
+    int timeout_;
+    int cache_ttl_;
+
+    // Waiting URLs by host, and the hosts in the order they are served, so
+    // that one host with many entries does not hold up the others.
+    QHash<QString, QQueue<QString> > queued_;
+    QStringList hosts_;
+    int queued_count_;
+    QHash<QString, int> active_per_host_;
+    QHash<QNetworkReply*, Probe> active_;
+    QHash<QString, CheckResult> cache_;
+    QSet<QString> pending_;         // Queued or active, to skip repeated URLs.
+
+    void startProbes();
+    void startProbe(const QString& url, const QString& host);
+    void complete(QNetworkReply*, const CheckResult&);
+    static void readHeaders(QNetworkReply*, CheckResult&);
+};
+
+#endif // STREAMCHECKER_H
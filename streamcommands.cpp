@@ -0,0 +1,185 @@
+#include "streamcommands.h"
+
+#include <algorithm>
+
+// Rows in ascending order, without repetitions.
+static QList<int> sortedRows(QList<int> rows)
+{
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    return rows;
+}
+
+
+EditStreamCommand::EditStreamCommand(StreamTableModel* model, int row, const Stream& stream):
+    QUndoCommand(QObject::tr("Edit entry")),
+    model_(model),
+    row_(row),
+    old_(model->parser()->streamAt(row)),
+    new_(stream)
+{
+}
+
+void EditStreamCommand::undo()
+{
+    model_->editStream(row_, old_);
+}
+
+void EditStreamCommand::redo()
+{
+    model_->editStream(row_, new_);
+}
+
+
+InsertStreamCommand::InsertStreamCommand(StreamTableModel* model, const Stream& stream):
+    QUndoCommand(QObject::tr("Insert entry")),
+    model_(model),
+    stream_(stream)
+{
+}
+
+void InsertStreamCommand::undo()
+{
+    model_->removeStream(model_->rowCount() - 1);
+}
+
+void InsertStreamCommand::redo()
+{
+    model_->insertStream(stream_);
+}
+
+
+RemoveStreamsCommand::RemoveStreamsCommand(StreamTableModel* model, QList<int> rows, const QString& text):
+    QUndoCommand(text),
+    model_(model),
+    rows_(sortedRows(rows))
+{
+}
+
+void RemoveStreamsCommand::undo()
+{
+    model_->insertStreams(rows_, removed_);
+    removed_.clear();
+}
+
+void RemoveStreamsCommand::redo()
+{
+    // The entries are only kept while they are removed.
+    removed_.reserve(rows_.size());
+    foreach (int row, rows_) {
+        removed_.append(model_->parser()->streamAt(row));
+    }
+    model_->removeStreams(rows_);
+}
+
+
+MoveStreamsCommand::MoveStreamsCommand(StreamTableModel* model, QList<int> rows, int target):
+    QUndoCommand(QObject::tr("Move entries")),
+    model_(model),
+    rows_(sortedRows(rows)),
+    target_(target),
+    first_(target)
+{
+}
+
+void MoveStreamsCommand::undo()
+{
+    model_->restoreMovedStreams(rows_, target_);
+}
+
+void MoveStreamsCommand::redo()
+{
+    first_ = model_->moveStreams(rows_, target_);
+}
+
+int MoveStreamsCommand::id() const
+{
+    return Id;
+}
+
+bool MoveStreamsCommand::mergeWith(const QUndoCommand* other)
+{
+/*
+Moving the same entry several times in a row (say, pressing "move down" over
+and over) is a single step of the history: it goes from where it was before
+the first move to where the last one left it.
+*/
+    const MoveStreamsCommand* next = static_cast<const MoveStreamsCommand*>(other);
+    if (rows_.size() != 1 || next->rows_.size() != 1 || next->rows_.first() != first_) {
+        return false;
+    }
+
+    // Moving a single row before target leaves it at target, or at target - 1
+    // if it was above it.
+    const int from = rows_.first();
+    first_ = next->first_;
+    target_ = (from < first_) ? first_ + 1 : first_;
+    return true;
+}
+
+
+SortStreamsCommand::SortStreamsCommand(StreamTableModel* model, const QVector<int>& order, const QString& text):
+    QUndoCommand(text),
+    model_(model),
+    order_(order)
+{
+}
+
+void SortStreamsCommand::undo()
+{
+    // Back where each entry came from: the inverse permutation.
+    QVector<int> inverse(order_.size());
+    for (int i = 0; i < order_.size(); i++) {
+        inverse[order_.at(i)] = i;
+    }
+    model_->reorderStreams(inverse);
+}
+
+void SortStreamsCommand::redo()
+{
+    model_->reorderStreams(order_);
+}
+
+
+MergeStreamsCommand::MergeStreamsCommand(StreamTableModel* model, const StreamMerger& merger):
+    QUndoCommand(QObject::tr("Merge files")),
+    model_(model),
+    replaced_rows_(merger.replacedRows()),
+    new_(merger.replacements()),
+    first_added_(model->rowCount())
+{
+    foreach (int row, replaced_rows_) {
+        old_.append(model->parser()->streamAt(row));
+    }
+    const StreamList& added = merger.added();
+    added_.reserve(added.size());
+    for (int i = 0; i < added.size(); i++) {
+        added_.append(added.at(i));
+    }
+}
+
+void MergeStreamsCommand::undo()
+{
+    model_->removeStreams(addedRows());
+    for (int i = 0; i < replaced_rows_.size(); i++) {
+        model_->editStream(replaced_rows_.at(i), old_.at(i));
+    }
+}
+
+void MergeStreamsCommand::redo()
+{
+    for (int i = 0; i < replaced_rows_.size(); i++) {
+        model_->editStream(replaced_rows_.at(i), new_.at(i));
+    }
+    model_->insertStreams(addedRows(), added_);
+}
+
+QList<int> MergeStreamsCommand::addedRows() const
+{
+    QList<int> rows;
+    rows.reserve(added_.size());
+    for (int i = 0; i < added_.size(); i++) {
+        rows.append(first_added_ + i);
+    }
+    return rows;
+}
@@ -0,0 +1,108 @@
+#ifndef STREAMCOMMANDS_H
+#define STREAMCOMMANDS_H
+
+#include <QUndoCommand>
+#include <QList>
+#include <QVector>
+
+#include "streamtablemodel.h"
+#include "streammerger.h"
+
+// Undoable edits of the entries, applied through the model so that the views
+// follow. Each command only keeps what it needs to revert itself (the rows
+// involved and the text of the entries it overwrites or removes), never a copy
+// of the whole list.
+
+class EditStreamCommand : public QUndoCommand
+{
+public:
+    EditStreamCommand(StreamTableModel*, int row, const Stream&);
+    void undo();
+    void redo();
+
+private:
+    StreamTableModel* model_;
+    int row_;
+    Stream old_;
+    Stream new_;
+};
+
+
+class InsertStreamCommand : public QUndoCommand
+{ // Appends the entry, as the editor does.
+public:
+    InsertStreamCommand(StreamTableModel*, const Stream&);
+    void undo();
+    void redo();
+
+private:
+    StreamTableModel* model_;
+    Stream stream_;
+};
+
+
+class RemoveStreamsCommand : public QUndoCommand
+{
+public:
+    RemoveStreamsCommand(StreamTableModel*, QList<int> rows, const QString& text);
+    void undo();
+    void redo();
+
+private:
+    StreamTableModel* model_;
+    QList<int> rows_;           // Ascending.
+    QList<Stream> removed_;
+};
+
+
+class MoveStreamsCommand : public QUndoCommand
+{
+public:
+    enum {Id = 1};
+
+    MoveStreamsCommand(StreamTableModel*, QList<int> rows, int target);
+    void undo();
+    void redo();
+    int id() const;
+    bool mergeWith(const QUndoCommand*);
+
+private:
+    StreamTableModel* model_;
+    QList<int> rows_;           // Ascending.
+    int target_;
+    int first_;                 // Where the moved rows start after redo().
+};
+
+
+class SortStreamsCommand : public QUndoCommand
+{ // Applies an order worked out beforehand (see Parser::sortOrder()).
+public:
+    SortStreamsCommand(StreamTableModel*, const QVector<int>& order, const QString& text);
+    void undo();
+    void redo();
+
+private:
+    StreamTableModel* model_;
+    QVector<int> order_;        // Entry i of the sorted list is entry order_[i] of the unsorted one.
+};
+
+
+class MergeStreamsCommand : public QUndoCommand
+{ // Applies what a merger worked out: replaced entries and appended ones.
+public:
+    MergeStreamsCommand(StreamTableModel*, const StreamMerger&);
+    void undo();
+    void redo();
+
+private:
+    StreamTableModel* model_;
+    QList<int> replaced_rows_;  // Ascending.
+    QList<Stream> old_;
+    QList<Stream> new_;
+    QList<Stream> added_;
+    int first_added_;
+
+    QList<int> addedRows() const;
+};
+
+#endif // STREAMCOMMANDS_H
@@ -0,0 +1,114 @@
+#include "streamdiff.h"
+#include "parser.h"
+
+#include <QHash>
+#include <QSet>
+
+static inline bool sameEntry(const StreamList& a, int i, const StreamList& b, int j)
+{
+    return a.url(i) == b.url(j) && a.name(i) == b.name(j);
+}
+
+// First row of each URL (normalized) of the list.
+static QHash<QString, int> firstRows(const StreamList& list)
+{
+    QHash<QString, int> res;
+    res.reserve(list.size());
+    for (int i = 0; i < list.size(); i++) {
+        const QString& key = list.urlParts(i).normalized;
+        if (!res.contains(key)) {
+            res.insert(key, i);
+        }
+    }
+    return res;
+}
+
+
+StreamDiff StreamDiff::compute(const StreamList& before, const StreamList& after)
+{
+    const int common = qMin(before.size(), after.size());
+
+    int first = 0;
+    while (first < common && sameEntry(before, first, after, first)) {
+        first++;
+    }
+    int suffix = 0;
+    while (suffix < common - first &&
+           sameEntry(before, before.size() - 1 - suffix, after, after.size() - 1 - suffix)) {
+        suffix++;
+    }
+
+    StreamDiff res;
+    res.first   = first;
+    res.old_end = before.size() - suffix;
+    res.new_end = after.size() - suffix;
+    return res;
+}
+
+
+StreamRebase StreamRebase::compute(const StreamList& base, const StreamList& local, const StreamList& remote)
+{
+/*
+Entries are matched by URL, each list contributing its first entry of every
+URL (later ones are left as they are). For every URL of the remote list:
+- not in the local one: removed locally, unless the remote changed it;
+- changed locally but not remotely: the local version replaces it;
+- changed on both sides: same, counted as a conflict.
+Then, for every URL only in the local list: added locally, or removed
+remotely (and dropped, unless it was also changed locally).
+*/
+    StreamRebase res;
+    res.conflicts = 0;
+
+    const QHash<QString, int> base_rows = firstRows(base);
+    const QHash<QString, int> local_rows = firstRows(local);
+
+    QSet<QString> remote_urls;
+    remote_urls.reserve(remote.size());
+    for (int r = 0; r < remote.size(); r++) {
+        const QString& key = remote.urlParts(r).normalized;
+        if (remote_urls.contains(key)) {
+            continue;
+        }
+        remote_urls.insert(key);
+
+        const int b = base_rows.value(key, -1);
+        const int l = local_rows.value(key, -1);
+        if (l < 0) {
+            if (b >= 0 && sameEntry(base, b, remote, r)) {
+                res.removed_rows.append(r);
+            }
+            else if (b >= 0) {
+                res.conflicts++;    // Changed remotely: kept.
+            }
+            continue;
+        }
+
+        const bool local_changed = (b < 0 || !sameEntry(local, l, base, b));
+        if (!local_changed || sameEntry(local, l, remote, r)) {
+            continue;
+        }
+        if (b < 0 || !sameEntry(remote, r, base, b)) {
+            res.conflicts++;
+        }
+        res.edited_rows.append(r);
+        res.edited.append(local.at(l));
+    }
+
+    for (int l = 0; l < local.size(); l++) {
+        const QString& key = local.urlParts(l).normalized;
+        if (remote_urls.contains(key) || local_rows.value(key) != l) {
+            continue;
+        }
+
+        const int b = base_rows.value(key, -1);
+        if (b >= 0 && sameEntry(local, l, base, b)) {
+            continue;               // Removed remotely.
+        }
+        if (b >= 0) {
+            res.conflicts++;        // Removed remotely, changed locally: kept.
+        }
+        res.added.append(local.at(l));
+    }
+    return res;
+}
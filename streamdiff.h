@@ -0,0 +1,40 @@
+#ifndef STREAMDIFF_H
+#define STREAMDIFF_H
+
+#include <QList>
+
+#include "streamlist.h"
+
+// The changed region between two versions of a list: what is left once the
+// entries they have in common at the start and at the end are set aside.
+// Rows [first, old_end) of the old list became rows [first, new_end) of the
+// new one; the rows after them only shifted, if at all.
+struct StreamDiff {
+    int first;
+    int old_end;
+    int new_end;
+
+    bool isEmpty() const { return first == old_end && first == new_end; }
+    static StreamDiff compute(const StreamList& before, const StreamList& after);
+};
+
+
+// Local edits of a list, worked out against the version they started from
+// (base) and replayed on a newer version of it (remote): a three-way merge by
+// normalized URL. Rows are the remote's. Remote changes are kept, and so are
+// local ones; when both changed the same entry, the local version wins and
+// the entry is counted as a conflict.
+// Local reordering is not replayed: the remote order is kept, with the
+// entries only added locally at the end.
+struct StreamRebase {
+    QList<int> edited_rows;     // Ascending.
+    QList<Stream> edited;       // Their local versions.
+    QList<int> removed_rows;    // Ascending; removed locally.
+    QList<Stream> added;        // Added locally.
+    int conflicts;
+
+    bool isEmpty() const { return edited_rows.isEmpty() && removed_rows.isEmpty() && added.isEmpty(); }
+    static StreamRebase compute(const StreamList& base, const StreamList& local, const StreamList& remote);
+};
+
+#endif // STREAMDIFF_H
@@ -0,0 +1,240 @@
+#include "streamfiltermodel.h"
+#include "profiler.h"
+
+StreamFilterModel::StreamFilterModel(QObject *parent) :
+    QSortFilterProxyModel(parent),
+    streams_(NULL),
+    match_count_(0),
+    remapped_(false)
+{
+}
+
+
+void StreamFilterModel::setSourceModel(QAbstractItemModel* model)
+{
+/*
+Our connections are made before the base class makes its own, so the matches
+are already up to date when it filters the rows that changed.
+*/
+    if (streams_ != NULL) {
+        disconnect(streams_, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(sourceRowsInserted(QModelIndex,int,int)));
+        disconnect(streams_, SIGNAL(rowsRemoved(QModelIndex,int,int)), this, SLOT(sourceRowsRemoved(QModelIndex,int,int)));
+        disconnect(streams_, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)), this, SLOT(sourceRowsMoved(QModelIndex,int,int,QModelIndex,int)));
+        disconnect(streams_, SIGNAL(rowsRemapped(QVector<int>)), this, SLOT(sourceRowsRemapped(QVector<int>)));
+        disconnect(streams_, SIGNAL(dataChanged(QModelIndex,QModelIndex)), this, SLOT(sourceDataChanged(QModelIndex,QModelIndex)));
+        disconnect(streams_, SIGNAL(layoutChanged()), this, SLOT(sourceLayoutChanged()));
+        disconnect(streams_, SIGNAL(modelReset()), this, SLOT(sourceReset()));
+    }
+
+    streams_ = qobject_cast<StreamTableModel*>(model);
+    index_.clear();
+    if (streams_ != NULL) {
+        connect(streams_, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(sourceRowsInserted(QModelIndex,int,int)));
+        connect(streams_, SIGNAL(rowsRemoved(QModelIndex,int,int)), this, SLOT(sourceRowsRemoved(QModelIndex,int,int)));
+        connect(streams_, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)), this, SLOT(sourceRowsMoved(QModelIndex,int,int,QModelIndex,int)));
+        connect(streams_, SIGNAL(rowsRemapped(QVector<int>)), this, SLOT(sourceRowsRemapped(QVector<int>)));
+        connect(streams_, SIGNAL(dataChanged(QModelIndex,QModelIndex)), this, SLOT(sourceDataChanged(QModelIndex,QModelIndex)));
+        connect(streams_, SIGNAL(layoutChanged()), this, SLOT(sourceLayoutChanged()));
+        connect(streams_, SIGNAL(modelReset()), this, SLOT(sourceReset()));
+    }
+    QSortFilterProxyModel::setSourceModel(model);
+    updateMatches();
+}
+
+
+void StreamFilterModel::buildIndex()
+{
+    ETS_PROFILE_SCOPE("StreamFilterModel::buildIndex");
+    if (streams_ != NULL && streams_->parser() != NULL) {
+        index_.build(*streams_->parser());
+    }
+}
+
+
+QString StreamFilterModel::searchText() const
+{
+    return text_;
+}
+
+
+int StreamFilterModel::matchCount() const
+{
+    return match_count_;
+}
+
+
+void StreamFilterModel::setSearchText(const QString& text)
+{
+    if (text == text_) {
+        return;
+    }
+    text_ = text;
+
+    // The index is only built on demand after a reset.
+    if (text_.size() >= 3 && !index_.isBuilt()) {
+        buildIndex();
+    }
+    updateMatches();
+    invalidateFilter();
+}
+
+
+bool StreamFilterModel::filterAcceptsRow(int source_row, const QModelIndex &source_parent) const
+{
+    if (text_.isEmpty() || source_parent.isValid()) {
+        return true;
+    }
+    return source_row < matches_.size() && matches_.testBit(source_row);
+}
+
+
+void StreamFilterModel::sourceRowsInserted(const QModelIndex& parent, int first, int last)
+{
+    // Rows appended at the end (while loading, or inserted by the user) are
+    // checked directly by the index, so it stays valid; any other insertion
+    // shifts the rows after it.
+    if (parent.isValid()) {
+        return;
+    }
+    if (last != streams_->rowCount() - 1) {
+        const int inserted = last - first + 1;
+        QVector<int> new_rows(streams_->rowCount() - inserted);
+        for (int row = 0; row < new_rows.size(); row++) {
+            new_rows[row] = (row < first) ? row : row + inserted;
+        }
+        remapRows(new_rows);
+        updateMatches();
+        return;
+    }
+
+    if (!text_.isEmpty()) {
+        const Parser& parser = *streams_->parser();
+        matches_.resize(streams_->rowCount());
+        for (int row = first; row <= last; row++) {
+            const bool match = SearchIndex::matches(parser, row, text_);
+            matches_.setBit(row, match);
+            match_count_ += match ? 1 : 0;
+        }
+    }
+}
+
+
+void StreamFilterModel::sourceRowsRemoved(const QModelIndex& parent, int first, int last)
+{
+    if (parent.isValid()) {
+        return;
+    }
+    const int removed = last - first + 1;
+    QVector<int> new_rows(streams_->rowCount() + removed);
+    for (int row = 0; row < new_rows.size(); row++) {
+        new_rows[row] = (row < first) ? row : (row <= last) ? -1 : row - removed;
+    }
+    remapRows(new_rows);
+    updateMatches();
+}
+
+
+void StreamFilterModel::sourceRowsMoved(const QModelIndex& parent, int first, int last,
+                                        const QModelIndex& destination, int target)
+{
+    // [first, last] now sits before what was row target.
+    if (parent.isValid() || destination.isValid()) {
+        return;
+    }
+    const int moved = last - first + 1;
+    QVector<int> new_rows(streams_->rowCount());
+    for (int row = 0; row < new_rows.size(); row++) {
+        if (row >= first && row <= last) {
+            new_rows[row] = (target < first) ? target + row - first : target - moved + row - first;
+        }
+        else if (target < first && row >= target && row < first) {
+            new_rows[row] = row + moved;
+        }
+        else if (target > last && row > last && row < target) {
+            new_rows[row] = row - moved;
+        }
+        else {
+            new_rows[row] = row;
+        }
+    }
+    remapRows(new_rows);
+    updateMatches();
+}
+
+
+void StreamFilterModel::sourceRowsRemapped(const QVector<int>& new_rows)
+{
+    // The layout change that follows only needs the matches updated.
+    remapRows(new_rows);
+    remapped_ = true;
+}
+
+
+void StreamFilterModel::sourceDataChanged(const QModelIndex& top_left, const QModelIndex& bottom_right)
+{
+    // Only names and URLs are searched.
+    if (top_left.column() > StreamTableModel::URL_COL) {
+        return;
+    }
+    for (int row = top_left.row(); row <= bottom_right.row(); row++) {
+        index_.rowEdited(row);
+        if (!text_.isEmpty() && row < matches_.size()) {
+            const bool match = SearchIndex::matches(*streams_->parser(), row, text_);
+            match_count_ += (match ? 1 : 0) - (matches_.testBit(row) ? 1 : 0);
+            matches_.setBit(row, match);
+        }
+    }
+}
+
+
+void StreamFilterModel::sourceLayoutChanged()
+{
+    // A layout change that did not say where the rows went: the index no
+    // longer knows which row is which.
+    if (!remapped_) {
+        index_.clear();
+    }
+    remapped_ = false;
+    updateMatches();
+}
+
+
+void StreamFilterModel::sourceReset()
+{
+    index_.clear();
+    remapped_ = false;
+    updateMatches();
+}
+
+
+void StreamFilterModel::remapRows(const QVector<int>& new_rows)
+{
+    // Remapping goes through every posting list, so it is only worth it while
+    // a search uses the index. Otherwise the index is dropped, and built again
+    // by the next search that needs it.
+    ETS_PROFILE_SCOPE("StreamFilterModel::remapRows");
+    if (text_.size() >= 3) {
+        index_.remap(new_rows, streams_->rowCount());
+    }
+    else {
+        index_.clear();
+    }
+}
+
+
+void StreamFilterModel::updateMatches()
+{
+    ETS_PROFILE_SCOPE("StreamFilterModel::updateMatches");
+    matches_.clear();
+    match_count_ = 0;
+    if (text_.isEmpty() || streams_ == NULL || streams_->parser() == NULL) {
+        return;
+    }
+
+    const QVector<int> rows = index_.find(*streams_->parser(), text_);
+    matches_.resize(streams_->rowCount());
+    foreach (int row, rows) {
+        matches_.setBit(row);
+    }
+    match_count_ = rows.size();
+}
@@ -0,0 +1,52 @@
+#ifndef STREAMFILTERMODEL_H
+#define STREAMFILTERMODEL_H
+
+#include <QBitArray>
+#include <QSortFilterProxyModel>
+
+#include "searchindex.h"
+#include "streamtablemodel.h"
+
+// Shows the entries of a StreamTableModel whose name or URL contains the
+// search text. Matches come from a SearchIndex, so filtering does not check
+// every row on every keystroke.
+class StreamFilterModel : public QSortFilterProxyModel
+{
+    Q_OBJECT
+
+public:
+    explicit StreamFilterModel(QObject *parent = 0);
+
+    void setSourceModel(QAbstractItemModel*);   // A StreamTableModel.
+    void buildIndex();
+    QString searchText() const;
+    int matchCount() const;
+
+public slots:
+    void setSearchText(const QString&);
+
+protected:
+    bool filterAcceptsRow(int source_row, const QModelIndex &source_parent) const;
+
+private slots:
+    void sourceRowsInserted(const QModelIndex&, int, int);
+    void sourceRowsRemoved(const QModelIndex&, int, int);
+    void sourceRowsMoved(const QModelIndex&, int, int, const QModelIndex&, int);
+    void sourceRowsRemapped(const QVector<int>&);
+    void sourceDataChanged(const QModelIndex&, const QModelIndex&);
+    void sourceLayoutChanged();
+    void sourceReset();
+
+private:
+    StreamTableModel* streams_;
+    SearchIndex index_;
+    QString text_;
+    QBitArray matches_;     // By source row, while there is a search text.
+    int match_count_;
+    bool remapped_;         // Between rowsRemapped() and layoutChanged().
+
+    void remapRows(const QVector<int>& new_rows);
+    void updateMatches();
+};
+
+#endif // STREAMFILTERMODEL_H
@@ -0,0 +1,429 @@
+#include "streamlist.h"
+
+// Joins the tables of two lists, each one being empty or of its list's size.
+template <typename T>
+static void appendTable(QVector<T>& table, int size, const QVector<T>& other, int other_size)
+{
+    if (table.isEmpty() && other.isEmpty()) {
+        return;
+    }
+    table.resize(size);
+    if (other.isEmpty()) {
+        table.resize(size + other_size);
+    }
+    else {
+        table += other;
+    }
+}
+
+template <typename T>
+static void remapTable(QVector<T>& table, const QVector<int>& from)
+{
+    if (table.isEmpty()) {
+        return;
+    }
+    QVector<T> res(from.size());
+    for (int i = 0; i < from.size(); i++) {
+        if (from.at(i) >= 0) {
+            res[i] = table.at(from.at(i));
+        }
+    }
+    table = res;
+}
+
+StreamList::StreamList():
+pending_(0),
+garbage_(0)
+{
+}
+
+int StreamList::size() const
+{
+    return spans_.size();
+}
+
+bool StreamList::isEmpty() const
+{
+    return spans_.isEmpty();
+}
+
+StreamList::const_iterator StreamList::begin() const
+{
+    return const_iterator(this, 0);
+}
+
+StreamList::const_iterator StreamList::end() const
+{
+    return const_iterator(this, spans_.size());
+}
+
+Stream StreamList::at(int i) const
+{
+    const StreamSpan& s = spans_.at(i);
+    const QChar* text = arena_.constData() + s.offset;
+    return Stream(QString(text, s.url_length), QString(text + s.url_length, s.name_length));
+}
+
+Stream StreamList::operator[](int i) const
+{
+    return at(i);
+}
+
+QStringRef StreamList::url(int i) const
+{
+    const StreamSpan& s = spans_.at(i);
+    return QStringRef(&arena_, s.offset, s.url_length);
+}
+
+QStringRef StreamList::name(int i) const
+{
+    const StreamSpan& s = spans_.at(i);
+    return QStringRef(&arena_, s.offset + s.url_length, s.name_length);
+}
+
+const StreamUrl& StreamList::urlParts(int i) const
+{
+    if (url_parts_.isEmpty()) {
+        url_parts_.resize(spans_.size());
+    }
+    StreamUrl& parts = url_parts_[i];
+    if (!parts.parsed) {
+        parts = StreamUrl::parse(url(i));
+    }
+    return parts;
+}
+
+QByteArray StreamList::originalText(int i) const
+{
+    return original_text_.isEmpty() ? QByteArray() : original_text_.at(i);
+}
+
+void StreamList::setOriginalText(int i, const QByteArray& text)
+{
+    if (original_text_.isEmpty()) {
+        if (text.isNull()) {
+            return;
+        }
+        original_text_.resize(spans_.size());
+    }
+    original_text_[i] = text;
+}
+
+void StreamList::push_back(const Stream& s)
+{
+    appendSpan(s.url, s.name);
+    addRowTableItems(1);
+}
+
+void StreamList::append(const Stream& s)
+{
+    appendSpan(s.url, s.name);
+    addRowTableItems(1);
+}
+
+void StreamList::append(const StreamList& other)
+{
+/*
+Copies the other list's arena as is (garbage included) and shifts its spans.
+*/
+    if (isEmpty() && garbage_ == 0) {
+        *this = other;      // Both share the data until one is modified.
+        return;
+    }
+
+    detachRawData(other.arena_.size());
+    const quint32 base = arena_.size();
+    arena_.append(other.arena_);
+    garbage_ += other.garbage_;
+    appendTable(original_text_, spans_.size(), other.original_text_, other.spans_.size());
+    appendTable(url_parts_, spans_.size(), other.url_parts_, other.spans_.size());
+
+    spans_.reserve(spans_.size() + other.spans_.size());
+    for (int i = 0; i < other.spans_.size(); i++) {
+        StreamSpan s = other.spans_.at(i);
+        s.offset += base;
+        spans_.append(s);
+    }
+}
+
+void StreamList::replace(int i, const Stream& s)
+{
+/*
+Copy-on-edit: the new text goes to the end of the arena and the old one is
+left behind as garbage.
+*/
+    const StreamSpan old = spans_.at(i);
+    appendSpan(s.url, s.name);
+    spans_[i] = spans_.takeLast();
+    garbage_ += old.url_length + old.name_length;
+    if (!original_text_.isEmpty()) {
+        original_text_[i] = QByteArray();
+    }
+    if (!url_parts_.isEmpty()) {
+        url_parts_[i] = StreamUrl();
+    }
+    compact();
+}
+
+void StreamList::removeAt(int i)
+{
+    garbage_ += spans_.at(i).url_length + spans_.at(i).name_length;
+    spans_.remove(i);
+    if (!original_text_.isEmpty()) {
+        original_text_.remove(i);
+    }
+    if (!url_parts_.isEmpty()) {
+        url_parts_.remove(i);
+    }
+    compact();
+}
+
+void StreamList::removeRows(const QList<int>& rows)
+{
+/*
+Removes all the given rows in a single pass over the list.
+*/
+    const bool tables = hasRowTables();
+    QVector<int> from;
+    int next = 0;
+    int kept = 0;
+    for (int i = 0; i < spans_.size(); i++) {
+        if (next < rows.size() && rows.at(next) == i) {
+            garbage_ += spans_.at(i).url_length + spans_.at(i).name_length;
+            next++;
+            continue;
+        }
+        if (tables) {
+            from.append(i);
+        }
+        spans_[kept++] = spans_.at(i);
+    }
+    spans_.resize(kept);
+    remapRowTables(from);
+    compact();
+}
+
+void StreamList::moveRows(const QList<int>& rows, int target)
+{
+/*
+Moves the given rows, keeping their order, so that they end up right before
+the row that was at target (or at the end, if target is size()). Whatever the
+rows, this is a single pass over the list.
+*/
+    QVector<int> order;
+    order.reserve(spans_.size());
+
+    // Rows before the target that stay, then the moved ones, then the rest.
+    int next = 0;
+    for (int i = 0; i < target; i++) {
+        if (next < rows.size() && rows.at(next) == i) {
+            next++;
+            continue;
+        }
+        order.append(i);
+    }
+    for (int i = 0; i < rows.size(); i++) {
+        order.append(rows.at(i));
+    }
+    for (int i = target; i < spans_.size(); i++) {
+        if (next < rows.size() && rows.at(next) == i) {
+            next++;
+            continue;
+        }
+        order.append(i);
+    }
+    permute(order);
+}
+
+void StreamList::insertRows(const QList<int>& rows, const QList<Stream>& streams)
+{
+/*
+Inserts streams[k] so that it ends up at rows[k] (in ascending order), the
+inverse of removeRows(). The new text is appended to the arena first, and the
+spans are then merged in a single pass.
+*/
+    const int old_size = spans_.size();
+    for (int k = 0; k < streams.size(); k++) {
+        appendSpan(streams.at(k).url, streams.at(k).name);
+    }
+
+    const bool tables = hasRowTables();
+    QVector<int> from(tables ? spans_.size() : 0);
+    QVector<StreamSpan> spans(spans_.size());
+    int next = 0;
+    int old = 0;
+    for (int i = 0; i < spans.size(); i++) {
+        if (next < rows.size() && rows.at(next) == i) {
+            if (tables) {
+                from[i] = -1;
+            }
+            spans[i] = spans_.at(old_size + next++);
+        }
+        else {
+            if (tables) {
+                from[i] = old;
+            }
+            spans[i] = spans_.at(old++);
+        }
+    }
+    spans_ = spans;
+    remapRowTables(from);
+}
+
+void StreamList::swap(int i, int j)
+{
+    qSwap(spans_[i], spans_[j]);
+    if (!original_text_.isEmpty()) {
+        qSwap(original_text_[i], original_text_[j]);
+    }
+    if (!url_parts_.isEmpty()) {
+        qSwap(url_parts_[i], url_parts_[j]);
+    }
+}
+
+void StreamList::permute(const QVector<int>& order)
+{
+    // Only the spans move; the text stays where it is.
+    QVector<StreamSpan> spans(order.size());
+    for (int i = 0; i < order.size(); i++) {
+        spans[i] = spans_.at(order.at(i));
+    }
+    spans_ = spans;
+    remapRowTables(order);
+}
+
+void StreamList::clear()
+{
+    arena_.clear();
+    spans_.clear();
+    garbage_ = 0;
+    raw_owner_.clear();
+    original_text_.clear();
+    url_parts_.clear();
+}
+
+ushort* StreamList::reserveText(int length)
+{
+    detachRawData(length);
+    pending_ = arena_.size();
+    arena_.resize(pending_ + length);
+    return reinterpret_cast<ushort*>(arena_.data()) + pending_;
+}
+
+void StreamList::commitEntry(int url_length, int name_length)
+{
+    StreamSpan s;
+    s.offset        = pending_;
+    s.url_length    = url_length;
+    s.name_length   = name_length;
+    spans_.append(s);
+    arena_.resize(pending_ + url_length + name_length);
+    addRowTableItems(1);
+}
+
+void StreamList::setRawData(const QChar* text, int length, const QVector<StreamSpan>& spans,
+                            const QSharedPointer<QObject>& owner)
+{
+    // The text of every span is assumed to be inside [text, text + length).
+    arena_      = QString::fromRawData(text, length);
+    spans_      = spans;
+    raw_owner_  = owner;
+    original_text_.clear();
+    url_parts_.clear();
+
+    qint64 used = 0;
+    for (int i = 0; i < spans_.size(); i++) {
+        used += spans_.at(i).url_length + spans_.at(i).name_length;
+    }
+    garbage_ = int(length - used);
+}
+
+bool StreamList::isRawData() const
+{
+    return !raw_owner_.isNull();
+}
+
+qint64 StreamList::memoryUsage() const
+{
+    // Raw data is not allocated by the list, so it does not count.
+    // Neither is the text the row tables point to: originals are only kept for
+    // a few entries, and URL parts only for the entries asked about.
+    const qint64 tables = qint64(original_text_.capacity()) * sizeof(QByteArray)
+                        + qint64(url_parts_.capacity()) * sizeof(StreamUrl);
+    if (isRawData()) {
+        return sizeof(*this) + qint64(spans_.capacity()) * sizeof(StreamSpan) + tables;
+    }
+    return sizeof(*this)
+         + qint64(arena_.capacity()) * sizeof(QChar)
+         + qint64(spans_.capacity()) * sizeof(StreamSpan)
+         + tables;
+}
+
+void StreamList::detachRawData(int extra)
+{
+    // Copying it once, with room for what is about to be appended (QString
+    // would copy it anyway, but only with room for the appended text).
+    if (isRawData()) {
+        QString arena;
+        arena.reserve(arena_.size() + extra);
+        arena.append(arena_.constData(), arena_.size());
+        arena_ = arena;
+        raw_owner_.clear();
+    }
+}
+
+bool StreamList::hasRowTables() const
+{
+    return !original_text_.isEmpty() || !url_parts_.isEmpty();
+}
+
+void StreamList::addRowTableItems(int count)
+{
+    if (!original_text_.isEmpty()) {
+        original_text_.resize(original_text_.size() + count);
+    }
+    if (!url_parts_.isEmpty()) {
+        url_parts_.resize(url_parts_.size() + count);
+    }
+}
+
+void StreamList::remapRowTables(const QVector<int>& from)
+{
+    remapTable(original_text_, from);
+    remapTable(url_parts_, from);
+}
+
+void StreamList::appendSpan(const QString& url, const QString& name)
+{
+    detachRawData(url.size() + name.size());
+    StreamSpan s;
+    s.offset        = arena_.size();
+    s.url_length    = url.size();
+    s.name_length   = name.size();
+    arena_.append(url).append(name);
+    spans_.append(s);
+}
+
+void StreamList::compact()
+{
+/*
+Rebuilds the arena with only the text still in use, in list order, once more
+than half of it (and at least kMinGarbage characters) is garbage.
+*/
+    static const int kMinGarbage = 1 << 16;
+    if (garbage_ < kMinGarbage || garbage_ < arena_.size() / 2) {
+        return;
+    }
+
+    QString arena;
+    arena.reserve(arena_.size() - garbage_);
+    for (int i = 0; i < spans_.size(); i++) {
+        StreamSpan& s = spans_[i];
+        const quint32 offset = arena.size();
+        arena.append(arena_.constData() + s.offset, s.url_length + s.name_length);
+        s.offset = offset;
+    }
+    arena_ = arena;
+    garbage_ = 0;
+    raw_owner_.clear();
+}
@@ -0,0 +1,156 @@
+#ifndef STREAMLIST_H
+#define STREAMLIST_H
+
+#include <QObject>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringRef>
+#include <QVector>
+#include <iterator>
+
+#include "streamurl.h"
+
+struct Stream {
+    QString url;
+    QString name;
+
+    Stream(QString u, QString d): url(u), name(d) {};
+};
+
+// Where the text of an entry lives inside a StreamList's arena: the URL
+// followed by the name.
+struct StreamSpan {
+    quint32 offset;
+    quint32 url_length;
+    quint32 name_length;
+};
+Q_DECLARE_TYPEINFO(StreamSpan, Q_PRIMITIVE_TYPE);
+
+
+// Compact list of stream entries. The URLs and names of all the entries are
+// stored in one UTF-16 arena, and each entry is just a StreamSpan into it, so a
+// list costs a couple of allocations instead of two per entry.
+// Edited entries get their new text appended to the arena; the old text is
+// reclaimed once it outgrows the text still in use.
+class StreamList {
+public:
+    class const_iterator {
+    public:
+        // Entries are materialized on access, so -> goes through a copy.
+        class ArrowProxy {
+        public:
+            ArrowProxy(const Stream& s): s_(s) {}
+            const Stream* operator->() const { return &s_; }
+        private:
+            Stream s_;
+        };
+
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef Stream value_type;
+        typedef int difference_type;
+        typedef const Stream* pointer;
+        typedef Stream reference;
+
+        const_iterator(): list_(NULL), i_(0) {}
+        const_iterator(const StreamList* list, int i): list_(list), i_(i) {}
+
+        Stream operator*() const { return list_->at(i_); }
+        ArrowProxy operator->() const { return ArrowProxy(list_->at(i_)); }
+        Stream operator[](int n) const { return list_->at(i_ + n); }
+
+        const_iterator& operator++() { i_++; return *this; }
+        const_iterator operator++(int) { const_iterator it(*this); i_++; return it; }
+        const_iterator& operator--() { i_--; return *this; }
+        const_iterator operator--(int) { const_iterator it(*this); i_--; return it; }
+        const_iterator& operator+=(int n) { i_ += n; return *this; }
+        const_iterator& operator-=(int n) { i_ -= n; return *this; }
+        const_iterator operator+(int n) const { return const_iterator(list_, i_ + n); }
+        const_iterator operator-(int n) const { return const_iterator(list_, i_ - n); }
+        int operator-(const const_iterator& other) const { return i_ - other.i_; }
+
+        bool operator==(const const_iterator& other) const { return i_ == other.i_; }
+        bool operator!=(const const_iterator& other) const { return i_ != other.i_; }
+        bool operator<(const const_iterator& other) const { return i_ < other.i_; }
+
+    private:
+        const StreamList* list_;
+        int i_;
+    };
+    // Entries can only be modified through the list.
+    typedef const_iterator iterator;
+
+    StreamList();
+
+    int size() const;
+    bool isEmpty() const;
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    Stream at(int) const;
+    Stream operator[](int) const;
+    QStringRef url(int) const;      // Valid until the list is modified.
+    QStringRef name(int) const;
+
+    // The parts of an entry's URL, parsed the first time they are asked for
+    // and kept until the entry is edited. Valid until the list is modified.
+    // Filling the cache modifies the list, so a list must not be asked for
+    // them from several threads at once.
+    const StreamUrl& urlParts(int) const;
+
+    // The text of an entry as it was in the file (URL, '|' and name, still
+    // escaped), for the entries that would not be written back with the same
+    // bytes. Null for all the others, and for edited entries.
+    QByteArray originalText(int) const;
+    void setOriginalText(int, const QByteArray&);
+
+    void push_back(const Stream&);
+    void append(const Stream&);
+    void append(const StreamList&);
+    void replace(int, const Stream&);
+    void removeAt(int);
+    void removeRows(const QList<int>&);    // Rows in ascending order.
+    void moveRows(const QList<int>&, int);  // Same, moved before the given row.
+    void insertRows(const QList<int>&, const QList<Stream>&);  // At these final rows.
+    void swap(int, int);
+    void permute(const QVector<int>&);  // Entry i becomes the old entry order[i].
+    void clear();
+
+    // For readers that decode text straight into the arena: reserveText()
+    // returns room for the given number of characters at the end of the
+    // arena, and commitEntry() turns the first url_length + name_length of
+    // them into a new entry.
+    ushort* reserveText(int);
+    void commitEntry(int url_length, int name_length);
+
+    // For readers that find the text already decoded somewhere else (e.g. a
+    // mapped cache file): the list uses it in place instead of copying it,
+    // and holds on to owner, which keeps that memory valid, until the arena
+    // is modified (the text is copied then) or cleared.
+    void setRawData(const QChar* text, int length, const QVector<StreamSpan>& spans,
+                    const QSharedPointer<QObject>& owner);
+    bool isRawData() const;
+
+    qint64 memoryUsage() const;     // Bytes allocated by the list.
+
+private:
+    QString arena_;
+    QVector<StreamSpan> spans_;
+    int pending_;                   // Start of the text given by reserveText().
+    int garbage_;                   // Arena characters no entry refers to.
+    QSharedPointer<QObject> raw_owner_; // Set while arena_ is raw data.
+
+    // Per-entry tables that follow the entries around. Each one is either
+    // empty (nothing to keep so far) or has one item per entry.
+    QVector<QByteArray> original_text_;
+    mutable QVector<StreamUrl> url_parts_;
+
+    bool hasRowTables() const;
+    void addRowTableItems(int);
+    void remapRowTables(const QVector<int>& from);  // Entry i was entry from[i] (-1: a new one).
+
+    void detachRawData(int extra);
+    void appendSpan(const QString&, const QString&);
+    void compact();
+};
+
+#endif // STREAMLIST_H
@@ -0,0 +1,178 @@
+#include "streamloader.h"
+#include "profiler.h"
+
+#include <QFile>
+#include <QtConcurrent>
+#include <climits>
+#include <cstring>
+
+StreamLoader::StreamLoader(QObject *parent) :
+    QObject(parent),
+    generation_(0),
+    active_(false)
+{
+    qRegisterMetaType<ParsedBlock>("ParsedBlock");
+}
+
+
+StreamLoader::~StreamLoader()
+{
+    generation_.ref();
+    future_.waitForFinished();
+}
+
+
+void StreamLoader::start(const QString& filename)
+{
+    cancel();
+    active_ = true;
+    future_ = QtConcurrent::run(this, &StreamLoader::run, filename, int(generation_.load()));
+}
+
+
+void StreamLoader::cancel()
+{
+    if (!active_) {
+        return;
+    }
+    active_ = false;
+    generation_.ref();
+    future_.waitForFinished();
+    emit finished(true);
+}
+
+
+bool StreamLoader::isRunning() const
+{
+    return active_;
+}
+
+
+void StreamLoader::deliverBatch(int generation, const ParsedBlock& block)
+{
+    if (generation == generation_.load()) {
+        emit batchReady(block);
+    }
+}
+
+
+void StreamLoader::deliverProgress(int generation, qint64 bytes_read, qint64 total_bytes)
+{
+    if (generation == generation_.load()) {
+        emit progress(bytes_read, total_bytes);
+    }
+}
+
+
+void StreamLoader::deliverFinished(int generation)
+{
+    if (generation == generation_.load()) {
+        active_ = false;
+        emit finished(false);
+    }
+}
+
+
+void StreamLoader::run(const QString& filename, int generation)
+{
+/*
+Runs in a worker thread. The file is mapped and parsed as a document (see
+Parser::parseEntries()), and its entries are then decoded in batches. The
+first batch is small so the view fills up right away; the next ones grow up
+to kMaxBatch entries, which also bounds how long a cancellation takes to be
+noticed.
+Files that are not valid documents are cut into batches at line boundaries
+instead, growing up to kMaxBatchSize bytes, and parsed line by line.
+Encrypted and binary files are decoded whole, into a single batch (see
+Parser::parseBinary()).
+Results are queued back to the loader's thread.
+*/
+    ETS_PROFILE_SCOPE("StreamLoader::run");
+    static const int kFirstBatch        = 1 << 10;
+    static const int kMaxBatch          = 1 << 16;
+    static const qint64 kFirstBatchSize = 64 << 10;
+    static const qint64 kMaxBatchSize   = 4 << 20;
+
+    QFile file(filename);
+    if (file.open(QIODevice::ReadOnly)) {
+        const qint64 size = file.size();
+        QByteArray buffer;
+        const char* file_begin = size > 0 ? reinterpret_cast<const char*>(file.map(0, size)) : NULL;
+        if (file_begin == NULL) {
+            buffer = file.readAll();
+            file_begin = buffer.constData();
+        }
+        const char* end = file_begin + (buffer.isNull() ? size : buffer.size());
+        ETS_PROFILE_COUNT("bytes read", end - file_begin);
+
+        SiiDocument document;
+        if (Parser::isBinary(file_begin, end)) {
+            QMetaObject::invokeMethod(this, "deliverBatch", Qt::QueuedConnection,
+                                      Q_ARG(int, generation),
+                                      Q_ARG(ParsedBlock, Parser::parseBinary(file_begin, end)));
+            QMetaObject::invokeMethod(this, "deliverProgress", Qt::QueuedConnection,
+                                      Q_ARG(int, generation),
+                                      Q_ARG(qint64, end - file_begin),
+                                      Q_ARG(qint64, end - file_begin));
+        }
+        else if (end - file_begin <= INT_MAX &&
+                 document.parse(QByteArray::fromRawData(file_begin, int(end - file_begin)))) {
+            const QVector<int> entries = Parser::entryNodes(document);
+            int batch = 0;
+            int batch_size = kFirstBatch;
+            do {    // Once at least, for the definition line and the skeleton.
+                if (generation != generation_.load()) {
+                    return;     // Cancelled.
+                }
+
+                const int batch_end = qMin(batch + batch_size, entries.size());
+                const qint64 bytes_read = (batch_end < entries.size())
+                    ? document.node(entries.at(batch_end)).begin : end - file_begin;
+                QMetaObject::invokeMethod(this, "deliverBatch", Qt::QueuedConnection,
+                                          Q_ARG(int, generation),
+                                          Q_ARG(ParsedBlock, Parser::parseEntries(document, entries, batch, batch_end)));
+                QMetaObject::invokeMethod(this, "deliverProgress", Qt::QueuedConnection,
+                                          Q_ARG(int, generation),
+                                          Q_ARG(qint64, bytes_read),
+                                          Q_ARG(qint64, end - file_begin));
+
+                batch = batch_end;
+                batch_size = qMin(batch_size * 2, kMaxBatch);
+            } while (batch < entries.size());
+        }
+        else {
+            // Skipping the UTF-8 BOM, if any.
+            const char* batch = file_begin;
+            if (end - batch >= 3 && memcmp(batch, "\xEF\xBB\xBF", 3) == 0) {
+                batch += 3;
+            }
+
+            qint64 batch_size = kFirstBatchSize;
+            while (batch < end) {
+                if (generation != generation_.load()) {
+                    return;     // Cancelled.
+                }
+
+                const char* batch_end = end;
+                if (end - batch > batch_size) {
+                    batch_end = static_cast<const char*>(memchr(batch + batch_size, '\n', end - batch - batch_size));
+                    batch_end = batch_end ? batch_end + 1 : end;
+                }
+
+                QMetaObject::invokeMethod(this, "deliverBatch", Qt::QueuedConnection,
+                                          Q_ARG(int, generation),
+                                          Q_ARG(ParsedBlock, Parser::parseBlock(file_begin, batch, batch_end)));
+                QMetaObject::invokeMethod(this, "deliverProgress", Qt::QueuedConnection,
+                                          Q_ARG(int, generation),
+                                          Q_ARG(qint64, batch_end - file_begin),
+                                          Q_ARG(qint64, end - file_begin));
+
+                batch = batch_end;
+                batch_size = qMin(batch_size * 2, kMaxBatchSize);
+            }
+        }
+    }
+
+    QMetaObject::invokeMethod(this, "deliverFinished", Qt::QueuedConnection,
+                              Q_ARG(int, generation));
+}
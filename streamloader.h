@@ -0,0 +1,49 @@
+#ifndef STREAMLOADER_H
+#define STREAMLOADER_H
+
+#include <QObject>
+#include <QFuture>
+#include <QAtomicInt>
+#include <QMetaType>
+
+#include "parser.h"
+
+Q_DECLARE_METATYPE(ParsedBlock)
+
+// Parses a .sii file in a worker thread and hands the entries over in batches,
+// so they can be shown while the rest of the file is still being read.
+class StreamLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit StreamLoader(QObject *parent = 0);
+    ~StreamLoader();
+
+    void start(const QString&);
+    void cancel();          // Returns once the worker has stopped.
+    bool isRunning() const;
+
+signals:
+    // Emitted in file order, in the thread the loader lives in. Nothing from
+    // a load is emitted after it has been cancelled.
+    void batchReady(const ParsedBlock&);
+    void progress(qint64 bytes_read, qint64 total_bytes);
+    void finished(bool cancelled);
+
+private slots:
+    void deliverBatch(int generation, const ParsedBlock&);
+    void deliverProgress(int generation, qint64, qint64);
+    void deliverFinished(int generation);
+
+private:
+    QFuture<void> future_;
+    // Changes on every start and cancel; the worker stops, and anything it
+    // already queued is dropped, when it no longer matches its own.
+    QAtomicInt generation_;
+    bool active_;
+
+    void run(const QString&, int generation);
+};
+
+#endif // STREAMLOADER_H
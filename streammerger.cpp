@@ -0,0 +1,226 @@
+#include "streammerger.h"
+
+#include <QFile>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+StreamMerger::StreamMerger(const Parser* base, ConflictRule rule, int preferred_source):
+base_(base),
+rule_(rule),
+preferred_source_(preferred_source),
+base_rows_(base != NULL ? base->streamCount() : 0),
+sources_(base != NULL ? 1 : 0),
+entries_read_(0),
+duplicates_(0)
+{
+    if (base_ == NULL) {
+        return;
+    }
+
+    // Repeated URLs already in the base are left alone: only what is added
+    // is deduplicated, against the first of them.
+    live_stream_def_line_ = base_->liveStreamDefLine();
+    rows_.reserve(base_rows_);
+    row_sources_.fill(0, base_rows_);
+    for (int row = 0; row < base_rows_; row++) {
+        const QString& key = base_->urlPartsAt(row).normalized;
+        if (!rows_.contains(key)) {
+            rows_.insert(key, row);
+        }
+    }
+}
+
+bool StreamMerger::addFile(const QString& filename)
+{
+/*
+Like the loader, the file is mapped and parsed as a document, whose entries
+are decoded in batches; each batch is merged and dropped before the next one
+is decoded. The first file with a definition line also gives its skeleton
+(the units and comments around the entries), which a merge without a base
+is written with. Files that are not valid documents are parsed in windows
+that end at line boundaries instead, and encrypted and binary files are
+decoded whole.
+*/
+    static const int kBatch = 1 << 14;
+    static const qint64 kWindow = 4 << 20;
+
+    // Unreadable files still take their number, so that they match the order
+    // in which the sources were given.
+    const int source = sources_++;
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const qint64 size = file.size();
+    QByteArray buffer;
+    const char* file_begin = size > 0 ? reinterpret_cast<const char*>(file.map(0, size)) : NULL;
+    if (file_begin == NULL) {
+        buffer = file.readAll();
+        file_begin = buffer.constData();
+    }
+    const char* end = file_begin + (buffer.isNull() ? size : buffer.size());
+
+    if (Parser::isBinary(file_begin, end)) {
+        const ParsedBlock block = Parser::parseBinary(file_begin, end);
+        addBlock(block, source);
+        return block.error.isEmpty();
+    }
+
+    SiiDocument document;
+    if (end - file_begin <= INT_MAX &&
+        document.parse(QByteArray::fromRawData(file_begin, int(end - file_begin)))) {
+        const QVector<int> entries = Parser::entryNodes(document);
+        int batch = 0;
+        do {    // Once at least, for the definition line and the skeleton.
+            const int batch_end = qMin(batch + kBatch, entries.size());
+            addBlock(Parser::parseEntries(document, entries, batch, batch_end), source);
+            batch = batch_end;
+        } while (batch < entries.size());
+        return true;
+    }
+
+    // Skipping the UTF-8 BOM, if any.
+    const char* window = file_begin;
+    if (end - window >= 3 && memcmp(window, "\xEF\xBB\xBF", 3) == 0) {
+        window += 3;
+    }
+
+    while (window < end) {
+        const char* window_end = end;
+        if (end - window > kWindow) {
+            window_end = static_cast<const char*>(memchr(window + kWindow, '\n', end - window - kWindow));
+            window_end = window_end ? window_end + 1 : end;
+        }
+        addBlock(Parser::parseBlock(file_begin, window, window_end), source);
+        window = window_end;
+    }
+    return true;
+}
+
+void StreamMerger::addStreams(const StreamList& streams)
+{
+    const int source = sources_++;
+    for (int i = 0; i < streams.size(); i++) {
+        addStream(streams.url(i), streams.name(i), source);
+    }
+}
+
+int StreamMerger::sourceCount() const
+{
+    return sources_;
+}
+
+int StreamMerger::entriesRead() const
+{
+    return entries_read_;
+}
+
+int StreamMerger::duplicates() const
+{
+    return duplicates_;
+}
+
+QString StreamMerger::liveStreamDefLine() const
+{
+    return live_stream_def_line_;
+}
+
+QList<int> StreamMerger::replacedRows() const
+{
+    QList<int> rows = replaced_.keys();
+    std::sort(rows.begin(), rows.end());
+    return rows;
+}
+
+QList<Stream> StreamMerger::replacements() const
+{
+    QList<Stream> res;
+    foreach (int row, replacedRows()) {
+        res.append(*replaced_.constFind(row));
+    }
+    return res;
+}
+
+const StreamList& StreamMerger::added() const
+{
+    return added_;
+}
+
+void StreamMerger::apply(Parser& parser) const
+{
+    for (QHash<int, Stream>::const_iterator it = replaced_.constBegin(); it != replaced_.constEnd(); ++it) {
+        parser.editStream(it.key(), it.value());
+    }
+    parser.appendStreams(added_);
+    if (!parser.liveStreamDefLine().isNull()) {
+        return;
+    }
+    if (!skeleton_.isEmpty()) {
+        ParsedBlock header;     // No entries: only the definition line and skeleton.
+        header.live_stream_def_line = live_stream_def_line_;
+        header.skeleton = skeleton_;
+        parser.appendBlock(header);
+    }
+    else {
+        parser.setLiveStreamDefLine(live_stream_def_line_);
+    }
+}
+
+void StreamMerger::addBlock(const ParsedBlock& block, int source)
+{
+    // The definition line and the skeleton come from the same file.
+    if (live_stream_def_line_.isNull() && !block.live_stream_def_line.isNull()) {
+        live_stream_def_line_ = block.live_stream_def_line;
+        skeleton_ = block.skeleton;
+    }
+    for (int i = 0; i < block.streams.size(); i++) {
+        addStream(block.streams.url(i), block.streams.name(i), source);
+    }
+}
+
+void StreamMerger::addStream(const QStringRef& url, const QStringRef& name, int source)
+{
+    entries_read_++;
+    const QString key = Parser::normalizeUrl(url.toString());
+    QHash<QString, int>::const_iterator it = rows_.constFind(key);
+    if (it == rows_.constEnd()) {
+        rows_.insert(key, base_rows_ + added_.size());
+        row_sources_.append(source);
+        added_.append(Stream(url.toString(), name.toString()));
+        return;
+    }
+
+    duplicates_++;
+    const int row = it.value();
+    if (rule_ == KeepLongestName) {
+        const Stream kept = streamAt(row);
+        if (name.size() > kept.name.size()) {
+            replace(row, Stream(kept.url, name.toString()), row_sources_.at(row));
+        }
+    }
+    else if (rule_ == PreferSource && source == preferred_source_ && row_sources_.at(row) != source) {
+        replace(row, Stream(url.toString(), name.toString()), source);
+    }
+}
+
+Stream StreamMerger::streamAt(int row) const
+{
+    if (row >= base_rows_) {
+        return added_.at(row - base_rows_);
+    }
+    QHash<int, Stream>::const_iterator it = replaced_.constFind(row);
+    return it != replaced_.constEnd() ? it.value() : base_->streamAt(row);
+}
+
+void StreamMerger::replace(int row, const Stream& stream, int source)
+{
+    row_sources_[row] = source;
+    if (row >= base_rows_) {
+        added_.replace(row - base_rows_, stream);
+    }
+    else {
+        replaced_.insert(row, stream);
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef STREAMMERGER_H
+#define STREAMMERGER_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "parser.h"
+
+// Joins the entries of several lists into one, without repeated URLs (as
+// told by Parser::normalizeUrl()). Sources are numbered in the order they are
+// given, the base list (if any) being source 0. Each URL keeps the position of
+// its first entry; which name (and spelling of the URL) it ends up with when it
+// is repeated depends on the rule.
+//
+// Files are streamed: they are mapped and their entries decoded a batch at a
+// time, so only the merged entries (and the nodes of the file being read) are
+// kept in memory, never the text of a whole input.
+class StreamMerger {
+public:
+    enum ConflictRule {
+        KeepFirst,          // The first entry of each URL.
+        KeepLongestName,    // The longest name seen for the URL.
+        PreferSource        // The entry from the preferred source, if it has one.
+    };
+
+    // With a base, the result is what has to change in it: replaced entries
+    // and entries to append. base must outlive the merger, unchanged.
+    explicit StreamMerger(const Parser* base = NULL, ConflictRule rule = KeepFirst, int preferred_source = -1);
+
+    bool addFile(const QString&);       // False if it cannot be read.
+    void addStreams(const StreamList&);
+
+    int sourceCount() const;
+    int entriesRead() const;            // From all the added sources.
+    int duplicates() const;             // Entries dropped for a repeated URL.
+    QString liveStreamDefLine() const;  // The base's, or the first found (whose
+                                        // file's skeleton apply() also gives to
+                                        // a parser without one).
+
+    // The result.
+    QList<int> replacedRows() const;    // Rows of the base, ascending.
+    QList<Stream> replacements() const; // Their new entries, same order.
+    const StreamList& added() const;    // To be appended to the base.
+
+    void apply(Parser&) const;          // Applies the result to the base (or to an empty parser).
+
+private:
+    const Parser* base_;
+    ConflictRule rule_;
+    int preferred_source_;
+    int base_rows_;
+    int sources_;
+    int entries_read_;
+    int duplicates_;
+    QString live_stream_def_line_;
+    SiiDocument skeleton_;              // Of the file the definition line came from.
+
+    QHash<QString, int> rows_;          // Merged row by normalized URL.
+    QVector<int> row_sources_;          // Source of the entry kept at each row.
+    QHash<int, Stream> replaced_;       // By base row.
+    StreamList added_;
+
+    void addBlock(const ParsedBlock&, int source);
+    void addStream(const QStringRef& url, const QStringRef& name, int source);
+    Stream streamAt(int row) const;
+    void replace(int row, const Stream&, int source);
+};
+
+#endif // STREAMMERGER_H
@@ -0,0 +1,210 @@
+#include "streamsorter.h"
+#include "profiler.h"
+
+#include <QCollator>
+#include <QCollatorSortKey>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <algorithm>
+
+// Below this, threads cost more than they save.
+static const int kMinParallelRows = 1 << 14;
+
+typedef QList<QCollatorSortKey> SortKeys;
+
+class KeyLess {
+public:
+    explicit KeyLess(const SortKeys& keys):
+    keys_(keys)
+    {
+    }
+
+    bool operator()(int a, int b) const
+    {
+        return keys_.at(a).compare(keys_.at(b)) < 0;
+    }
+
+private:
+    const SortKeys& keys_;
+};
+
+// Collation keys of rows [begin, end). Each call has its own collator, as they
+// cannot be shared between threads.
+static SortKeys sortKeys(const StreamList* streams, Parser::SortKey key, Parser::SortKeyFunction custom,
+                         int begin, int end)
+{
+    QCollator collator;
+    collator.setCaseSensitivity(Qt::CaseInsensitive);
+
+    SortKeys keys;
+    keys.reserve(end - begin);
+    for (int row = begin; row < end; row++) {
+        keys.append(collator.sortKey(StreamSorter::keyText(*streams, row, key, custom)));
+    }
+    return keys;
+}
+
+static void sortRun(int* begin, int* end, const KeyLess* less)
+{
+    std::stable_sort(begin, end, *less);
+}
+
+// std::merge takes from the first run on ties, which keeps the sort stable.
+static void mergeRuns(const int* begin, const int* middle, const int* end, int* out, const KeyLess* less)
+{
+    std::merge(begin, middle, middle, end, out, *less);
+}
+
+
+QVector<int> StreamSorter::order(const StreamList& streams, Parser::SortKey key, int threads,
+                                 Parser::SortKeyFunction custom)
+{
+/*
+The rows are cut into one run per thread. The runs get their keys and are
+sorted concurrently, and are then merged pairwise, also concurrently, going
+back and forth between two buffers until a single run is left.
+*/
+    ETS_PROFILE_SCOPE("StreamSorter::order");
+
+    const int count = streams.size();
+    if (threads <= 0) {
+        threads = QThread::idealThreadCount();
+    }
+    const int runs = qBound(1, count / kMinParallelRows, threads);
+
+    QVector<int> order(count);
+    for (int i = 0; i < count; i++) {
+        order[i] = i;
+    }
+
+    QVector<int> bounds;
+    for (int i = 0; i <= runs; i++) {
+        bounds.append(int(qint64(count) * i / runs));
+    }
+
+    if (runs == 1) {
+        const SortKeys keys = sortKeys(&streams, key, custom, 0, count);
+        std::stable_sort(order.begin(), order.end(), KeyLess(keys));
+        return order;
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(runs);
+
+    QList< QFuture<SortKeys> > parts;
+    for (int i = 0; i < runs; i++) {
+        parts.append(QtConcurrent::run(&pool, sortKeys, &streams, key, custom, bounds.at(i), bounds.at(i + 1)));
+    }
+    SortKeys keys;
+    keys.reserve(count);
+    for (int i = 0; i < parts.size(); i++) {
+        keys += parts[i].result();
+    }
+    const KeyLess less(keys);
+
+    QList< QFuture<void> > jobs;
+    for (int i = 0; i < runs; i++) {
+        jobs.append(QtConcurrent::run(&pool, sortRun, order.data() + bounds.at(i), order.data() + bounds.at(i + 1), &less));
+    }
+    for (int i = 0; i < jobs.size(); i++) {
+        jobs[i].waitForFinished();
+    }
+
+    QVector<int> buffer(count);
+    int* from = order.data();
+    int* to = buffer.data();
+    while (bounds.size() > 2) {
+        jobs.clear();
+        QVector<int> merged;
+        for (int i = 0; i + 1 < bounds.size(); i += 2) {
+            merged.append(bounds.at(i));
+            if (i + 2 < bounds.size()) {
+                jobs.append(QtConcurrent::run(&pool, mergeRuns, from + bounds.at(i), from + bounds.at(i + 1),
+                                              from + bounds.at(i + 2), to + bounds.at(i), &less));
+            }
+            else {  // An odd run out: copied as it is.
+                std::copy(from + bounds.at(i), from + bounds.at(i + 1), to + bounds.at(i));
+            }
+        }
+        merged.append(count);
+        for (int i = 0; i < jobs.size(); i++) {
+            jobs[i].waitForFinished();
+        }
+        bounds = merged;
+        qSwap(from, to);
+    }
+
+    if (from != order.data()) {
+        return buffer;
+    }
+    return order;
+}
+
+QString StreamSorter::keyText(const StreamList& streams, int row, Parser::SortKey key, Parser::SortKeyFunction custom)
+{
+    switch (key) {
+    case Parser::SortByUrl:
+        return streams.url(row).toString();
+    case Parser::SortByHost:
+        return hostKey(streams.url(row));
+    case Parser::SortByPrefix:
+        return prefixKey(streams.name(row));
+    case Parser::SortByCustom:
+        return custom != NULL ? custom(streams.url(row), streams.name(row)) : QString();
+    default:
+        return streams.name(row).toString();
+    }
+}
+
+QString StreamSorter::hostKey(const QStringRef& url)
+{
+/*
+The labels of the host are reversed, "a.example.com" giving "com.example.a",
+unless it is an IP address.
+The URL is parsed again rather than taken from the list's cache of URL parts,
+which cannot be filled from several threads at once.
+*/
+    const QString host = StreamUrl::parse(url).host;
+    if (host.startsWith('[')) {
+        return host;    // IPv6.
+    }
+
+    bool numeric = true;
+    for (int i = 0; i < host.size() && numeric; i++) {
+        numeric = host.at(i).isDigit() || host.at(i) == '.';
+    }
+    if (numeric) {
+        return host;
+    }
+
+    QStringList labels = host.split('.');
+    std::reverse(labels.begin(), labels.end());
+    return labels.join('.');
+}
+
+QString StreamSorter::prefixKey(const QStringRef& name)
+{
+/*
+Station names often start with a genre or network: "[Jazz] Name",
+"(Rock) Name", "Rock: Name", "SKY.FM - Name", "Rock | Name". The prefix is the
+bracketed tag at the start, or else whatever comes before the first ':',
+" - " or " | ". Names without one are their own prefix.
+*/
+    const QStringRef trimmed = name.trimmed();
+    if (trimmed.startsWith('[') || trimmed.startsWith('(')) {
+        const int close = trimmed.indexOf(trimmed.at(0) == '[' ? ']' : ')');
+        if (close > 0) {
+            return trimmed.mid(1, close - 1).trimmed().toString();
+        }
+    }
+
+    int end = trimmed.size();
+    const int colon = trimmed.indexOf(':');
+    const int dash = trimmed.indexOf(QLatin1String(" - "));
+    const int bar = trimmed.indexOf(QLatin1String(" | "));
+    if (colon > 0) end = qMin(end, colon);
+    if (dash > 0)  end = qMin(end, dash);
+    if (bar > 0)   end = qMin(end, bar);
+    return trimmed.left(end).trimmed().toString();
+}
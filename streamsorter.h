@@ -0,0 +1,27 @@
+#ifndef STREAMSORTER_H
+#define STREAMSORTER_H
+
+#include <QString>
+#include <QStringRef>
+#include <QVector>
+
+#include "parser.h"
+
+// Works out the stable order of a list by one of its fields, as the user's
+// locale sorts text (ignoring case). Collation keys are computed once per
+// entry, so each comparison is a plain byte comparison; both the keys and the
+// sort itself (a merge sort) are spread over several threads.
+class StreamSorter {
+public:
+    // Entry i of the sorted list is entry order[i] of the given one; equal
+    // keys keep their order. threads: 0 for one per core. custom is only
+    // used by Parser::SortByCustom.
+    static QVector<int> order(const StreamList&, Parser::SortKey, int threads = 0,
+                              Parser::SortKeyFunction custom = NULL);
+
+    static QString keyText(const StreamList&, int row, Parser::SortKey, Parser::SortKeyFunction custom);
+    static QString hostKey(const QStringRef& url);
+    static QString prefixKey(const QStringRef& name);
+};
+
+#endif // STREAMSORTER_H
@@ -0,0 +1,455 @@
+#include "streamtablemodel.h"
+#include "profiler.h"
+
+#include <QBrush>
+#include <QDataStream>
+#include <QMimeData>
+#include <QStringList>
+#include <algorithm>
+
+// Rows dragged within the view.
+static const char kRowsMimeType[] = "application/x-etsradiomanager-rows";
+
+StreamTableModel::StreamTableModel(QObject *parent) :
+    QAbstractTableModel(parent),
+    parser_(NULL)
+{
+}
+
+
+void StreamTableModel::setParser(Parser* parser)
+{
+    beginResetModel();
+    this->parser_ = parser;
+    endResetModel();
+}
+
+
+Parser* StreamTableModel::parser() const
+{
+    return parser_;
+}
+
+
+int StreamTableModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid() || parser_ == NULL) {
+        return 0;
+    }
+    return parser_->streamCount();
+}
+
+
+int StreamTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : COLUMN_COUNT;
+}
+
+
+QVariant StreamTableModel::data(const QModelIndex &index, int role) const
+{
+/*
+Only called for the cells the view is currently showing, so no per-row
+objects exist besides the parser's own entries.
+*/
+    if (!index.isValid() || parser_ == NULL) {
+        return QVariant();
+    }
+
+    if (index.column() == STATUS_COL) {
+        return checkData(index.row(), role);
+    }
+    if (role != Qt::DisplayRole && role != Qt::ToolTipRole) {
+        return QVariant();
+    }
+
+    const Stream s = parser_->streamAt(index.row());
+    return (index.column() == URL_COL) ? s.url : s.name;
+}
+
+
+QVariant StreamTableModel::checkData(int row, int role) const
+{
+    if (check_results_.isEmpty()) {
+        return QVariant();
+    }
+    QHash<QString, CheckResult>::const_iterator it =
+        check_results_.constFind(parser_->urlPartsAt(row).normalized);
+    if (it == check_results_.constEnd()) {
+        return QVariant();
+    }
+
+    switch (role) {
+    case Qt::DisplayRole:
+        return it->summary();
+    case Qt::ToolTipRole:
+        return QString(tr("%1\nLatency: %2 ms\nType: %3\nStation: %4"))
+               .arg(it->summary()).arg(it->latency_ms).arg(it->content_type).arg(it->icy_name);
+    case Qt::ForegroundRole:
+        if (it->status == CheckResult::Online) {
+            return QBrush(Qt::darkGreen);
+        }
+        return QBrush(it->status == CheckResult::Timeout ? Qt::darkYellow : Qt::red);
+    default:
+        return QVariant();
+    }
+}
+
+
+QVariant StreamTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    if (orientation == Qt::Vertical) {
+        return section + 1;
+    }
+    if (section == STATUS_COL) {
+        return tr("Status");
+    }
+    return (section == URL_COL) ? tr("URL") : tr("Description");
+}
+
+
+void StreamTableModel::swapStreams(int a, int b)
+{
+    ETS_PROFILE_SCOPE("StreamTableModel::swapStreams");
+    if (a == b) {
+        return;
+    }
+    if (a > b) {
+        qSwap(a, b);
+    }
+
+    if (b == a + 1) {
+        // Neighbours: moving the lower row above the upper one keeps the
+        // selection (and any other persistent index) on the moved entry.
+        beginMoveRows(QModelIndex(), b, b, QModelIndex(), a);
+        parser_->swapStreams(a, b);
+        endMoveRows();
+    }
+    else {
+        parser_->swapStreams(a, b);
+        emit dataChanged(index(a, 0), index(a, COLUMN_COUNT-1));
+        emit dataChanged(index(b, 0), index(b, COLUMN_COUNT-1));
+    }
+}
+
+
+void StreamTableModel::insertStream(const Stream& s)
+{
+    const int row = parser_->streamCount();
+    beginInsertRows(QModelIndex(), row, row);
+    parser_->insertStream(s);
+    endInsertRows();
+}
+
+
+void StreamTableModel::removeStream(int row)
+{
+    beginRemoveRows(QModelIndex(), row, row);
+    parser_->deleteStream(row);
+    endRemoveRows();
+}
+
+
+int StreamTableModel::moveStreams(QList<int> rows, int target)
+{
+/*
+The parser moves all the rows in one pass, and the views get a single layout
+change. Persistent indexes (the selection, among them) follow their entries,
+so the moved rows stay selected.
+*/
+    ETS_PROFILE_SCOPE("StreamTableModel::moveStreams");
+    sortRows(rows);
+    if (rows.isEmpty()) {
+        return target;
+    }
+
+    const QVector<int> new_rows = movedRows(rows, target, parser_->streamCount());
+    emit layoutAboutToBeChanged();
+    const int first = parser_->moveStreams(rows, target);
+    remapPersistentRows(new_rows);
+    emit layoutChanged();
+    return first;
+}
+
+
+void StreamTableModel::restoreMovedStreams(const QList<int>& rows, int target)
+{
+    // Entry i goes back to where moveStreams() left it from.
+    const QVector<int> order = movedRows(rows, target, parser_->streamCount());
+    QVector<int> new_rows(order.size());
+    for (int i = 0; i < order.size(); i++) {
+        new_rows[order.at(i)] = i;
+    }
+    permuteStreams(order, new_rows);
+}
+
+
+void StreamTableModel::reorderStreams(const QVector<int>& order)
+{
+    ETS_PROFILE_SCOPE("StreamTableModel::reorderStreams");
+    QVector<int> new_rows(order.size());
+    for (int i = 0; i < order.size(); i++) {
+        new_rows[order.at(i)] = i;
+    }
+    permuteStreams(order, new_rows);
+}
+
+
+void StreamTableModel::permuteStreams(const QVector<int>& order, const QVector<int>& new_rows)
+{ // new_rows is the inverse of order.
+    emit layoutAboutToBeChanged();
+    parser_->permuteStreams(order);
+    remapPersistentRows(new_rows);
+    emit layoutChanged();
+}
+
+
+QVector<int> StreamTableModel::movedRows(const QList<int>& rows, int target, int count)
+{
+/*
+Position of every row after moving rows (ascending) before target: the ones
+that stay shift back by the moved rows before them, and forward by all of them
+if they are after target.
+*/
+    const int first = target - int(std::lower_bound(rows.begin(), rows.end(), target) - rows.begin());
+    QVector<int> new_rows(count);
+    int moved = 0;
+    for (int i = 0; i < count; i++) {
+        if (moved < rows.size() && rows.at(moved) == i) {
+            new_rows[i] = first + moved;
+            moved++;
+        }
+        else {
+            new_rows[i] = (i < target) ? i - moved : i - moved + rows.size();
+        }
+    }
+    return new_rows;
+}
+
+
+void StreamTableModel::removeStreams(QList<int> rows)
+{
+    sortRows(rows);
+    if (rows.isEmpty()) {
+        return;
+    }
+
+    // A single range is a plain removal; otherwise the remaining rows are
+    // shifted in one layout change instead of one removal per range.
+    if (rows.last() - rows.first() + 1 == rows.size()) {
+        beginRemoveRows(QModelIndex(), rows.first(), rows.last());
+        parser_->removeStreams(rows);
+        endRemoveRows();
+        return;
+    }
+
+    emit layoutAboutToBeChanged();
+    QVector<int> new_rows(parser_->streamCount());
+    int removed = 0;
+    for (int i = 0; i < new_rows.size(); i++) {
+        if (removed < rows.size() && rows.at(removed) == i) {
+            new_rows[i] = -1;
+            removed++;
+        }
+        else {
+            new_rows[i] = i - removed;
+        }
+    }
+    parser_->removeStreams(rows);
+    remapPersistentRows(new_rows);
+    emit layoutChanged();
+}
+
+
+void StreamTableModel::insertStreams(const QList<int>& rows, const QList<Stream>& streams)
+{
+    if (rows.isEmpty()) {
+        return;
+    }
+
+    if (rows.last() - rows.first() + 1 == rows.size()) {
+        beginInsertRows(QModelIndex(), rows.first(), rows.last());
+        parser_->insertStreams(rows, streams);
+        endInsertRows();
+        return;
+    }
+
+    // Old row i ends up shifted by the rows inserted before it.
+    emit layoutAboutToBeChanged();
+    QVector<int> new_rows(parser_->streamCount());
+    int inserted = 0;
+    for (int i = 0; i < new_rows.size(); i++) {
+        while (inserted < rows.size() && rows.at(inserted) <= i + inserted) {
+            inserted++;
+        }
+        new_rows[i] = i + inserted;
+    }
+    parser_->insertStreams(rows, streams);
+    remapPersistentRows(new_rows);
+    emit layoutChanged();
+}
+
+
+void StreamTableModel::remapPersistentRows(const QVector<int>& new_rows)
+{ // new_rows: new position of each old row, -1 if it was removed.
+    const QModelIndexList from = persistentIndexList();
+    QModelIndexList to;
+    foreach (const QModelIndex& i, from) {
+        const int row = new_rows.value(i.row(), -1);
+        to.append(row == -1 ? QModelIndex() : index(row, i.column()));
+    }
+    changePersistentIndexList(from, to);
+    emit rowsRemapped(new_rows);
+}
+
+
+void StreamTableModel::sortRows(QList<int>& rows)
+{
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+}
+
+
+Qt::ItemFlags StreamTableModel::flags(const QModelIndex &index) const
+{
+    // Drops land between rows, never on them.
+    if (!index.isValid()) {
+        return Qt::ItemIsDropEnabled;
+    }
+    return QAbstractTableModel::flags(index) | Qt::ItemIsDragEnabled;
+}
+
+
+Qt::DropActions StreamTableModel::supportedDropActions() const
+{
+    return Qt::MoveAction;
+}
+
+
+QStringList StreamTableModel::mimeTypes() const
+{
+    return QStringList(kRowsMimeType);
+}
+
+
+QMimeData* StreamTableModel::mimeData(const QModelIndexList &indexes) const
+{ // Only the row numbers: the entries themselves never leave the parser.
+    QList<int> rows;
+    foreach (const QModelIndex& i, indexes) {
+        rows.append(i.row());
+    }
+    sortRows(rows);
+
+    QByteArray encoded;
+    QDataStream stream(&encoded, QIODevice::WriteOnly);
+    stream << rows;
+
+    QMimeData* data = new QMimeData();
+    data->setData(kRowsMimeType, encoded);
+    return data;
+}
+
+
+bool StreamTableModel::dropMimeData(const QMimeData *data, Qt::DropAction action,
+                                    int row, int column, const QModelIndex &parent)
+{
+/*
+Asks for the dragged rows to be moved to the drop position. The view then asks
+to remove the source rows, which this model does not allow (removeRows() is
+not reimplemented), so the move is all that happens.
+*/
+    Q_UNUSED(column);
+    if (action != Qt::MoveAction || parser_ == NULL || !data->hasFormat(kRowsMimeType)) {
+        return false;
+    }
+
+    // Dropped on a row: before it. Past the last row: at the end.
+    if (row == -1) {
+        row = parent.isValid() ? parent.row() : rowCount();
+    }
+
+    QList<int> rows;
+    QDataStream stream(data->data(kRowsMimeType));
+    stream >> rows;
+    if (rows.isEmpty() || rows.first() < 0 || rows.last() >= rowCount()) {
+        return false;
+    }
+
+    emit dropRequested(rows, row);
+    return true;
+}
+
+
+void StreamTableModel::editStream(int row, const Stream& s)
+{
+    parser_->editStream(row, s);
+    emit dataChanged(index(row, 0), index(row, COLUMN_COUNT-1));
+}
+
+
+void StreamTableModel::appendBlock(const ParsedBlock& block)
+{
+    ETS_PROFILE_SCOPE("StreamTableModel::appendBlock");
+    if (block.streams.isEmpty()) {
+        parser_->appendBlock(block);  // Might still carry the definition line and skeleton.
+        return;
+    }
+
+    const int row = parser_->streamCount();
+    beginInsertRows(QModelIndex(), row, row + block.streams.size() - 1);
+    parser_->appendBlock(block);
+    endInsertRows();
+}
+
+
+StreamDiff StreamTableModel::reloadStreams(const Parser& fresh)
+{
+/*
+The parser takes the contents of the fresh one (entries, offsets and file
+stamp), and the views are only told about the region that changed: the rows
+both versions have there are changed in place, and the rest are inserted or
+removed at its end.
+*/
+    ETS_PROFILE_SCOPE("StreamTableModel::reloadStreams");
+    const StreamDiff diff = StreamDiff::compute(parser_->streamList(), fresh.streamList());
+    const int old_rows = diff.old_end - diff.first;
+    const int new_rows = diff.new_end - diff.first;
+
+    if (new_rows > old_rows) {
+        beginInsertRows(QModelIndex(), diff.old_end, diff.new_end - 1);
+        *parser_ = fresh;
+        endInsertRows();
+    }
+    else if (new_rows < old_rows) {
+        beginRemoveRows(QModelIndex(), diff.new_end, diff.old_end - 1);
+        *parser_ = fresh;
+        endRemoveRows();
+    }
+    else {
+        *parser_ = fresh;
+    }
+
+    const int changed = qMin(old_rows, new_rows);
+    if (changed > 0) {
+        emit dataChanged(index(diff.first, 0), index(diff.first + changed - 1, COLUMN_COUNT-1));
+    }
+    return diff;
+}
+
+
+void StreamTableModel::setCheckResult(const QString& url, const CheckResult& result)
+{
+    check_results_.insert(Parser::normalizeUrl(url), result);
+
+    // Every entry with the URL shows the result, repeated ones included.
+    if (parser_ == NULL) {
+        return;
+    }
+    foreach (int row, parser_->urlRows(url)) {
+        emit dataChanged(index(row, STATUS_COL), index(row, STATUS_COL));
+    }
+}
+
@@ -0,0 +1,76 @@
+#ifndef STREAMTABLEMODEL_H
+#define STREAMTABLEMODEL_H
+
+#include <QAbstractTableModel>
+
+#include "parser.h"
+#include "streamchecker.h"
+#include "streamdiff.h"
+
+// Exposes a Parser's entries to item views without copying them.
+// All changes made through the model are forwarded to the parser and
+// notified to the views.
+class StreamTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column {DESC_COL=0, URL_COL=1, STATUS_COL=2, COLUMN_COUNT};
+
+    explicit StreamTableModel(QObject *parent = 0);
+
+    void setParser(Parser*);   // Not owned.
+    Parser* parser() const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const;
+
+    // Rows are reordered by dragging them within the view.
+    Qt::ItemFlags flags(const QModelIndex &index) const;
+    Qt::DropActions supportedDropActions() const;
+    QStringList mimeTypes() const;
+    QMimeData* mimeData(const QModelIndexList &indexes) const;
+    bool dropMimeData(const QMimeData *data, Qt::DropAction action,
+                      int row, int column, const QModelIndex &parent);
+
+    void swapStreams(int, int);
+    void insertStream(const Stream&);
+    void removeStream(int);
+    int moveStreams(QList<int>, int);   // Returns where the rows start now.
+    void restoreMovedStreams(const QList<int>&, int);  // Undoes moveStreams().
+    void reorderStreams(const QVector<int>&);   // Entry i becomes the old entry order[i].
+    void removeStreams(QList<int>);
+    void insertStreams(const QList<int>&, const QList<Stream>&);  // Undoes removeStreams().
+    void editStream(int, const Stream&);
+    void appendBlock(const ParsedBlock&);
+    StreamDiff reloadStreams(const Parser&);   // The file read again, after it changed on disk.
+
+public slots:
+    // Shown in the status column of the entries with that URL.
+    void setCheckResult(const QString& url, const CheckResult&);
+
+signals:
+    // Rows were dropped before target. The move is left to the receiver, so
+    // that it can go through the undo history.
+    void dropRequested(const QList<int>& rows, int target);
+
+    // Sent inside the layout changes that move, remove or insert rows (before
+    // layoutChanged()): the new position of each old row, -1 if it was
+    // removed.
+    void rowsRemapped(const QVector<int>& new_rows);
+
+private:
+    Parser* parser_;
+    QHash<QString, CheckResult> check_results_;  // By normalized URL.
+
+    void permuteStreams(const QVector<int>&, const QVector<int>&);
+    void remapPersistentRows(const QVector<int>&);
+    QVariant checkData(int row, int role) const;
+    static QVector<int> movedRows(const QList<int>&, int, int);
+    static void sortRows(QList<int>&);
+};
+
+#endif // STREAMTABLEMODEL_H
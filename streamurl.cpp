@@ -0,0 +1,83 @@
+#include "streamurl.h"
+
+#include <QHash>
+
+// Where the host (and port) of a URL ends: at the path, the query or the
+// fragment, whichever comes first.
+static int hostEnd(const QString& text, int authority)
+{
+    int end = authority;
+    while (end < text.size() && text.at(end) != '/' && text.at(end) != '?' && text.at(end) != '#') {
+        end++;
+    }
+    return end;
+}
+
+// Where the scheme ends (its "://"), -1 if the URL has none. It can only come
+// before the path, query and fragment, which may well hold URLs of their own.
+static int schemeEnd(const QString& text)
+{
+    const int scheme_end = text.indexOf(QLatin1String("://"));
+    return (scheme_end != -1 && scheme_end < hostEnd(text, 0)) ? scheme_end : -1;
+}
+
+StreamUrl StreamUrl::parse(const QStringRef& url)
+{
+    StreamUrl res;
+    res.parsed      = true;
+    res.normalized  = normalize(url.toString());
+    res.hash        = qHash(res.normalized);
+
+    // The normalized URL is already trimmed, and lower case up to the path.
+    const QString& text = res.normalized;
+    const int scheme_end = schemeEnd(text);
+    const int authority = (scheme_end == -1) ? 0 : scheme_end + 3;
+    if (scheme_end != -1) {
+        res.scheme = text.left(scheme_end);
+    }
+
+    const int host_end = hostEnd(text, authority);
+    res.path = text.mid(host_end);
+
+    const int at = (host_end > authority) ? text.lastIndexOf('@', host_end - 1) : -1;
+    const int host = (at >= authority) ? at + 1 : authority;
+    int port = -1;
+    if (host < host_end && text.at(host) == '[') {     // IPv6.
+        const int close = text.indexOf(']', host);
+        if (close != -1 && close < host_end && close + 1 < host_end && text.at(close + 1) == ':') {
+            port = close + 1;
+        }
+    }
+    else {
+        port = text.indexOf(':', host);
+        if (port >= host_end) {
+            port = -1;
+        }
+    }
+
+    res.host = text.mid(host, (port == -1 ? host_end : port) - host);
+    if (port != -1) {
+        bool ok = false;
+        res.port = text.mid(port + 1, host_end - port - 1).toInt(&ok);
+        if (!ok) {
+            res.port = -1;
+        }
+    }
+    return res;
+}
+
+QString StreamUrl::normalize(const QString& url)
+{
+    QString res = url.trimmed();
+
+    const int scheme_end = schemeEnd(res);
+    const int host_end = hostEnd(res, scheme_end == -1 ? 0 : scheme_end + 3);
+    for (int i = 0; i < host_end; i++) {
+        res[i] = res.at(i).toLower();
+    }
+
+    while (res.size() > host_end && res.endsWith('/')) {
+        res.chop(1);
+    }
+    return res;
+}
@@ -0,0 +1,29 @@
+#ifndef STREAMURL_H
+#define STREAMURL_H
+
+#include <QString>
+#include <QStringRef>
+
+// The parts of a stream URL, cut from its text without going through QUrl
+// (which is far slower, and rejects some URLs the game accepts). Lists keep
+// them for their entries once they are first asked for (see
+// StreamList::urlParts()).
+struct StreamUrl {
+    QString scheme;         // Lower case, without "://". Empty if there is none.
+    QString host;           // Lower case, without user name or port.
+    int port;               // -1 if the URL does not give one.
+    QString path;           // Whatever follows the host (path, query and fragment).
+    QString normalized;     // As given by normalize().
+    uint hash;              // qHash() of normalized.
+    bool parsed;            // False for the empty parts of an entry not parsed yet.
+
+    StreamUrl(): port(-1), hash(0), parsed(false) {}
+
+    static StreamUrl parse(const QStringRef&);
+
+    // URLs that only differ in the case of their scheme and host, surrounding
+    // blanks or trailing slashes point to the same stream.
+    static QString normalize(const QString&);
+};
+
+#endif // STREAMURL_H
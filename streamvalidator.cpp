@@ -0,0 +1,473 @@
+#include "streamvalidator.h"
+#include "linescanner.h"
+#include "parser.h"
+#include "profiler.h"
+#include "streamurl.h"
+
+#include <QFile>
+#include <cstring>
+
+static inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static bool startsWith(const char* begin, const char* end, const char* prefix)
+{
+    const qptrdiff length = qstrlen(prefix);
+    return end - begin >= length && memcmp(begin, prefix, length) == 0;
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Length of a UTF-8 sequence given its lead byte, 0 if it cannot start one.
+static int utf8Length(uint c)
+{
+    if (c < 0x80)   return 1;
+    if (c < 0xC2)   return 0;
+    if (c < 0xE0)   return 2;
+    if (c < 0xF0)   return 3;
+    if (c < 0xF5)   return 4;
+    return 0;
+}
+
+
+QString StreamDiagnostic::toString() const
+{
+    return QString("%1:%2: %3: %4 (byte %5)")
+           .arg(line).arg(column).arg(severity == Error ? "error" : "warning")
+           .arg(message).arg(offset);
+}
+
+
+StreamValidator::StreamValidator(int max_diagnostics):
+max_diagnostics_(max_diagnostics)
+{
+    reset(NULL, NULL);
+}
+
+void StreamValidator::reset(const char* file_begin, const char* begin)
+{
+    diagnostics_.clear();
+    errors_                     = 0;
+    warnings_                   = 0;
+    entries_                    = 0;
+    file_begin_                 = file_begin;
+    line_begin_                 = begin;
+    line_end_                   = begin;
+    line_                       = 0;
+    depth_                      = 0;
+    header_seen_                = false;
+    definition_seen_            = false;
+    declared_count_             = -1;
+    declared_count_line_        = 0;
+    declared_count_line_begin_  = NULL;
+    declared_count_at_          = NULL;
+    url_lines_.clear();
+}
+
+bool StreamValidator::checkFile(const QString& filename, ParsedBlock* block)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    // Mapped if possible, like Parser::readStreamsMapped() does.
+    const qint64 size = file.size();
+    QByteArray buffer;
+    const char* begin = (size > 0) ? reinterpret_cast<const char*>(file.map(0, size)) : NULL;
+    if (begin == NULL) {
+        buffer = file.readAll();
+        begin = buffer.constData();
+    }
+    check(begin, begin + (buffer.isNull() ? size : buffer.size()), block);
+    return true;
+}
+
+void StreamValidator::check(const char* begin, const char* end, ParsedBlock* block)
+{
+/*
+The lines are found by the LineScanner, a window of about kScanWindow bytes at
+a time, as in Parser::parseBlock(). Most lines are entries, which only need
+their quotes and separator (in the line table) and one walk over their bytes
+to be checked; the checks of the file as a whole (header, definition, braces,
+number of entries) are left for the end.
+*/
+    static const qptrdiff kScanWindow = 1 << 20;
+    ETS_PROFILE_SCOPE("StreamValidator::check");
+
+    const char* data = begin;
+    if (end - data >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+        data += 3;
+    }
+    reset(begin, data);
+
+    // Encrypted and binary files have no lines to check, and are only decoded.
+    if (Parser::isBinary(begin, end)) {
+        const ParsedBlock decoded = Parser::parseBinary(begin, end);
+        if (!decoded.error.isEmpty()) {
+            report(StreamDiagnostic::Error, StreamDiagnostic::BinaryFile, 1, begin, begin,
+                   "cannot be decoded: " + decoded.error);
+        }
+        else {
+            report(StreamDiagnostic::Warning, StreamDiagnostic::BinaryFile, 1, begin, begin,
+                   "encrypted or binary file, only decoded");
+        }
+        entries_ = decoded.streams.size();
+        if (block != NULL) {
+            *block = decoded;
+        }
+        return;
+    }
+
+    QVector<LineInfo> lines;
+    while (data < end) {
+        const char* window_end = end;
+        if (end - data > kScanWindow) {
+            window_end = static_cast<const char*>(memchr(data + kScanWindow, '\n', end - data - kScanWindow));
+            window_end = window_end ? window_end + 1 : end;
+        }
+
+        lines.clear();
+        LineScanner::scan(data, window_end, lines);
+        ETS_PROFILE_COUNT("lines validated", lines.size());
+
+        QVector<LineInfo>::const_iterator it = lines.constBegin();
+        for (; it != lines.constEnd(); it++) {
+            line_++;
+            line_begin_ = data + it->begin;
+            line_end_   = line_begin_ + it->length;
+            checkLine(*it, block);
+        }
+        data = window_end;
+    }
+
+    // Problems of the file as a whole are put at its end.
+    const int last_line = qMax(line_, 1);
+    if (!header_seen_) {
+        report(StreamDiagnostic::Error, StreamDiagnostic::MissingHeader, last_line, line_begin_, line_end_,
+               "the file is empty");
+    }
+    if (depth_ > 0) {
+        report(StreamDiagnostic::Error, StreamDiagnostic::UnbalancedBraces, last_line, line_begin_, line_end_,
+               QString("%1 '{' not closed at the end of the file").arg(depth_));
+    }
+    if (!definition_seen_) {
+        report(StreamDiagnostic::Error, StreamDiagnostic::MissingDefinition, last_line, line_begin_, line_end_,
+               "no live_stream_def line");
+    }
+    if (declared_count_ >= 0 && declared_count_ != entries_) {
+        report(StreamDiagnostic::Warning, StreamDiagnostic::CountMismatch,
+               declared_count_line_, declared_count_line_begin_, declared_count_at_,
+               QString("%1 entries declared, %2 found").arg(declared_count_).arg(entries_));
+    }
+    ETS_PROFILE_COUNT("problems found", errors_ + warnings_);
+}
+
+void StreamValidator::checkLine(const LineInfo& info, ParsedBlock* block)
+{
+    const char* text = line_begin_;
+    const char* text_end = line_end_;
+    while (text < text_end && isBlank(*text)) {
+        text++;
+    }
+    while (text_end > text && isBlank(text_end[-1])) {
+        text_end--;
+    }
+    if (text == text_end || *text == '#' || startsWith(text, text_end, "//")) {
+        return;     // Blank lines and comments.
+    }
+
+    if (!header_seen_) {
+        header_seen_ = true;
+        if (text_end - text == 8 && startsWith(text, text_end, "SiiNunit")) {
+            return;
+        }
+        report(StreamDiagnostic::Error, StreamDiagnostic::MissingHeader, text,
+               "the file does not start with \"SiiNunit\"");
+    }
+
+    if (info.first_quote < 0) {
+        checkStructure(text, text_end, block);
+    }
+    else {
+        checkEntry(info, text, block);
+    }
+}
+
+void StreamValidator::checkStructure(const char* begin, const char* end, ParsedBlock* block)
+{
+/*
+Lines without quotes: braces, the definition line and the number of entries
+("stream_data: n"). Like the readers, any of them that mentions
+live_stream_def is taken as the definition line.
+*/
+    bool braces_only = true;
+    for (const char* p = begin; p < end; p++) {
+        if (*p == '{') {
+            depth_++;
+        }
+        else if (*p == '}') {
+            if (depth_ == 0) {
+                report(StreamDiagnostic::Error, StreamDiagnostic::UnbalancedBraces, p, "'}' without a matching '{'");
+            }
+            else {
+                depth_--;
+            }
+        }
+        else if (!isBlank(*p)) {
+            braces_only = false;
+        }
+    }
+    if (braces_only) {
+        return;
+    }
+
+    if (QByteArray::fromRawData(begin, int(end - begin)).toLower().contains("live_stream_def")) {
+        definition_seen_ = true;
+        if (block != NULL) {
+            block->live_stream_def_line = QString::fromUtf8(line_begin_, int(line_end_ - line_begin_));
+        }
+        return;
+    }
+
+    if (startsWith(begin, end, "stream_data:")) {
+        const char* number = begin + 12;
+        while (number < end && isBlank(*number)) {
+            number++;
+        }
+        bool ok = false;
+        const int count = QByteArray(number, int(end - number)).toInt(&ok);
+        if (!ok || count < 0) {
+            report(StreamDiagnostic::Warning, StreamDiagnostic::UnexpectedLine, number,
+                   "stream_data: is not followed by a number of entries");
+            return;
+        }
+        declared_count_             = count;
+        declared_count_line_        = line_;
+        declared_count_line_begin_  = line_begin_;
+        declared_count_at_          = number;
+        return;
+    }
+
+    if (startsWith(begin, end, "stream_data[")) {
+        report(StreamDiagnostic::Error, StreamDiagnostic::MissingQuote, begin,
+               "entry without a quoted value; it is skipped");
+        return;
+    }
+    report(StreamDiagnostic::Warning, StreamDiagnostic::UnexpectedLine, begin, "unexpected text");
+}
+
+void StreamValidator::checkEntry(const LineInfo& info, const char* text, ParsedBlock* block)
+{
+/*
+Lines with quotes are read as entries by the readers, whatever comes before
+the first quote, as long as there is a '|' between the first and the last
+quote. Those are the entries counted, and parsed into the block.
+*/
+    const char* first_quote = line_begin_ + info.first_quote;
+    const char* last_quote  = line_begin_ + info.last_quote;
+
+    if (startsWith(text, first_quote, "stream_data[")) {
+        const char* digits = text + 12;
+        const char* p = digits;
+        int index = 0;
+        while (p < first_quote && *p >= '0' && *p <= '9' && p - digits < 9) {
+            index = index * 10 + (*p++ - '0');
+        }
+        if (p == digits || p == first_quote || *p != ']') {
+            report(StreamDiagnostic::Warning, StreamDiagnostic::WrongIndex, digits,
+                   "stream_data[] without a valid index");
+        }
+        else if (index != entries_) {
+            report(StreamDiagnostic::Warning, StreamDiagnostic::WrongIndex, digits,
+                   QString("entry %1 is numbered %2").arg(entries_).arg(index));
+        }
+    }
+    else {
+        report(StreamDiagnostic::Warning, StreamDiagnostic::UnexpectedLine, text,
+               "quoted text outside of a stream_data[] entry");
+    }
+
+    if (last_quote == first_quote) {
+        report(StreamDiagnostic::Error, StreamDiagnostic::UnterminatedQuote, first_quote,
+               "missing closing quote; the entry is skipped");
+        return;
+    }
+    for (const char* p = last_quote + 1; p < line_end_; p++) {
+        if (!isBlank(*p)) {
+            report(StreamDiagnostic::Warning, StreamDiagnostic::TrailingText, p, "text after the closing quote");
+            break;
+        }
+    }
+    if (info.separator < info.first_quote || info.separator > info.last_quote) {
+        report(StreamDiagnostic::Error, StreamDiagnostic::MissingSeparator, first_quote + 1,
+               "no '|' between the URL and the name; the entry is skipped");
+        return;
+    }
+
+    const char* url         = first_quote + 1;
+    const char* separator   = line_begin_ + info.separator;
+    const char* name        = separator + 1;
+    if (url == separator) {
+        report(StreamDiagnostic::Error, StreamDiagnostic::EmptyUrl, url, "empty URL");
+    }
+    else if (!QByteArray::fromRawData(url, int(separator - url)).contains("://")) {
+        report(StreamDiagnostic::Error, StreamDiagnostic::MissingScheme, url,
+               "URL without a scheme (such as \"http://\")");
+    }
+    checkText(url, separator, false);
+    if (name == last_quote) {
+        report(StreamDiagnostic::Warning, StreamDiagnostic::EmptyName, name, "empty name");
+    }
+    checkText(name, last_quote, info.escaped);
+
+    if (url != separator) {
+        const QString normalized = StreamUrl::normalize(QString::fromUtf8(url, int(separator - url)));
+        QHash<QString, int>::const_iterator found = url_lines_.constFind(normalized);
+        if (found != url_lines_.constEnd()) {
+            report(StreamDiagnostic::Warning, StreamDiagnostic::DuplicateUrl, url,
+                   QString("same URL as the entry on line %1").arg(found.value()));
+        }
+        else {
+            url_lines_.insert(normalized, line_);
+        }
+    }
+
+    if (block != NULL) {
+        Parser::parseEntry(*block, line_begin_ - file_begin_, url, separator, last_quote, info.escaped);
+    }
+    entries_++;
+}
+
+void StreamValidator::checkText(const char* p, const char* end, bool unescape)
+{
+/*
+Walks the bytes of a field as decodeString() (in parser.cpp) decodes them,
+reporting the escapes it keeps as they are and the byte sequences that it
+turns into U+FFFD.
+*/
+    static const uint kMinimum[] = {0, 0, 0x80, 0x800, 0x10000};
+
+    const char* sequence = NULL;    // Start of the UTF-8 sequence being read.
+    int length = 0;
+    int pending = 0;                // Continuation bytes still expected.
+    uint c = 0;
+    while (p < end) {
+        const char* at = p;
+        uint b = uchar(*p++);
+        if (b == '\\' && unescape) {
+            if (end - at >= 2 && at[1] == 'x') {
+                if (end - at < 4) {
+                    report(StreamDiagnostic::Error, StreamDiagnostic::TruncatedEscape, at,
+                           "\\x escape cut short; it is kept as it is");
+                }
+                else if (hexValue(at[2]) < 0 || hexValue(at[3]) < 0) {
+                    report(StreamDiagnostic::Error, StreamDiagnostic::InvalidEscape, at,
+                           "\\x not followed by two hex digits; it is kept as it is");
+                }
+                else {
+                    b = uint((hexValue(at[2]) << 4) | hexValue(at[3]));
+                    p = at + 4;
+                }
+            }
+            else {
+                report(StreamDiagnostic::Warning, StreamDiagnostic::InvalidEscape, at,
+                       "'\\' that does not start a \\xNN escape; it is kept as it is");
+            }
+        }
+
+        if (pending > 0) {
+            if ((b & 0xC0) == 0x80) {
+                c = (c << 6) | (b & 0x3F);
+                if (--pending == 0 && (c < kMinimum[length] || c > 0x10FFFF || (c >= 0xD800 && c < 0xE000))) {
+                    report(StreamDiagnostic::Error, StreamDiagnostic::InvalidUtf8, sequence,
+                           QString("invalid UTF-8 sequence (U+%1)").arg(c, 4, 16, QChar('0')));
+                }
+                continue;
+            }
+            report(StreamDiagnostic::Error, StreamDiagnostic::InvalidUtf8, sequence, "UTF-8 sequence cut short");
+            pending = 0;    // This byte starts over.
+        }
+
+        length = utf8Length(b);
+        if (length == 0) {
+            report(StreamDiagnostic::Error, StreamDiagnostic::InvalidUtf8, at,
+                   QString("byte 0x%1 cannot start a UTF-8 sequence").arg(b, 2, 16, QChar('0')));
+        }
+        else if (length > 1) {
+            sequence    = at;
+            pending     = length - 1;
+            c           = b & (0x7F >> length);
+        }
+    }
+    if (pending > 0) {
+        report(StreamDiagnostic::Error, StreamDiagnostic::InvalidUtf8, sequence, "UTF-8 sequence cut short");
+    }
+}
+
+void StreamValidator::report(StreamDiagnostic::Severity severity, StreamDiagnostic::Code code,
+                             const char* at, const QString& message)
+{
+    report(severity, code, line_, line_begin_, at, message);
+}
+
+void StreamValidator::report(StreamDiagnostic::Severity severity, StreamDiagnostic::Code code,
+                             int line, const char* line_begin, const char* at, const QString& message)
+{
+    if (severity == StreamDiagnostic::Error) {
+        errors_++;
+    }
+    else {
+        warnings_++;
+    }
+    if (diagnostics_.size() >= max_diagnostics_) {
+        return;
+    }
+
+    StreamDiagnostic d;
+    d.severity  = severity;
+    d.code      = code;
+    d.line      = line;
+    d.column    = int(at - line_begin) + 1;
+    d.offset    = at - file_begin_;
+    d.message   = message;
+    diagnostics_.append(d);
+}
+
+bool StreamValidator::isValid() const
+{
+    return errors_ == 0;
+}
+
+int StreamValidator::errorCount() const
+{
+    return errors_;
+}
+
+int StreamValidator::warningCount() const
+{
+    return warnings_;
+}
+
+int StreamValidator::lineCount() const
+{
+    return line_;
+}
+
+int StreamValidator::entryCount() const
+{
+    return entries_;
+}
+
+const QList<StreamDiagnostic>& StreamValidator::diagnostics() const
+{
+    return diagnostics_;
+}
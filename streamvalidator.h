@@ -0,0 +1,108 @@
+#ifndef STREAMVALIDATOR_H
+#define STREAMVALIDATOR_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+
+struct ParsedBlock;
+struct LineInfo;
+
+// A problem found in a .sii file. Lines and columns count from 1; columns are
+// in bytes, from the start of the line (after the BOM, on the first line).
+struct StreamDiagnostic {
+    enum Severity {
+        Warning,            // The file reads, but maybe not as intended.
+        Error               // The game, or the readers, will get it wrong.
+    };
+
+    enum Code {
+        MissingHeader,      // The file does not start with "SiiNunit".
+        BinaryFile,         // Encrypted or binary: decoded, but not checked.
+        MissingDefinition,  // No live_stream_def line.
+        UnbalancedBraces,
+        UnexpectedLine,     // Text that is not part of the expected layout.
+        MissingQuote,       // A stream_data[] line without its quoted value.
+        UnterminatedQuote,  // Skipped by the readers.
+        MissingSeparator,   // No '|' between the quotes; skipped by the readers.
+        EmptyUrl,
+        MissingScheme,      // A URL without "://".
+        EmptyName,
+        TrailingText,       // After the closing quote.
+        TruncatedEscape,    // "\x" without two more characters; kept as it is.
+        InvalidEscape,      // "\x" and non hex digits, or another '\'; kept as it is.
+        InvalidUtf8,        // Decoded as U+FFFD.
+        WrongIndex,         // stream_data[i] out of sequence.
+        CountMismatch,      // "stream_data: n" does not match the entries.
+        DuplicateUrl        // Same normalized URL as an earlier entry.
+    };
+
+    Severity severity;
+    Code code;
+    int line;
+    int column;
+    qint64 offset;          // From the start of the file, in bytes.
+    QString message;
+
+    // "line:column: error: message (byte offset)", as compilers put it.
+    QString toString() const;
+};
+
+
+// Single-pass checker of .sii files, which finds every problem it can instead
+// of stopping at the first one: each line is checked on its own, so a broken
+// line is reported and the next one is read as usual. It can also parse the
+// entries into a block at the same time, getting the same entries as
+// Parser::parseBlock() (the line reader).
+class StreamValidator {
+public:
+    static const int kDefaultMaxDiagnostics = 1000;
+
+    // Only the first max_diagnostics problems are kept, though all of them
+    // are counted.
+    explicit StreamValidator(int max_diagnostics = kDefaultMaxDiagnostics);
+
+    // Checks a whole file in [begin, end), parsing its entries into block
+    // unless it is NULL (a pure scan).
+    void check(const char* begin, const char* end, ParsedBlock* block = NULL);
+    bool checkFile(const QString&, ParsedBlock* block = NULL);  // False if it cannot be read.
+
+    bool isValid() const;               // No errors (warnings are fine).
+    int errorCount() const;
+    int warningCount() const;
+    int lineCount() const;
+    int entryCount() const;             // Entries the readers get.
+    const QList<StreamDiagnostic>& diagnostics() const;
+
+private:
+    int max_diagnostics_;
+    QList<StreamDiagnostic> diagnostics_;
+    int errors_;
+    int warnings_;
+    int entries_;
+
+    // Where the scan is.
+    const char* file_begin_;
+    const char* line_begin_;
+    const char* line_end_;              // Without the terminator.
+    int line_;
+    int depth_;                         // Of braces.
+    bool header_seen_;
+    bool definition_seen_;
+    int declared_count_;                // Given by "stream_data: n", -1 if none.
+    int declared_count_line_;
+    const char* declared_count_line_begin_;
+    const char* declared_count_at_;
+    QHash<QString, int> url_lines_;     // Line of the first entry of each normalized URL.
+
+    void reset(const char* file_begin, const char* begin);
+    void checkLine(const LineInfo&, ParsedBlock*);
+    void checkStructure(const char* begin, const char* end, ParsedBlock*);
+    void checkEntry(const LineInfo&, const char* text, ParsedBlock*);
+    void checkText(const char* begin, const char* end, bool unescape);
+    void report(StreamDiagnostic::Severity, StreamDiagnostic::Code, const char* at, const QString&);
+    void report(StreamDiagnostic::Severity, StreamDiagnostic::Code, int line, const char* line_begin,
+                const char* at, const QString&);
+};
+
+#endif // STREAMVALIDATOR_H